@@ -35,15 +35,26 @@
   ------------------------------------------------------------------------*/
 
 #include "dotstar.h"
+#include <math.h>
 
 // fast pin access
+// portBSRR() is one 32-bit write to a port's BSRR: the low half sets pins,
+// the high half clears them, so data and clock can change together.
 #if PLATFORM_ID == 0 // Core
+  #define pinInfo(_pin) (PIN_MAP[_pin])
   #define pinLO(_pin) (PIN_MAP[_pin].gpio_peripheral->BRR = PIN_MAP[_pin].gpio_pin)
   #define pinHI(_pin) (PIN_MAP[_pin].gpio_peripheral->BSRR = PIN_MAP[_pin].gpio_pin)
+  #ifndef portBSRR
+    #define portBSRR(_port, _word) ((_port)->BSRR = (_word))
+  #endif
 #elif PLATFORM_ID == 6 || PLATFORM_ID == 8 || PLATFORM_ID == 10 // Photon (6), P1 (8) or Electron (10)
   STM32_Pin_Info* PIN_MAP2 = HAL_Pin_Map(); // Pointer required for highest access speed
+  #define pinInfo(_pin) (PIN_MAP2[_pin])
   #define pinLO(_pin) (PIN_MAP2[_pin].gpio_peripheral->BSRRH = PIN_MAP2[_pin].gpio_pin)
   #define pinHI(_pin) (PIN_MAP2[_pin].gpio_peripheral->BSRRL = PIN_MAP2[_pin].gpio_pin)
+  #ifndef portBSRR // BSRRL/BSRRH are the two halves of the F2's 32-bit BSRR
+    #define portBSRR(_port, _word) (*(volatile uint32_t *)&(_port)->BSRRL = (_word))
+  #endif
 #else
   #error "*** PLATFORM_ID not supported by this library. PLATFORM should be Core, Photon, P1 or Electron ***"
 #endif
@@ -52,15 +63,44 @@
 
 #define USE_HW_SPI 255 // Assign this to dataPin to indicate 'hard' SPI
 
-bool Adafruit_DotStar::hw_spi_DMA_TransferCompleted = true;
-uint16_t Adafruit_DotStar::spiStartTime;
+// Statistics hooks compile to nothing without DOTSTAR_STATS
+#if DOTSTAR_STATS
+  #define STATS(_x) _x
+#else
+  #define STATS(_x)
+#endif
+
+#define NO_BUFFER 0xFF // sendingBuffer value when no frame is on the wire
+
+// End frame source for partial frames.  Zeros rather than the 0xFF of a
+// full frame: past the last LED sent they look like a start frame to the
+// next LED, where 0xFF bytes would latch it to full white.
+static uint8_t zeroFrame[64];
+
+Adafruit_DotStar * volatile Adafruit_DotStar::busOwner[2] = { NULL, NULL };
 
 // Constructor for hardware SPI -- must connect to MOSI, SCK pins
-Adafruit_DotStar::Adafruit_DotStar(uint16_t n, uint8_t o, uint8_t s) :
+Adafruit_DotStar::Adafruit_DotStar(uint16_t n, uint8_t o, DotStarBus s) :
  numLEDs(n), dataPin(USE_HW_SPI), brightness(255), pixels(NULL),
  rOffset(o & 3), gOffset((o >> 2) & 3), bOffset((o >> 4) & 3)
-{ if(s==0) use_spi_1 = false;
+{ if(s==DOTSTAR_SPI) use_spi_1 = false;
   else     use_spi_1 = true;
+  resetStats();
+  updateLength(n);
+}
+
+// Constructor for hardware SPI with the frame in storage the caller owns
+// (e.g. a static array of DOTSTAR_FRAME_BYTES(n) bytes), so the strip
+// never touches the heap.  A multiple of that size also holds the extra
+// buffers of setBufferCount().  Storage that is too small leaves the
+// strip with 0 LEDs.
+Adafruit_DotStar::Adafruit_DotStar(uint16_t n, uint8_t *buf, uint32_t bytes,
+  uint8_t o, DotStarBus s) :
+ numLEDs(n), dataPin(USE_HW_SPI), brightness(255), pixels(NULL),
+ rOffset(o & 3), gOffset((o >> 2) & 3), bOffset((o >> 4) & 3),
+ use_spi_1(s != DOTSTAR_SPI), externalPixels(buf), externalBytes(bytes)
+{
+  resetStats();
   updateLength(n);
 }
 
@@ -70,11 +110,29 @@ Adafruit_DotStar::Adafruit_DotStar(uint16_t n, uint8_t data, uint8_t clock,
  dataPin(data), clockPin(clock), brightness(255), pixels(NULL),
  rOffset(o & 3), gOffset((o >> 2) & 3), bOffset((o >> 4) & 3)
 {
+  resetStats();
+  updateLength(n);
+}
+
+// Constructor for 'soft' (bitbang) SPI with caller-owned frame storage
+Adafruit_DotStar::Adafruit_DotStar(uint16_t n, uint8_t data, uint8_t clock,
+  uint8_t *buf, uint32_t bytes, uint8_t o) :
+ dataPin(data), clockPin(clock), brightness(255), pixels(NULL),
+ rOffset(o & 3), gOffset((o >> 2) & 3), bOffset((o >> 4) & 3),
+ externalPixels(buf), externalBytes(bytes)
+{
+  resetStats();
   updateLength(n);
 }
 
 Adafruit_DotStar::~Adafruit_DotStar(void) { // Destructor
-  if(pixels)                free(pixels);
+  if(busOwner[use_spi_1] == this) busOwner[use_spi_1] = NULL;
+  if(outputMode != DOTSTAR_OUTPUT_DIRECT) free(pixels);
+  free(outputLUT);
+  free(pixels16);
+  free(ditherError);
+  free(bitTable);
+  for(uint8_t i=0; i<bufferCount; i++) releaseBuffer(buffers[i]);
   if(dataPin == USE_HW_SPI) hw_spi_end();
   else                      sw_spi_end();
 }
@@ -89,6 +147,8 @@ void Adafruit_DotStar::begin(void) { // Initialize SPI
 // "recycling" LED ram across multiple strips: set pins to first strip,
 // render & write all data, reassign pins to next strip, render & write,
 // etc.  They won't update simultaneously, but usually unnoticeable.
+// (Strips that each have their own RAM can be sent side by side with
+// DotStarParallel instead, in the time of one.)
 
 // Change to hardware SPI -- must connect to MOSI, SCK pins
 void Adafruit_DotStar::updatePins(void) {
@@ -108,41 +168,682 @@ void Adafruit_DotStar::updatePins(uint8_t data, uint8_t clock) {
 // Length can be changed post-constructor for similar reasons (sketch
 // config not hardcoded).  But DON'T use this for "recycling" strip RAM...
 // all that reallocation is likely to fragment and eventually fail.
-// Instead, set length once to longest strip.
+// Instead, set length once to longest strip, or give the strip its own
+// storage (see the constructors above).
+// With caller-owned storage the frame is laid out in place, and a length
+// that doesn't fit the storage is ignored.  On the heap a length with the
+// same frame size reuses the buffer.
 void Adafruit_DotStar::updateLength(uint16_t n) {
-  if(pixels) free(pixels);
+  // the output stage's own buffer is rebuilt around the new frame
+  uint8_t mode = outputMode;
+  if(mode != DOTSTAR_OUTPUT_DIRECT) setOutputMode(DOTSTAR_OUTPUT_DIRECT);
 
+  resizeFrame(n);
+
+  if(mode != DOTSTAR_OUTPUT_DIRECT) setOutputMode((DotStarOutput)mode);
+}
+
+void Adafruit_DotStar::resizeFrame(uint16_t n) {
   // 4 start bytes, 4 bytes for each led
   // For the end frame there are different approaches. Now we use 1 bit (1 clock pulse) for each led.
   // So 1 byte for each 8 leds, because of round down + 1 byte
-  uint16_t amountOfEndFrameBytes = (1 + n/8);
+  // (32 bit: past 16383 LEDs the frame no longer fits 16 bits)
+  uint32_t amountOfEndFrameBytes = (1 + n/8);
+
+  uint32_t bytes = 4 + ((uint32_t)n * 4) + amountOfEndFrameBytes;
+
+  if(externalPixels && (bytes > externalBytes)) {
+    if(!pixels) numLEDs = 0; // too small from the start
+    return;
+  }
+
+  uint8_t *frame = externalPixels;
+  if(!frame && buffers[0] && (bytes == pixelArrayLength)) frame = buffers[0];
 
-  uint16_t bytes = 4 + (n * 4) + amountOfEndFrameBytes;
+  for(uint8_t i=1; i<bufferCount; i++) releaseBuffer(buffers[i]);
+  if(buffers[0] != frame) releaseBuffer(buffers[0]);
+  pixels     = buffers[0] = NULL;
+  backBuffer = 0;
 
-  if((pixels = (uint8_t *)malloc(bytes))) {
+  if((pixels = frame ? frame : (uint8_t *)malloc(bytes))) {
 
     // set the start bytes
     for(uint16_t i=0; i<4; i++) {
       pixels[i] = 0x00;
     }
 
-    // set the leds to zero
+    // set the leds to zero (clear() walks numLEDs, so set that first)
+    numLEDs = n;
     clear();
 
-    uint16_t endFrameStartPosition = 4 + (n * 4);
+    uint32_t endFrameStartPosition = 4 + ((uint32_t)n * 4);
 
     // set the end bytes
-    for(uint16_t i = endFrameStartPosition; i<(endFrameStartPosition+amountOfEndFrameBytes); i++) {
+    for(uint32_t i = endFrameStartPosition; i<(endFrameStartPosition+amountOfEndFrameBytes); i++) {
       pixels[i] = 0xFF;
     }
 
-    numLEDs = n;
     pixelArrayLength = bytes;
+    buffers[0]       = pixels;
+    dirtyLEDs        = n;
+    powerStale       = true;                // clear() counted the old contents out
+
+    // re-create the extra frame buffers (if any) at the new length
+    uint8_t count = bufferCount;
+    bufferCount = 1;
+    allocBuffers(count);
+
+  } else {
+    numLEDs     = 0;
+    bufferCount = 1;
+  }
+}
+
+// FRAME BUFFERS -----------------------------------------------------------
+
+/* With more than one buffer, show() on hardware SPI hands the buffer the
+  sketch has been drawing into to DMA and immediately continues with a
+  fresh back buffer holding a copy of that frame, so rendering frame N+1
+  overlaps with transmitting frame N and never writes into a buffer DMA is
+  reading.  Frames shown while a transfer is running are queued and sent
+  from the DMA completion callback, oldest first.  When the ring is full
+  the newest queued frame is replaced (coalesced) by the one being shown;
+  with only two buffers there is nothing to queue into, so show() waits for
+  the running transfer instead.  Nothing is ever dropped silently.
+
+  Each extra buffer costs another getPixels() sized block of RAM.  Note
+  that getPixels() returns a different buffer after every show().
+*/
+
+bool Adafruit_DotStar::setBufferCount(uint8_t n) {
+  if(n < 1)                   n = 1;
+  if(n > DOTSTAR_MAX_BUFFERS) n = DOTSTAR_MAX_BUFFERS;
+  if(!pixels) return false;
+
+  // let queued frames go out before the ring is rebuilt
+  waitForShow();
+
+  // the current back buffer becomes buffers[0]
+  if(backBuffer) {
+    if(outputMode == DOTSTAR_OUTPUT_DIRECT) {
+      memcpy(buffers[0], pixels, pixelArrayLength);
+      pixels = buffers[0];
+    }
+    backBuffer = 0;
+  }
+  for(uint8_t i=1; i<bufferCount; i++) {
+    releaseBuffer(buffers[i]);
+    buffers[i] = NULL;
+  }
+  bufferCount = 1;
+
+  return allocBuffers(n);
+}
+
+// Free a frame buffer unless it lives in the caller's storage
+void Adafruit_DotStar::releaseBuffer(uint8_t *buf) {
+  if(externalPixels && (buf >= externalPixels) &&
+     (buf < externalPixels + externalBytes)) return;
+  free(buf);
+}
+
+uint8_t Adafruit_DotStar::getBufferCount(void) const {
+  return bufferCount;
+}
+
+// Grow the ring from one buffer (buffers[0] == pixels) to n buffers, each
+// starting as a copy of the current frame.  Buffers come from the caller's
+// storage as far as it reaches, then from the heap.  All or nothing.
+bool Adafruit_DotStar::allocBuffers(uint8_t n) {
+  for(uint8_t i=1; i<n; i++) {
+    if(externalPixels && ((uint32_t)(i + 1) * pixelArrayLength <= externalBytes))
+      buffers[i] = externalPixels + i * pixelArrayLength;
+    else if(!(buffers[i] = (uint8_t *)malloc(pixelArrayLength))) {
+      while(--i) {
+        releaseBuffer(buffers[i]);
+        buffers[i] = NULL;
+      }
+      return false;
+    }
+    memcpy(buffers[i], pixels, pixelArrayLength);
+  }
+  bufferCount = n;
+  return true;
+}
+
+// Start the oldest queued buffer if the bus is free.  Called from show()
+// and from the DMA completion callback.
+void Adafruit_DotStar::sendNextBuffer(void) {
+  if(!pendingCount || (sendingBuffer != NO_BUFFER) || busOwner[use_spi_1]) return;
+
+  sendingBuffer = pendingBuffers[pendingHead];
+  pendingHead   = (pendingHead + 1) % DOTSTAR_MAX_BUFFERS;
+  pendingCount--;
+  hw_spi_transfer(buffers[sendingBuffer], frameLEDs[sendingBuffer]);
+}
+
+void Adafruit_DotStar::showBuffered(uint16_t leds) {
+  uint8_t shown = backBuffer;
+
+  __disable_irq();
+
+  frameLEDs[shown] = leds;
+
+  uint8_t freeBuffers = bufferCount - 1 - pendingCount -
+                        ((sendingBuffer != NO_BUFFER) ? 1 : 0);
+
+  if(!freeBuffers && pendingCount) {
+    // ring full: this frame takes the place of the newest queued one,
+    // whose buffer becomes the new back buffer
+    // (it must also cover the LEDs the replaced frame would have updated)
+    uint8_t newest = (pendingHead + pendingCount - 1) % DOTSTAR_MAX_BUFFERS;
+    backBuffer             = pendingBuffers[newest];
+    pendingBuffers[newest] = shown;
+    if(frameLEDs[backBuffer] > leds) frameLEDs[shown] = frameLEDs[backBuffer];
+    framesCoalesced++;
+    STATS(stats.framesCoalesced++);
+  } else {
+    if(!freeBuffers) {
+      // two buffers and one of them is on the wire
+      __enable_irq();
+      while(sendingBuffer != NO_BUFFER) delayMicroseconds(1);
+      __disable_irq();
+      framesWaited++;
+    }
+    if((sendingBuffer != NO_BUFFER) || busOwner[use_spi_1]) framesQueued++;
+    pendingBuffers[(pendingHead + pendingCount) % DOTSTAR_MAX_BUFFERS] = shown;
+    pendingCount++;
+
+    // next back buffer: any one that is neither queued nor being sent
+    for(uint8_t i=0; i<bufferCount; i++) {
+      bool busy = (i == shown) || (i == sendingBuffer);
+      for(uint8_t q=0; q<pendingCount; q++)
+        busy |= (pendingBuffers[(pendingHead + q) % DOTSTAR_MAX_BUFFERS] == i);
+      if(!busy) {
+        backBuffer = i;
+        break;
+      }
+    }
+  }
+  sendNextBuffer();
+
+  __enable_irq();
+
+  // DMA only reads the shown frame, so copying it while it is sent is fine.
+  // With an output stage the sketch draws into its own buffer instead.
+  if(outputMode == DOTSTAR_OUTPUT_DIRECT) {
+    pixels = buffers[backBuffer];
+    memcpy(pixels, buffers[shown], pixelArrayLength);
+  }
+}
+
+uint32_t Adafruit_DotStar::getQueuedFrames(void) const {
+  return framesQueued;
+}
+
+uint32_t Adafruit_DotStar::getCoalescedFrames(void) const {
+  return framesCoalesced;
+}
+
+uint32_t Adafruit_DotStar::getWaitedFrames(void) const {
+  return framesWaited;
+}
+
+// STATISTICS --------------------------------------------------------------
+
+/* With DOTSTAR_STATS set, every strip counts the frames it sends and drops
+  and times them with micros(): the wire time of each frame (from the
+  start of its transfer to the completion callback, or the bitbang loop)
+  and the send latency from show() to the frame's last byte, which is
+  the time spent queued behind other frames plus the wire time.  It
+  starts at show(), so the time spent drawing the frame isn't in it; that
+  is the render time, from one show() returning to the next one starting.
+  A send latency much larger than the wire time means show() is outrunning
+  the bus; render times close to the frame period mean rendering is the
+  bottleneck.  Dropped frames are the ones a busy single buffer turned
+  away; with a ring, a full queue coalesces instead (the newest queued
+  frame is replaced) and those are counted separately.
+
+  Each field is written from one context only (show() or the DMA
+  interrupt) and getStats() copies them with interrupts off.  Without
+  DOTSTAR_STATS the hooks are empty macros and the fields don't exist.
+*/
+
+void Adafruit_DotStar::resetStats(void) {
+#if DOTSTAR_STATS
+  __disable_irq();
+  memset(&stats, 0, sizeof(stats));
+  stats.transferMin = 0xFFFFFFFF;
+  transferTotal     = 0;
+  showReturnTime    = 0;
+  statsSince        = micros();
+  __enable_irq();
+#endif
+}
+
+bool Adafruit_DotStar::getStats(DotStarStats &s) const {
+#if DOTSTAR_STATS
+  __disable_irq();
+  s = stats;
+  uint32_t total = transferTotal, since = statsSince;
+  __enable_irq();
+
+  if(!s.framesTransmitted) s.transferMin = 0;
+  else                     s.transferAvg = total / s.framesTransmitted;
+  uint32_t elapsed = micros() - since;
+  s.fps = elapsed ? (uint32_t)((uint64_t)s.framesTransmitted * 1000000 / elapsed) : 0;
+  return true;
+#else
+  memset(&s, 0, sizeof(s));
+  return false;
+#endif
+}
+
+#if DOTSTAR_STATS
+// 0 us in bin 0, 1 us in bin 1, 2-3 us in bin 2, 4-7 us in bin 3 ...
+uint8_t Adafruit_DotStar::statsBin(uint32_t us) {
+  uint8_t bin = us ? (32 - __builtin_clz(us)) : 0;
+  return (bin < DOTSTAR_STATS_BINS) ? bin : (DOTSTAR_STATS_BINS - 1);
+}
+
+void Adafruit_DotStar::statsSubmit(uint8_t buf) {
+  stats.framesSubmitted++;
+  submitTime[buf] = micros();
+}
+
+// From the DMA completion interrupt on hardware SPI
+void Adafruit_DotStar::statsDone(uint8_t buf) {
+  uint32_t now = micros(), wire = now - spiStartTime;
+  stats.framesTransmitted++;
+  stats.transferLast = wire;
+  if(wire < stats.transferMin) stats.transferMin = wire;
+  if(wire > stats.transferMax) stats.transferMax = wire;
+  transferTotal += wire;
+  stats.transferHist[statsBin(wire)]++;
+  stats.sendLatencyHist[statsBin(now - submitTime[buf])]++;
+}
+
+void Adafruit_DotStar::statsRender(void) {
+  if(showReturnTime) stats.renderHist[statsBin(micros() - showReturnTime)]++;
+}
+#endif
+
+// OUTPUT STAGE ------------------------------------------------------------
+
+/* By default the frame buffer is sent exactly as written: brightness is the
+  5-bit header stamped by setPixelColor() and there is no gamma correction.
+  With an output stage the sketch's buffer is kept as plain 8-bit color and
+  show() renders it through a 256-entry table (gamma and brightness folded
+  together) into the ring's back buffer, which is what DMA sends.  Changing
+  brightness or gamma then affects every pixel at the next show(), and
+  getPixelColor() still returns what was set.
+
+  DOTSTAR_OUTPUT_LUT  sends full 5-bit brightness and the table's 8 bits.
+  DOTSTAR_OUTPUT_HD   keeps the table at 16 bits and splits each pixel over
+                      the 5-bit global field and 8-bit PWM, giving far more
+                      distinct levels near black.  Mind the note on the
+                      5-bit field above show(): it adds a slow second PWM.
+  DOTSTAR_OUTPUT_DITHER keeps the table at 8.8 fixed point and sends the
+                      integer part; the fraction is carried per channel to
+                      the next show(), so over a few frames every pixel
+                      averages out to the exact table value.  The strip's
+                      refresh rate is spent on low-end resolution instead of
+                      a second PWM, and setPixelColor16() sets pixels with
+                      16 bits per channel.
+
+  The render pass is table lookups, shifts and one multiply per channel; no
+  divides.  The stage costs a second frame-sized buffer plus 514 bytes;
+  dithering another 9 bytes per LED.
+*/
+
+// 31 * 65536 / (257 * g), rounded up: maps a 16-bit channel to 8 bits
+// under global g.  g is picked so the result can't exceed 255.
+static const uint16_t hdScale[32] = {
+     0, 7906, 3953, 2636, 1977, 1582, 1318, 1130,  989,  879,  791,  719,
+   659,  609,  565,  528,  495,  466,  440,  417,  396,  377,  360,  344,
+   330,  317,  305,  293,  283,  273,  264,  256
+};
+
+bool Adafruit_DotStar::setOutputMode(DotStarOutput mode) {
+  if(mode == outputMode) return true;
+  if(!pixels) return false;
+
+  waitForShow();
+
+  if(outputMode == DOTSTAR_OUTPUT_DIRECT) {
+    // the sketch's frame moves out of the ring into its own buffer; all
+    // or nothing, so a failure leaves the strip as it was
+    uint8_t  *source = (uint8_t *)malloc(pixelArrayLength);
+    uint16_t *lut    = (uint16_t *)malloc(257 * sizeof(uint16_t));
+    if(!source || !lut || ((mode == DOTSTAR_OUTPUT_DITHER) && !allocDither())) {
+      free(source);
+      free(lut);
+      return false;
+    }
+    memcpy(source, pixels, pixelArrayLength);
+    pixels    = source;
+    outputLUT = lut;
+  } else if(mode == DOTSTAR_OUTPUT_DITHER) {
+    if(!allocDither()) return false;        // and the LUT stage stays as it was
+  } else if(outputMode == DOTSTAR_OUTPUT_DITHER) {
+    freeDither();
+  }
+
+  if(mode == DOTSTAR_OUTPUT_DIRECT) {
+    // and back into the ring's back buffer
+    memcpy(buffers[backBuffer], pixels, pixelArrayLength);
+    free(pixels);
+    pixels = buffers[backBuffer];
+    free(outputLUT);
+    outputLUT = NULL;
+  }
+
+  outputMode = mode;
+  powerStale = true;                        // headers matter again, or stop mattering
+  buildOutputLUT();
+  return true;
+}
+
+// The 16-bit buffer and the carried fractions.  Fractions start spread
+// out so pixels at the same level don't all step on the same frame.
+bool Adafruit_DotStar::allocDither(void) {
+  uint32_t channels = (uint32_t)(numLEDs ? numLEDs : 1) * 3;
+  pixels16    = (uint16_t *)malloc(channels * sizeof(uint16_t));
+  ditherError = (uint8_t *)malloc(channels);
+  if(!pixels16 || !ditherError) {
+    freeDither();
+    return false;
+  }
+  for(uint32_t i=0; i<channels; i++) ditherError[i] = i * 97;
+  return true;
+}
+
+// Pixels set with setPixelColor16() get a real header back first
+void Adafruit_DotStar::freeDither(void) {
+  uint8_t *p = &pixels[4];
+  for(uint16_t n=numLEDs; n--; p += 4) {
+    if(p[0] < 0xE0) p[0] = pixelHeader;
+  }
+  free(pixels16);
+  free(ditherError);
+  pixels16    = NULL;
+  ditherError = NULL;
+}
+
+DotStarOutput Adafruit_DotStar::getOutputMode(void) const {
+  return (DotStarOutput)outputMode;
+}
+
+// Gamma exponent of the output stage, 1.0 = linear (default).  2.2-2.8
+// looks right on most strips.
+void Adafruit_DotStar::setGamma(float g) {
+  gamma = g;
+  buildOutputLUT();
+}
+
+float Adafruit_DotStar::getGamma(void) const {
+  return gamma;
+}
+
+// Fold gamma and brightness into the output table.  256 entries, only
+// when either changes, so the float math stays out of show().
+void Adafruit_DotStar::buildOutputLUT(void) {
+  if(!outputLUT) return;
+  dirtyLEDs = numLEDs; // every pixel's output changes
+
+  for(uint16_t i=0; i<256; i++) {
+    float    v = (gamma == 1.0f) ? (i / 255.0f) : powf(i / 255.0f, gamma);
+    uint32_t x = ((uint32_t)(v * 65535.0f + 0.5f) * (shownBrightness + 1)) >> 8;
+    switch(outputMode) {
+      case DOTSTAR_OUTPUT_HD:     outputLUT[i] = x;                              break;
+      case DOTSTAR_OUTPUT_DITHER: outputLUT[i] = (x * 65280 + 32767) / 65535;    break;
+      default:                    outputLUT[i] = (x * 255 + 32767) / 65535;      break;
+    }
+  }
+  outputLUT[256] = outputLUT[255];          // for interpolating 16-bit input
+}
+
+// Dithered channel: the 8.8 value plus what it still owes, integer part
+// out, fraction carried.  v <= 255.0 so the sum can't pass 16 bits.
+static inline uint8_t ditherChannel(uint16_t v, uint8_t &carry) {
+  uint16_t sum = v + carry;
+  carry = (uint8_t)sum;
+  return sum >> 8;
+}
+
+// 16-bit channel through the 256-step table, interpolated
+static inline uint16_t lerpLUT(const uint16_t *lut, uint16_t v) {
+  const uint16_t *e = &lut[v >> 8];
+  return e[0] + (((uint32_t)(e[1] - e[0]) * (v & 0xFF)) >> 8);
+}
+
+// Render the first 'leds' pixels through the output table into 'tx'
+void Adafruit_DotStar::renderOutput(uint8_t *tx, uint16_t leds) {
+  const uint16_t *lut = outputLUT;
+  const uint8_t  *src = &pixels[4];
+  uint8_t        *dst = &tx[4];
+  uint16_t        n   = leds;
+
+  if(outputMode == DOTSTAR_OUTPUT_LUT) {
+    while(n--) {
+      dst[0] = 0xFF;
+      dst[1] = lut[src[1]];
+      dst[2] = lut[src[2]];
+      dst[3] = lut[src[3]];
+      src += 4;
+      dst += 4;
+    }
+  } else if(outputMode == DOTSTAR_OUTPUT_DITHER) {
+    // a header below 0xE0 marks a pixel set with setPixelColor16()
+    const uint16_t *wide  = pixels16;
+    uint8_t        *carry = ditherError;
+    while(n--) {
+      dst[0] = 0xFF;
+      if(src[0] < 0xE0) {
+        dst[1] = ditherChannel(lerpLUT(lut, wide[0]), carry[0]);
+        dst[2] = ditherChannel(lerpLUT(lut, wide[1]), carry[1]);
+        dst[3] = ditherChannel(lerpLUT(lut, wide[2]), carry[2]);
+      } else {
+        dst[1] = ditherChannel(lut[src[1]], carry[0]);
+        dst[2] = ditherChannel(lut[src[2]], carry[1]);
+        dst[3] = ditherChannel(lut[src[3]], carry[2]);
+      }
+      src   += 4;
+      dst   += 4;
+      wide  += 3;
+      carry += 3;
+    }
+  } else {
+    while(n--) {
+      encodeHD(lut[src[1]], lut[src[2]], lut[src[3]], dst);
+      src += 4;
+      dst += 4;
+    }
+  }
+}
+
+// Split three 16-bit channels (in strip byte order) over the 5-bit global
+// field and 8-bit PWM: the smallest global that keeps the largest channel
+// within 8 bits, then every channel scaled up by 31/global.
+void Adafruit_DotStar::encodeHD(uint16_t a, uint16_t b, uint16_t c,
+  uint8_t *dst) {
+  uint16_t m = (a > b) ? a : b;
+  if(c > m) m = c;
+  uint8_t  g = (((uint32_t)m * 31) >> 16) + 1; // 1-31
+  uint32_t k = hdScale[g];
+  dst[0] = 0xE0 | g;
+  dst[1] = (a * k) >> 16;
+  dst[2] = (b * k) >> 16;
+  dst[3] = (c * k) >> 16;
+}
+
+// PARTIAL SHOW ------------------------------------------------------------
+
+/* The write calls track the highest pixel changed since the last show().
+  With setPartialShow(true), show() sends only the start frame, pixels up
+  to that one and an end frame sized for them; LEDs further down keep the
+  color they latched last.  On long strips where the animation sits near
+  the start this cuts the time on the wire, and a show() with nothing
+  changed sends nothing at all.  Code that writes through getPixels()
+  must call markDirty() with the highest pixel it touched.
+*/
+
+void Adafruit_DotStar::setPartialShow(bool on) {
+  partialShow = on;
+  dirtyLEDs   = numLEDs; // resend everything once
+}
+
+bool Adafruit_DotStar::getPartialShow(void) const {
+  return partialShow;
+}
+
+// Dithered pixels change on every show(), so they are always all sent
+uint16_t Adafruit_DotStar::getDirtyLength(void) const {
+  return (partialShow && (outputMode != DOTSTAR_OUTPUT_DITHER)) ?
+    dirtyLEDs : numLEDs;
+}
+
+uint16_t Adafruit_DotStar::takeDirtyLength(void) {
+  if(powerLimit) limitPower();              // may change every pixel
+  uint16_t leds = getDirtyLength();
+  dirtyLEDs = 0;
+  return leds;
+}
+
+// POWER LIMIT -------------------------------------------------------------
+
+/* With setPowerLimit(mA) show() keeps the estimated current of each frame
+  under a budget by lowering the brightness it sends.  The estimate is an
+  idle current per LED plus, per channel, its full-on current times
+  value/255, times the brightness.  The write calls keep running sums of
+  the three channels over the frame (a subtract and an add per channel
+  for each pixel written), so show() has the estimate in constant time
+  instead of walking the strip.  Writes through getPixels() can't be
+  followed: markDirty() flags the sums and the next show() recounts them.
+
+  Without an output stage the limit is the 5-bit header of every pixel:
+  the write calls stamp the limited header, and the frame is restamped
+  (and sent whole) only when that header changes.  After a markDirty()
+  only the dirty range is restamped, so partial show still works.  With
+  a stage it is folded into the output table, which carries the
+  brightness anyway; gamma is left out of the estimate there, so it errs
+  high.  setBrightness() still sets the ceiling, and with the limiter on
+  it applies to the whole frame at the next show(); the colors don't
+  change, so the sums stay valid and only the header is worked out again.
+*/
+
+// False for a strip without a frame (a streamed DotStarIndexed)
+bool Adafruit_DotStar::setPowerLimit(uint32_t mA) {
+  if(mA && !numLEDs) return false;
+  powerLimit    = mA;
+  powerStale    = true;
+  powerEstimate = 0;
+  if(mA) return true;
+
+  // off: the sketch's brightness, everywhere
+  shownBrightness = brightness;
+  pixelHeader     = 0xE0 + (brightness>>3);
+  if(outputMode == DOTSTAR_OUTPUT_DIRECT) {
+    stampHeaders(numLEDs);
+    dirtyLEDs = numLEDs;
+  } else {
+    buildOutputLUT();
+  }
+  return true;
+}
+
+uint32_t Adafruit_DotStar::getPowerLimit(void) const {
+  return powerLimit;
+}
+
+// Defaults are typical APA102 figures, 20 mA per channel and 1 mA (1000
+// uA) idle per LED; measured values give a tighter budget.
+void Adafruit_DotStar::setPowerModel(uint8_t r, uint8_t g, uint8_t b,
+  uint16_t idle) {
+  channelMilliamps[0] = r;
+  channelMilliamps[1] = g;
+  channelMilliamps[2] = b;
+  idleMicroamps       = idle;
+}
 
+uint32_t Adafruit_DotStar::getPowerEstimate(void) const {
+  return powerEstimate;
+}
+
+uint8_t Adafruit_DotStar::getPowerBrightness(void) const {
+  return shownBrightness;
+}
 
+// The highest brightness up to the sketch's that fits the budget
+void Adafruit_DotStar::limitPower(void) {
+  // raw writes may have left any header in the range they dirtied
+  uint16_t stamp = powerStale ? dirtyLEDs : 0;
+  if(powerStale) scanPower();
+
+  // uA of the colors at full brightness, and what the idle draw leaves
+  uint64_t full = ((uint64_t)powerSum[0] * channelMilliamps[0] +
+                   (uint64_t)powerSum[1] * channelMilliamps[1] +
+                   (uint64_t)powerSum[2] * channelMilliamps[2]) * 1000 / 255,
+           idle = (uint64_t)numLEDs * idleMicroamps,
+           room = (uint64_t)powerLimit * 1000,
+           color;
+  room = (room > idle) ? (room - idle) : 0;
+
+  if(outputMode == DOTSTAR_OUTPUT_DIRECT) {
+    // 5-bit global: current goes with g/31
+    uint8_t g = brightness>>3;
+    if(full * g > room * 31) g = room * 31 / full;
+    color           = full * g / 31;
+    shownBrightness = (g == (brightness>>3)) ? brightness : (g << 3);
+    if(pixelHeader != 0xE0 + g) {
+      pixelHeader = 0xE0 + g;
+      stamp       = numLEDs;                // the whole frame goes out again
+      dirtyLEDs   = numLEDs;
+    }
+    stampHeaders(stamp);
   } else {
-    numLEDs = 0;
+    // output table: current goes with (brightness + 1) / 256
+    uint16_t k = brightness + 1;
+    if(full * k > room * 256) k = room * 256 / full;
+    uint8_t b = k ? (k - 1) : 0;
+    color = full * (b + 1) / 256;
+    if(b != shownBrightness) {
+      shownBrightness = b;
+      buildOutputLUT();
+    }
   }
+  powerEstimate = (idle + color + 500) / 1000;
+}
+
+void Adafruit_DotStar::scanPower(void) {
+  powerSum[0] = powerSum[1] = powerSum[2] = 0;
+  sumPower(0, numLEDs, true);
+  powerStale = false;
+}
+
+// Add the colors of 'count' pixels from 'first' to the sums, or take them out
+void Adafruit_DotStar::sumPower(uint16_t first, uint16_t count, bool add) {
+  uint32_t       r = 0, g = 0, b = 0;
+  const uint8_t *p = &pixels[4 + (first * 4)];
+  for(; count--; p += 4) {
+    r += p[rOffset+1];
+    g += p[gOffset+1];
+    b += p[bOffset+1];
+  }
+  if(add) {
+    powerSum[0] += r;
+    powerSum[1] += g;
+    powerSum[2] += b;
+  } else {
+    powerSum[0] -= r;
+    powerSum[1] -= g;
+    powerSum[2] -= b;
+  }
+}
+
+void Adafruit_DotStar::stampHeaders(uint16_t leds) {
+  uint8_t *p = &pixels[4];
+  for(; leds--; p += 4) p[0] = pixelHeader;
 }
 
 // SPI STUFF ---------------------------------------------------------------
@@ -182,6 +883,7 @@ void Adafruit_DotStar::sw_spi_init(void) { // Init 'soft' (bitbang) SPI
   pinMode(clockPin, OUTPUT);
   pinSet(dataPin , LOW);
   pinSet(clockPin, LOW);
+  sw_spi_pins();
 }
 
 void Adafruit_DotStar::sw_spi_end() { // Stop 'soft' SPI
@@ -198,6 +900,106 @@ void Adafruit_DotStar::sw_spi_out(uint8_t n) { // Bitbang SPI write
   }
 }
 
+/* BITBANG ENGINE -----------------------------------------------------------
+
+  sw_spi_out() above looks both pins up in the pin map for every bit and
+  writes data, clock high and clock low separately.  The engines below
+  look the GPIO ports and pin masks up once (sw_spi_pins(), run from
+  sw_spi_init() and so from updatePins()) and unroll the 8 bits of a byte:
+
+  DOTSTAR_SOFT_FAST   data and clock on one port: two BSRR writes per bit
+                      (data + clock low together, then clock high).  On
+                      different ports: three writes, no lookups.
+  DOTSTAR_SOFT_TABLE  as FAST on one port, with the data/clock-low word of
+                      each bit taken from a 16-entry nibble table (256
+                      bytes) instead of a test per bit.  Falls back to FAST
+                      when the pins are on different ports.
+  DOTSTAR_SOFT_PINMAP the original per-bit pinSet() loop.
+*/
+
+bool Adafruit_DotStar::setSoftSPIMode(DotStarSoftSPI mode) {
+  softMode = mode;
+  return sw_spi_pins();
+}
+
+DotStarSoftSPI Adafruit_DotStar::getSoftSPIMode(void) const {
+  return (DotStarSoftSPI)softMode;
+}
+
+// Cache ports and masks of the current pins, (re)build the nibble table.
+// False if the table was wanted but could not be allocated.
+bool Adafruit_DotStar::sw_spi_pins(void) {
+  if(dataPin == USE_HW_SPI) return true;
+
+  dataPort  = pinInfo(dataPin).gpio_peripheral;
+  dataMask  = pinInfo(dataPin).gpio_pin;
+  clockPort = pinInfo(clockPin).gpio_peripheral;
+  clockMask = pinInfo(clockPin).gpio_pin;
+
+  if((softMode != DOTSTAR_SOFT_TABLE) || (dataPort != clockPort)) {
+    free(bitTable);
+    bitTable = NULL;
+    return true;
+  }
+
+  if(!bitTable && !(bitTable = (uint32_t *)malloc(16 * 4 * sizeof(uint32_t))))
+    return false;
+  for(uint8_t nibble=0; nibble<16; nibble++) {
+    for(uint8_t bit=0; bit<4; bit++) {
+      bitTable[nibble * 4 + bit] = ((uint32_t)clockMask << 16) |
+        ((nibble & (8 >> bit)) ? dataMask : ((uint32_t)dataMask << 16));
+    }
+  }
+  return true;
+}
+
+void Adafruit_DotStar::sw_spi_write(const uint8_t *buf, uint32_t len) {
+  if(softMode == DOTSTAR_SOFT_PINMAP) {
+    while(len--) sw_spi_out(*buf++);
+    return;
+  }
+  if(!dataPort) sw_spi_pins(); // show() before begin()
+
+  GPIO_TypeDef *dp    = dataPort, *cp = clockPort;
+  uint32_t      clkHi = clockMask,
+                clkLo = (uint32_t)clockMask << 16;
+
+  if(dp == cp) {
+    if(bitTable) {
+      const uint32_t *t = bitTable;
+      #define SW_SPI_BIT(_w) portBSRR(dp, (_w)); portBSRR(dp, clkHi);
+      while(len--) {
+        const uint32_t *hi = &t[(*buf >> 4) * 4], *lo = &t[(*buf & 15) * 4];
+        buf++;
+        SW_SPI_BIT(hi[0]) SW_SPI_BIT(hi[1]) SW_SPI_BIT(hi[2]) SW_SPI_BIT(hi[3])
+        SW_SPI_BIT(lo[0]) SW_SPI_BIT(lo[1]) SW_SPI_BIT(lo[2]) SW_SPI_BIT(lo[3])
+      }
+      #undef SW_SPI_BIT
+    } else {
+      uint32_t one  = dataMask | clkLo,
+               zero = ((uint32_t)dataMask << 16) | clkLo;
+      #define SW_SPI_BIT(_bit) portBSRR(dp, (b & (_bit)) ? one : zero); portBSRR(dp, clkHi);
+      while(len--) {
+        uint8_t b = *buf++;
+        SW_SPI_BIT(0x80) SW_SPI_BIT(0x40) SW_SPI_BIT(0x20) SW_SPI_BIT(0x10)
+        SW_SPI_BIT(0x08) SW_SPI_BIT(0x04) SW_SPI_BIT(0x02) SW_SPI_BIT(0x01)
+      }
+      #undef SW_SPI_BIT
+    }
+    portBSRR(dp, clkLo);
+  } else {
+    uint32_t one = dataMask, zero = (uint32_t)dataMask << 16;
+    #define SW_SPI_BIT(_bit) portBSRR(dp, (b & (_bit)) ? one : zero); \
+                             portBSRR(cp, clkHi); portBSRR(cp, clkLo);
+    while(len--) {
+      uint8_t b = *buf++;
+      SW_SPI_BIT(0x80) SW_SPI_BIT(0x40) SW_SPI_BIT(0x20) SW_SPI_BIT(0x10)
+      SW_SPI_BIT(0x08) SW_SPI_BIT(0x04) SW_SPI_BIT(0x02) SW_SPI_BIT(0x01)
+    }
+    #undef SW_SPI_BIT
+  }
+}
+
 /* ISSUE DATA TO LED STRIP -------------------------------------------------
 
   I implemented the per-pixel 5-bit brightness and replaced the scale
@@ -215,65 +1017,199 @@ void Adafruit_DotStar::sw_spi_out(uint8_t n) { // Bitbang SPI write
     already handled better in one's sketch code.
 */
 
+// SPI and SPI1 are independent, so each bus has its own owner and its own
+// completion callback that routes back to the strip whose frame was sent.
+// A strip on SPI never waits for one on SPI1 and vice versa.
+
 void Adafruit_DotStar::hw_spi_DMA_TransferComplete_Callback(void) {
-    hw_spi_DMA_TransferCompleted = true;
+    hw_spi_DMA_TransferComplete(0);
+}
+
+void Adafruit_DotStar::hw_spi1_DMA_TransferComplete_Callback(void) {
+    hw_spi_DMA_TransferComplete(1);
+}
+
+void Adafruit_DotStar::hw_spi_DMA_TransferComplete(uint8_t bus) {
+    Adafruit_DotStar *strip = busOwner[bus];
+    if(!strip) return;
+
+    // a frame longer than one DMA transfer continues with its next chunk
+    if(strip->dmaRemaining) {
+      strip->hw_spi_dma(strip->dmaNext, strip->dmaRemaining);
+      return;
+    }
+
+    // a streamed frame (DotStarIndexed) continues with its next chunk
+    if(strip->dmaRefill && strip->dmaRefill(strip)) return;
+
+    // a partial frame continues with its zero end frame
+    if(strip->tailBytes) {
+      uint16_t len = strip->tailBytes;
+      if(len > sizeof(zeroFrame)) len = sizeof(zeroFrame);
+      strip->tailBytes -= len;
+      strip->hw_spi_dma(zeroFrame, len);
+      return;
+    }
+    busOwner[bus] = NULL;
+
+    strip->hw_spi_DMA_TransferCompleted = true;
+    STATS(strip->statsDone((strip->sendingBuffer != NO_BUFFER) ?
+                           strip->sendingBuffer : 0));
+
+    // hand the bus to the strip's next queued frame
+    strip->sendingBuffer = NO_BUFFER;
+    strip->sendNextBuffer();
+
+    // or to a frame queue feeding it
+    if(strip->frameSent) strip->frameSent(strip->frameSentContext);
+}
+
+// Start a DMA transfer of a frame buffer.  All LEDs: the whole buffer with
+// its own end frame.  Fewer: start frame and those LEDs, then a zero end
+// frame sized for them, chained from the completion callback.  Either may
+// take several DMA transfers on long strips (see hw_spi_dma()).
+void Adafruit_DotStar::hw_spi_transfer(uint8_t *buf, uint16_t leds) {
+  hw_spi_DMA_TransferCompleted = false;
+  busOwner[use_spi_1] = this;
+  STATS(spiStartTime = micros());
+
+  if(leds >= numLEDs) {
+    tailBytes = 0;
+    hw_spi_dma(buf, pixelArrayLength);
+  } else {
+    tailBytes = 1 + leds/8;
+    hw_spi_dma(buf, 4 + ((uint32_t)leds * 4));
+  }
+}
+
+// Start DMA of len bytes on our bus.  The DMA counter is 16 bit, so longer
+// buffers go out in DOTSTAR_DMA_CHUNK byte pieces, each started from the
+// completion callback of the one before; one show() can cover any length.
+void Adafruit_DotStar::hw_spi_dma(uint8_t *buf, uint32_t len) {
+  uint16_t n = (len > DOTSTAR_DMA_CHUNK) ? DOTSTAR_DMA_CHUNK : len;
+
+  // before the transfer: its callback may run before transfer() returns
+  dmaNext      = buf + n;
+  dmaRemaining = len - n;
+
+  if(!use_spi_1) SPI.transfer((void *)buf, 0, n, hw_spi_DMA_TransferComplete_Callback);
+  else           SPI1.transfer((void *)buf, 0, n, hw_spi1_DMA_TransferComplete_Callback);
+}
+
+// True while a frame of this strip is on the wire or queued
+bool Adafruit_DotStar::isShowing(void) const {
+  return !hw_spi_DMA_TransferCompleted || pendingCount ||
+         (sendingBuffer != NO_BUFFER);
+}
+
+// Block until every frame shown on this strip has been sent
+void Adafruit_DotStar::waitForShow(void) {
+  while(isShowing()) {
+    sendNextBuffer(); // in case another strip held the bus
+    delayMicroseconds(1);
+  }
+}
 
-    //uint16_t duration = micros() - spiStartTime;
-    //Serial.print("duration: ");
-    //Serial.println(duration);
+// Start show() on several strips back to back.  Strips on different buses
+// (SPI and SPI1) then transfer at the same time.  With wait set, return
+// only once all their frames have been sent.
+void Adafruit_DotStar::showAll(Adafruit_DotStar * const *strips, uint8_t n,
+  bool wait) {
+  for(uint8_t i=0; i<n; i++) strips[i]->show();
+  if(wait) {
+    for(uint8_t i=0; i<n; i++) strips[i]->waitForShow();
+  }
+}
+
+void Adafruit_DotStar::showAll(Adafruit_DotStar &a, Adafruit_DotStar &b,
+  bool wait) {
+  Adafruit_DotStar *strips[2] = { &a, &b };
+  showAll(strips, 2, wait);
 }
 
 void Adafruit_DotStar::show(void) {
 
+  STATS(statsRender());
+  if(showHook && showHook(this)) {         // sent another way (DotStarIndexed)
+    STATS(showReturnTime = micros());
+    return;
+  }
   if(!pixels) return;
 
   //__disable_irq(); // If 100% focus on SPI clocking required
 
-  if(dataPin == USE_HW_SPI) {
+  if(dataPin == USE_HW_SPI) hw_spi_show();
+  else                      sw_spi_show();
 
-    // Big change here
-    // Photon supports DMA if we send the whole pixel array.
-    // See: https://docs.particle.io/reference/firmware/photon/#transfer-
-    // That's why the pixel array layout is changed.
-
-    // brightness scaling is ignored for now (was applied here before and still in soft_spi)
+  //__enable_irq();
+  STATS(showReturnTime = micros());
+}
 
-    // transferComplete_Callback method from this topic:
-    // https://community.particle.io/t/bug-in-spi-block-transfer-complete-callback/18568
+void Adafruit_DotStar::hw_spi_show(void) {
 
-    if(hw_spi_DMA_TransferCompleted)
-    {
-      hw_spi_DMA_TransferCompleted = false;
-      //spiStartTime = micros();
+  // Big change here
+  // Photon supports DMA if we send the whole pixel array.
+  // See: https://docs.particle.io/reference/firmware/photon/#transfer-
+  // That's why the pixel array layout is changed.
 
-      if(!use_spi_1) SPI.transfer((void *)pixels, 0, pixelArrayLength, hw_spi_DMA_TransferComplete_Callback);
-      else           SPI1.transfer((void *)pixels, 0, pixelArrayLength, hw_spi_DMA_TransferComplete_Callback);
-    }
-    else {
-      //uint16_t duration = micros() - spiStartTime;
-      //Serial.print("still sending! : ");
-      //Serial.println(duration);
-    }
-    //SPI.transfer((void *)pixels, 0, pixelArrayLength, NULL);
+  // brightness scaling is ignored for now (was applied here before and still in soft_spi)
 
-  } else {                               // Soft (bitbang) SPI
+  // transferComplete_Callback method from this topic:
+  // https://community.particle.io/t/bug-in-spi-block-transfer-complete-callback/18568
 
-    // because of the new pixel layout we can output the array
-    // in one time. Brightness scaling is removed.
-    for(int i=0; i<pixelArrayLength; i++) {
-      sw_spi_out(pixels[i]);
-    };
+  // With an output stage the frame is rendered into the ring's back
+  // buffer first; a single buffer still on the wire is left alone.
+  if((bufferCount == 1) && busOwner[use_spi_1]) {
+    STATS(stats.framesDropped++);
+    return; // dropped: changes stay dirty for the next show()
   }
 
-  //__enable_irq();
+  uint16_t leds = takeDirtyLength();
+  if(partialShow && !leds) return; // nothing changed
+  STATS(statsSubmit(backBuffer));
+
+  if(outputMode != DOTSTAR_OUTPUT_DIRECT) renderOutput(buffers[backBuffer], leds);
+
+  // With setBufferCount(2+) frames are queued instead of dropped
+  if(bufferCount > 1) showBuffered(leds);
+  else                hw_spi_transfer(buffers[0], leds);
+  //SPI.transfer((void *)pixels, 0, pixelArrayLength, NULL);
 }
 
-inline void Adafruit_DotStar::clear() {
-  // was memset before now we just make the pixels black.
+void Adafruit_DotStar::sw_spi_show(void) { // Soft (bitbang) SPI
+
+  // because of the new pixel layout we can output the array
+  // in one time. Brightness scaling is removed (see the output stage).
+  uint16_t leds = takeDirtyLength();
+  if(partialShow && !leds) return; // nothing changed
+  STATS(statsSubmit(backBuffer));
+  STATS(spiStartTime = micros());
 
-  for(uint16_t i = 0;i<numLEDs;i++) {
-    setPixelColor(i,0,0,0);
+  uint8_t *out = sw_spi_frame(leds);
+  if(leds >= numLEDs) {
+    sw_spi_write(out, pixelArrayLength);
+  } else {
+    // partial frame, zero end frame as in hw_spi_transfer()
+    sw_spi_write(out, 4 + ((uint32_t)leds * 4));
+    for(uint16_t tail = 1 + leds/8; tail; ) {
+      uint16_t len = (tail > sizeof(zeroFrame)) ? sizeof(zeroFrame) : tail;
+      sw_spi_write(zeroFrame, len);
+      tail -= len;
+    }
   }
+  STATS(statsDone(backBuffer));
+}
+
+uint8_t *Adafruit_DotStar::sw_spi_frame(uint16_t leds) {
+  if(outputMode == DOTSTAR_OUTPUT_DIRECT) return pixels;
+  renderOutput(buffers[backBuffer], leds);
+  return buffers[backBuffer];
+}
+
+void Adafruit_DotStar::clear() {
+  // was memset before, then a setPixelColor() loop; now one fill pass that
+  // keeps the brightness header of each pixel intact.
+  fill(0, 0, 0);
 }
 
 // Set pixel color, separate R,G,B values (0-255 ea.)
@@ -283,24 +1219,132 @@ void Adafruit_DotStar::setPixelColor(
     // we include
     uint8_t *p = &pixels[4 + (n * 4)];
 
-    //we apply 5-bit brightness later...
-    //0xE0 + (brightness>>3);
-    p[0]         = 0xE0 + (brightness>>3);
+    if(powerLimit) trackPower(p, r, g, b);
+    p[0]         = pixelHeader;             // 5-bit global brightness
     p[rOffset+1] = r;
     p[gOffset+1] = g;
     p[bOffset+1] = b;
+    markChanged(n);
   }
 }
 
 // Set pixel color, 'packed' RGB value (0x000000 - 0xFFFFFF)
 void Adafruit_DotStar::setPixelColor(uint16_t n, uint32_t c) {
   if(n < numLEDs) {
-    uint8_t *p = &pixels[n * 4];
-    p[0]         = 0xFF;
+    uint8_t *p = &pixels[4 + (n * 4)];
+    if(powerLimit) trackPower(p, c >> 16, c >> 8, c);
+    p[0]         = pixelHeader;
     p[rOffset+1] = (uint8_t)(c >> 16);
     p[gOffset+1] = (uint8_t)(c >>  8);
     p[bOffset+1] = (uint8_t)c;
+    markChanged(n);
+  }
+}
+
+// Set pixel color with 16 bits per channel (0-65535 ea.).  Without
+// DOTSTAR_OUTPUT_DITHER only the top 8 bits are kept.  The sketch buffer
+// holds the top 8 bits either way, for getPixelColor().
+void Adafruit_DotStar::setPixelColor16(
+ uint16_t n, uint16_t r, uint16_t g, uint16_t b) {
+  if(n < numLEDs) {
+    uint8_t *p = &pixels[4 + (n * 4)];
+    if(powerLimit) trackPower(p, r >> 8, g >> 8, b >> 8);
+    p[rOffset+1] = r >> 8;
+    p[gOffset+1] = g >> 8;
+    p[bOffset+1] = b >> 8;
+    if(pixels16) {
+      uint16_t *w = &pixels16[n * 3];
+      w[rOffset]  = r;
+      w[gOffset]  = g;
+      w[bOffset]  = b;
+      p[0]        = 0x00;                   // 16-bit pixel, see renderOutput()
+    } else {
+      p[0]        = pixelHeader;
+    }
+    markChanged(n);
+  }
+}
+
+// BULK WRITES -------------------------------------------------------------
+
+/* These write straight into the 4-byte-per-LED frame layout (brightness
+  header + three color bytes in strip order) in one pass, instead of going
+  through setPixelColor() per pixel.  Ranges are clipped to the strip;
+  a count of 0 means "to the end of the strip".
+*/
+
+// Number of pixels from 'first' a bulk write may touch
+uint16_t Adafruit_DotStar::clipRange(uint16_t first, uint16_t count) const {
+  if(first >= numLEDs) return 0;
+  uint16_t room = numLEDs - first;
+  return (!count || (count > room)) ? room : count;
+}
+
+// Set 'count' pixels starting at 'first' to one packed RGB color
+void Adafruit_DotStar::fill(uint32_t c, uint16_t first, uint16_t count) {
+  if(!(count = clipRange(first, count))) return;
+  markChanged(first + count - 1);
+  if(powerLimit) sumPower(first, count, false);
+
+  // build the 4 frame bytes once, then store them as one word per pixel
+  uint32_t word = frameWord(c);
+
+  uint8_t *p = &pixels[4 + (first * 4)];
+  for(uint16_t n=count; n--; p += 4) memcpy(p, &word, 4);
+  if(powerLimit) sumPower(first, count, true);
+}
+
+// The 4 frame bytes of color c (header, colors in strip order) as one
+// word, to be stored with memcpy(p, &word, 4)
+uint32_t Adafruit_DotStar::frameWord(uint32_t c) const {
+  uint8_t  frame[4];
+  uint32_t word;
+  frame[0]         = pixelHeader;
+  frame[rOffset+1] = (uint8_t)(c >> 16);
+  frame[gOffset+1] = (uint8_t)(c >>  8);
+  frame[bOffset+1] = (uint8_t)c;
+  memcpy(&word, frame, 4);
+  return word;
+}
+
+// Copy 'count' packed RGB colors from 'src' to the pixels starting at 'first'
+void Adafruit_DotStar::setPixels(uint16_t first, const uint32_t *src,
+  uint16_t count) {
+  if(!(count = clipRange(first, count))) return;
+  markChanged(first + count - 1);
+  if(powerLimit) sumPower(first, count, false);
+
+  uint8_t  header = pixelHeader,
+           r = rOffset + 1, g = gOffset + 1, b = bOffset + 1,
+          *p = &pixels[4 + (first * 4)];
+  for(uint16_t n=count; n--; p += 4) {
+    uint32_t c = *src++;
+    p[0] = header;
+    p[r] = (uint8_t)(c >> 16);
+    p[g] = (uint8_t)(c >>  8);
+    p[b] = (uint8_t)c;
+  }
+  if(powerLimit) sumPower(first, count, true);
+}
+
+// Copy 'count' R,G,B byte triplets from 'rgb' to the pixels starting at 'first'
+void Adafruit_DotStar::setPixelsRGB(uint16_t first, const uint8_t *rgb,
+  uint16_t count) {
+  if(!(count = clipRange(first, count))) return;
+  markChanged(first + count - 1);
+  if(powerLimit) sumPower(first, count, false);
+
+  uint8_t  header = pixelHeader,
+           r = rOffset + 1, g = gOffset + 1, b = bOffset + 1,
+          *p = &pixels[4 + (first * 4)];
+  for(uint16_t n=count; n--; p += 4) {
+    p[0] = header;
+    p[r] = rgb[0];
+    p[g] = rgb[1];
+    p[b] = rgb[2];
+    rgb += 3;
   }
+  if(powerLimit) sumPower(first, count, true);
 }
 
 // Convert separate R,G,B to packed value
@@ -338,7 +1382,12 @@ uint16_t Adafruit_DotStar::numPixels(void) { // Ret. strip length
 
 void Adafruit_DotStar::setBrightness(uint8_t b) {
   // now we use apa102 pixel brightness, so above doesn't apply
+  // (except with an output stage, where it is applied at show() again)
   brightness = b;
+  if(powerLimit) return;                    // limitPower() restamps if the header changes
+  shownBrightness = b;
+  pixelHeader     = 0xE0 + (b>>3);
+  buildOutputLUT();
 }
 
 uint8_t Adafruit_DotStar::getBrightness(void) const {
@@ -351,3 +1400,135 @@ uint8_t Adafruit_DotStar::getBrightness(void) const {
 uint8_t *Adafruit_DotStar::getPixels(void) const {
   return pixels;
 }
+
+// The 16-bit channels behind setPixelColor16() (3 per LED, strip order),
+// NULL unless dithering.  Only used for pixels whose header byte in
+// getPixels() is below 0xE0.
+uint16_t *Adafruit_DotStar::getPixels16(void) const {
+  return pixels16;
+}
+
+/* PARALLEL SOFT SPI -------------------------------------------------------
+
+  All lanes shift out in step, one byte position at a time: the byte at
+  that position of every lane frame goes through transpose8(), which turns
+  8 lane bytes into 8 bit planes (plane 0 = the MSBs, lane 0 in bit 7).
+  laneTable maps a plane straight to the BSRR word that sets the data pins
+  of the lanes whose bit is 1, clears the others and (with the clock on the
+  same port) pulls the clock low, so a bit costs two stores for all lanes.
+*/
+
+DotStarParallel::DotStarParallel(void) : lanes(0), dataPort(NULL),
+  clockPort(NULL), dataMask(0), clockMask(0), laneTable(NULL) {
+}
+
+DotStarParallel::~DotStarParallel(void) {
+  free(laneTable);
+}
+
+bool DotStarParallel::addStrip(Adafruit_DotStar &strip) {
+  if((lanes >= DOTSTAR_PARALLEL_LANES) || (strip.dataPin == USE_HW_SPI) ||
+     strip.showHook) return false;           // frames built at show() can't share lanes
+
+  GPIO_TypeDef *port = pinInfo(strip.dataPin).gpio_peripheral;
+  uint16_t      mask = pinInfo(strip.dataPin).gpio_pin;
+  if(lanes && ((strip.clockPin != strips[0]->clockPin) ||
+               (port != dataPort) || (mask & dataMask))) return false;
+
+  dataPort  = port;
+  dataMask |= mask;
+  clockPort = pinInfo(strip.clockPin).gpio_peripheral;
+  clockMask = pinInfo(strip.clockPin).gpio_pin;
+  strips[lanes++] = &strip;
+  free(laneTable); // rebuilt by begin()
+  laneTable = NULL;
+  return true;
+}
+
+bool DotStarParallel::begin(void) {
+  for(uint8_t i=0; i<lanes; i++) strips[i]->begin();
+  if(!lanes) return false;
+
+  if(!laneTable && !(laneTable = (uint32_t *)malloc(256 * sizeof(uint32_t))))
+    return false;
+  uint32_t clkLo = (clockPort == dataPort) ? ((uint32_t)clockMask << 16) : 0;
+  for(uint16_t plane=0; plane<256; plane++) {
+    uint16_t set = 0;
+    for(uint8_t i=0; i<lanes; i++) {
+      if(plane & (0x80 >> i)) set |= pinInfo(strips[i]->dataPin).gpio_pin;
+    }
+    laneTable[plane] = set | ((uint32_t)(dataMask & ~set) << 16) | clkLo;
+  }
+  return true;
+}
+
+uint8_t DotStarParallel::numStrips(void) const {
+  return lanes;
+}
+
+// 8x8 bit matrix transpose (Hacker's Delight, 7-3): in[i] is lane i, out[b]
+// holds bit 7-b of every lane with lane i in bit 7-i.
+void DotStarParallel::transpose8(const uint8_t *in, uint8_t *out) {
+  uint32_t x = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
+               ((uint32_t)in[2] << 8)  | in[3],
+           y = ((uint32_t)in[4] << 24) | ((uint32_t)in[5] << 16) |
+               ((uint32_t)in[6] << 8)  | in[7],
+           t;
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  out[0] = x >> 24; out[1] = x >> 16; out[2] = x >> 8; out[3] = x;
+  out[4] = y >> 24; out[5] = y >> 16; out[6] = y >> 8; out[7] = y;
+}
+
+void DotStarParallel::show(void) {
+  if(!laneTable && !begin()) return;
+
+  const uint8_t *frame[DOTSTAR_PARALLEL_LANES];
+  uint32_t       len[DOTSTAR_PARALLEL_LANES], shortest = 0xFFFFFFFF, longest = 0;
+  for(uint8_t i=0; i<lanes; i++) {
+    Adafruit_DotStar *s = strips[i];
+    s->takeDirtyLength();                   // whole frames only
+    STATS(s->statsSubmit(s->backBuffer));
+    STATS(s->spiStartTime = micros());
+    frame[i] = s->sw_spi_frame(s->numLEDs);
+    len[i]   = s->pixelArrayLength;
+    if(len[i] < shortest) shortest = len[i];
+    if(len[i] > longest)  longest  = len[i];
+  }
+
+  GPIO_TypeDef   *dp    = dataPort, *cp = clockPort;
+  const uint32_t *table = laneTable;
+  uint32_t        clkHi = clockMask,
+                  clkLo = (uint32_t)clockMask << 16;
+  uint8_t         in[DOTSTAR_PARALLEL_LANES] = { 0 }, plane[8];
+
+  for(uint32_t pos=0; pos<longest; pos++) {
+    if(pos < shortest) {
+      for(uint8_t i=0; i<lanes; i++) in[i] = frame[i][pos];
+    } else {                                // end frame continues on short lanes
+      for(uint8_t i=0; i<lanes; i++) in[i] = (pos < len[i]) ? frame[i][pos] : 0xFF;
+    }
+    transpose8(in, plane);
+    if(dp == cp) {
+      for(uint8_t b=0; b<8; b++) {
+        portBSRR(dp, table[plane[b]]);
+        portBSRR(dp, clkHi);
+      }
+    } else {
+      for(uint8_t b=0; b<8; b++) {
+        portBSRR(dp, table[plane[b]]);
+        portBSRR(cp, clkHi);
+        portBSRR(cp, clkLo);
+      }
+    }
+  }
+  if(dp == cp) portBSRR(dp, clkLo);
+  STATS(for(uint8_t i=0; i<lanes; i++) strips[i]->statsDone(strips[i]->backBuffer));
+}
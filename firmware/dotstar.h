@@ -28,45 +28,161 @@
 
 #include "application.h"
 
+#include <type_traits>
+
 // Color-order flag for LED pixels (optional extra parameter to constructor):
-// Bits 0,1 = R index (0-2), bits 2,3 = G index, bits 4,5 = B index
-#define DOTSTAR_RGB (0 | (1 << 2) | (2 << 4))
-#define DOTSTAR_RBG (0 | (2 << 2) | (1 << 4))
-#define DOTSTAR_GRB (1 | (0 << 2) | (2 << 4))
-#define DOTSTAR_GBR (2 | (0 << 2) | (1 << 4))
-#define DOTSTAR_BRG (1 | (2 << 2) | (0 << 4))
-#define DOTSTAR_BGR (2 | (1 << 2) | (0 << 4))
+// Bits 0,1 = R index (0-2), bits 2,3 = G index, bits 4,5 = B index.
+// A distinct type (it converts to uint8_t wherever an order is stored) so
+// the constructors can tell an order from a pin number.
+enum DotStarOrder {
+  DOTSTAR_RGB = (0 | (1 << 2) | (2 << 4)),
+  DOTSTAR_RBG = (0 | (2 << 2) | (1 << 4)),
+  DOTSTAR_GRB = (1 | (0 << 2) | (2 << 4)),
+  DOTSTAR_GBR = (2 | (0 << 2) | (1 << 4)),
+  DOTSTAR_BRG = (1 | (2 << 2) | (0 << 4)),
+  DOTSTAR_BGR = (2 | (1 << 2) | (0 << 4))
+};
+
+// Hardware SPI bus (optional 3rd parameter to the hardware SPI constructor).
+// A distinct type so that (n, order, bus) can't be mistaken for the
+// (n, data, clock) soft SPI constructor.
+enum DotStarBus {
+  DOTSTAR_SPI  = 0,                         // A3 clock, A5 data
+  DOTSTAR_SPI1 = 1                          // D4 clock, D2 data
+};
+
+// Output stage applied by show() (see setOutputMode())
+enum DotStarOutput {
+  DOTSTAR_OUTPUT_DIRECT = 0,                // Send the frame as written (default)
+  DOTSTAR_OUTPUT_LUT    = 1,                // Gamma/brightness table, 8 bit
+  DOTSTAR_OUTPUT_HD     = 2,                // Table at 16 bit over 5-bit global + 8-bit PWM
+  DOTSTAR_OUTPUT_DITHER = 3                 // Table at 8.8 bit, temporal dither to 8 bit
+};
+
+// Bitbang engine for soft SPI strips (see setSoftSPIMode())
+enum DotStarSoftSPI {
+  DOTSTAR_SOFT_FAST   = 0,                  // Cached port/masks, unrolled (default)
+  DOTSTAR_SOFT_TABLE  = 1,                  // ... with a nibble-to-BSRR table
+  DOTSTAR_SOFT_PINMAP = 2                   // Original per-bit pin map lookups
+};
+
+// Transfer statistics (see getStats()).  Changes the class layout, so set
+// it here or for the whole build (-DDOTSTAR_STATS=1), not per sketch file.
+#ifndef DOTSTAR_STATS
+  #define DOTSTAR_STATS 0
+#endif
+
+#define DOTSTAR_STATS_BINS 16 // log2 histogram bins: 0 us, 1 us, 2-3 us ... 16384+ us
+
+struct DotStarStats {
+  uint32_t
+    framesSubmitted,                        // show() calls that sent or queued a frame
+    framesTransmitted,                      // Frames completely on the wire
+    framesDropped,                          // Frames lost because DMA was busy
+    framesCoalesced,                        // Queued frames replaced by a newer show()
+    transferLast,                           // Wire time of a frame, us
+    transferMin,
+    transferMax,
+    transferAvg,
+    fps,                                    // Frames transmitted per second since resetStats()
+    transferHist[DOTSTAR_STATS_BINS],       // Wire time, log2 us bins
+    sendLatencyHist[DOTSTAR_STATS_BINS],    // Queue + transfer: show() to last byte sent, log2 us bins
+    renderHist[DOTSTAR_STATS_BINS];         // Render: one show() returning to the next, log2 us bins
+};
+
+#define DOTSTAR_MAX_BUFFERS 4 // Most frame buffers setBufferCount() accepts
+
+// Longest single DMA transfer; longer frames are sent as a chain of these
+// from the completion callback.  The STM32 DMA counter is 16 bit.
+#ifndef DOTSTAR_DMA_CHUNK
+  #define DOTSTAR_DMA_CHUNK 65532
+#endif
+
+// Bytes in the frame buffer of an n LED strip: 4 byte start frame, 4 bytes
+// per LED, end frame of 1 + n/8 bytes.  Usable in constant expressions, so
+// it can size static storage for the caller-owned-storage constructors:
+//   static uint8_t frame[DOTSTAR_FRAME_BYTES(144)];
+//   Adafruit_DotStar strip(144, frame, sizeof(frame));
+#define DOTSTAR_FRAME_BYTES(n) (4 + ((uint32_t)(n) * 4) + (1 + (n) / 8))
 
 class Adafruit_DotStar {
 
  public:
 
-    Adafruit_DotStar(uint16_t n, uint8_t o=DOTSTAR_BGR, uint8_t s=0);
+    Adafruit_DotStar(uint16_t n, uint8_t o=DOTSTAR_BGR, DotStarBus s=DOTSTAR_SPI);
     Adafruit_DotStar(uint16_t n, uint8_t d, uint8_t c, uint8_t o=DOTSTAR_BGR);
+    // Frame in caller-owned storage, DOTSTAR_FRAME_BYTES(n) bytes (per buffer)
+    Adafruit_DotStar(uint16_t n, uint8_t *buf, uint32_t bytes,
+                     uint8_t o=DOTSTAR_BGR, DotStarBus s=DOTSTAR_SPI);
+    Adafruit_DotStar(uint16_t n, uint8_t d, uint8_t c, uint8_t *buf,
+                     uint32_t bytes, uint8_t o=DOTSTAR_BGR);
+    // (n, order, 1) was the bus argument before DotStarBus; it would
+    // otherwise compile as soft SPI with data on pin 'order', clock on 1
+    template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+    Adafruit_DotStar(uint16_t n, DotStarOrder o, T bus) = delete;
    ~Adafruit_DotStar(void);                 // Destructor
   void
     begin(void),                            // Prime pins/SPI for output
     clear(),                                // Set all pixel data to zero
     setBrightness(uint8_t),                 // Set global brightness 0-255
+    setGamma(float g),                      // Output stage gamma, 1.0 = linear
     setPixelColor(uint16_t n, uint32_t c),
     setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b),
+    setPixelColor16(uint16_t n, uint16_t r, uint16_t g, uint16_t b), // 0-65535 ea.
+    fill(uint32_t c=0, uint16_t first=0, uint16_t count=0), // 0 = to end
+    setPixels(uint16_t first, const uint32_t *src, uint16_t count),
+    setPixelsRGB(uint16_t first, const uint8_t *rgb, uint16_t count),
     show(void),                             // Issue color data to strip
     updatePins(void),                       // Change pin assignments (HW)
     updatePins(uint8_t d, uint8_t c),       // Change pin assignments (SW)
-    updateLength(uint16_t n);               // Change length
+    updateLength(uint16_t n),               // Change length
+    setPartialShow(bool on),                // show() sends only up to the last changed pixel
+    markDirty(uint16_t n),                  // Pixel n changed (for getPixels() writers)
+    setPowerModel(uint8_t r, uint8_t g, uint8_t b, uint16_t idle), // mA per channel, uA per LED
+    resetStats(void),                       // Restart the DOTSTAR_STATS counters
+    waitForShow(void);                      // Wait until queued frames are sent
+  bool
+    setPowerLimit(uint32_t mA),             // Current budget show() keeps to, 0 = off
+    setBufferCount(uint8_t n),              // 1 = single buffer, 2+ = queue frames for DMA
+    setOutputMode(DotStarOutput mode),      // Gamma/brightness stage at show()
+    setSoftSPIMode(DotStarSoftSPI mode),    // Bitbang engine (soft SPI only)
+    isShowing(void) const,                  // Frame on the wire or queued
+    getStats(DotStarStats &s) const,        // False (and zeros) without DOTSTAR_STATS
+    getPartialShow(void) const;
   uint32_t
     Color(uint8_t r, uint8_t g, uint8_t b), // R,G,B to 32-bit color
-    getPixelColor(uint16_t n) const;        // Return 32-bit pixel color
+    getPixelColor(uint16_t n) const,        // Return 32-bit pixel color
+    getQueuedFrames(void) const,            // Frames shown while DMA was busy
+    getCoalescedFrames(void) const,         // Queued frames replaced by newer ones
+    getWaitedFrames(void) const,            // show() calls that waited for DMA
+    getPowerLimit(void) const,
+    getPowerEstimate(void) const;           // mA of the last frame shown (limiter on)
   uint16_t
-    numPixels(void);                        // Return number of pixels
+    numPixels(void),                        // Return number of pixels
+    getDirtyLength(void) const;             // Pixels the next partial show() sends
   uint8_t
+    getBufferCount(void) const,             // Return number of frame buffers
     getBrightness(void) const,              // Return global brightness
+    getPowerBrightness(void) const,         // Brightness the limiter last allowed
    *getPixels(void) const;                  // Return pixel data pointer
+  uint16_t
+   *getPixels16(void) const;                // 16-bit buffer (DOTSTAR_OUTPUT_DITHER) or NULL
+  DotStarOutput
+    getOutputMode(void) const;
+  DotStarSoftSPI
+    getSoftSPIMode(void) const;
+  float
+    getGamma(void) const;
 
- private:
+  static void
+    showAll(Adafruit_DotStar * const *strips, uint8_t n, bool wait=false),
+    showAll(Adafruit_DotStar &a, Adafruit_DotStar &b, bool wait=false);
+
+ protected:
 
   uint16_t
-    numLEDs,                                // Number of pixels
+    numLEDs;                                // Number of pixels
+  uint32_t
     pixelArrayLength;                       // Length of the array (includes start/end frame)
   uint8_t
     dataPin,                                // If soft SPI, data pin #
@@ -80,19 +196,291 @@ class Adafruit_DotStar {
     hw_spi_init(void),                      // Start hardware SPI
     hw_spi_end(void),                       // Stop hardware SPI
     sw_spi_init(void),                      // Start bitbang SPI
-    sw_spi_out(uint8_t n),                  // Bitbang SPI write
-    sw_spi_end(void);                       // Stop bitbang SPI
+    sw_spi_out(uint8_t n),                  // Bitbang SPI write (pin map)
+    sw_spi_write(const uint8_t *buf, uint32_t len), // Bitbang engine
+    sw_spi_end(void),                       // Stop bitbang SPI
+    hw_spi_show(void),                      // show() over hardware SPI
+    sw_spi_show(void),                      // show() over bitbang SPI
+    hw_spi_transfer(uint8_t *buf, uint16_t leds), // Start DMA of a frame's first leds
+    hw_spi_dma(uint8_t *buf, uint32_t len), // Start DMA on our bus, chunked
+    showBuffered(uint16_t leds),            // show() with 2+ frame buffers
+    sendNextBuffer(void),                   // Start oldest queued frame if idle
+    resizeFrame(uint16_t n),                // updateLength() without the stage
+    buildOutputLUT(void),                   // Fold gamma + brightness into outputLUT
+    renderOutput(uint8_t *tx, uint16_t leds), // pixels through outputLUT into tx
+    limitPower(void),                       // Fit the frame to powerLimit, from show()
+    scanPower(void),                        // Recount powerSum over the whole frame
+    sumPower(uint16_t first, uint16_t count, bool add), // Count a range in or out
+    stampHeaders(uint16_t leds),            // The first leds pixels to pixelHeader
+    trackPower(const uint8_t *p, uint8_t r, uint8_t g, uint8_t b), // Pixel p becomes r,g,b
+    markChanged(uint16_t n),                // markDirty() for the tracked write paths
+    freeDither(void),                       // Drop the dither buffers
+    releaseBuffer(uint8_t *buf);            // free() unless in caller storage
+  uint8_t
+   *sw_spi_frame(uint16_t leds);            // Frame to bitbang, rendered if a stage is set
+  static void
+    encodeHD(uint16_t a, uint16_t b, uint16_t c, uint8_t *dst); // 16-bit to 5+8 bit
+  bool
+    allocBuffers(uint8_t n),                // Add buffers to reach n
+    allocDither(void),                      // 16-bit buffer and carried fractions
+    sw_spi_pins(void);                      // Cache soft SPI ports and masks
+  uint32_t
+    frameWord(uint32_t c) const;            // Color as the 4 frame bytes of a pixel
+  uint16_t
+    clipRange(uint16_t first, uint16_t count) const, // Pixels a bulk write may touch
+    takeDirtyLength(void);                  // LEDs this show() sends, resets tracking
 
   bool
     use_spi_1 = false;                      //
 
-  static void hw_spi_DMA_TransferComplete_Callback(void); // DMA transfer done
+  GPIO_TypeDef
+   *dataPort = NULL,                        // Soft SPI pins, cached by sw_spi_pins()
+   *clockPort = NULL;
+  uint16_t
+    dataMask = 0,
+    clockMask = 0;
+  uint32_t
+   *bitTable = NULL;                        // DOTSTAR_SOFT_TABLE: BSRR word per nibble bit
+  uint8_t
+    softMode = DOTSTAR_SOFT_FAST;           // DotStarSoftSPI
+
+  uint8_t
+    outputMode = DOTSTAR_OUTPUT_DIRECT;     // DotStarOutput
+  uint16_t
+   *outputLUT = NULL,                       // 257 entries, 8, 16 or 8.8 bit values
+   *pixels16 = NULL;                        // DOTSTAR_OUTPUT_DITHER: 3 channels per LED
+  uint8_t
+   *ditherError = NULL;                     // ... and the fraction each channel still owes
+  float
+    gamma = 1.0f;
+
+  uint8_t
+   *externalPixels = NULL;                  // Caller-owned frame storage, if any
+  uint32_t
+    externalBytes = 0;                      // Size of that storage
+
+  uint8_t
+   *buffers[DOTSTAR_MAX_BUFFERS] = { NULL },// Frame ring, pixels is one of these
+    bufferCount = 1,                        // Number of frame buffers in use
+    backBuffer = 0,                         // Index of the buffer pixels points at
+    pendingHead = 0;                        // Oldest queued frame in pendingBuffers
+  volatile uint8_t
+    sendingBuffer = 0xFF,                   // Buffer on the wire (0xFF = none)
+    pendingCount = 0,                       // Frames queued behind it
+    pendingBuffers[DOTSTAR_MAX_BUFFERS];    // FIFO of queued buffer indexes
+  uint16_t
+    dirtyLEDs = 0,                          // Pixels 0..dirtyLEDs-1 changed since last show()
+    frameLEDs[DOTSTAR_MAX_BUFFERS];         // LEDs each ring buffer sends
+  volatile uint16_t
+    tailBytes = 0;                          // End frame bytes still to send after a partial frame
+  uint8_t
+   *volatile dmaNext = NULL;                // Next chunk of a frame longer than one DMA transfer
+  volatile uint32_t
+    dmaRemaining = 0;                       // Bytes of it still to send
+  bool
+    (*dmaRefill)(Adafruit_DotStar *strip) = NULL, // Starts the next chunk of a streamed frame
+    (*showHook)(Adafruit_DotStar *strip) = NULL;  // First in show(), true = it sent the frame
+  void
+    (*frameSent)(void *context) = NULL;     // Frame completely sent (DotStarFrameQueue)
+  void
+   *frameSentContext = NULL;
+  bool
+    partialShow = false;
+
+  uint8_t
+    pixelHeader = 0xFF,                     // Header the write paths stamp
+    shownBrightness = 255,                  // Brightness after the limiter
+    channelMilliamps[3] = { 20, 20, 20 };   // R, G, B at full, per LED
+  uint16_t
+    idleMicroamps = 1000;                   // Per LED, all channels off
+  uint32_t
+    powerLimit = 0,                         // mA, 0 = limiter off
+    powerEstimate = 0,                      // mA of the last frame shown
+    powerSum[3] = { 0, 0, 0 };              // R, G, B values over the frame
+  bool
+    powerStale = true;                      // powerSum needs a scanPower()
+
+  volatile uint32_t
+    framesQueued = 0,
+    framesCoalesced = 0,
+    framesWaited = 0;
+
+  volatile bool
+    hw_spi_DMA_TransferCompleted = true;    // This strip's last transfer is done
+
+  uint32_t
+    spiStartTime;                           // micros() the frame on the wire started
+
+#if DOTSTAR_STATS
+  void
+    statsSubmit(uint8_t buf),               // Frame in ring buffer 'buf' was shown
+    statsDone(uint8_t buf),                 // ... and is now completely sent
+    statsRender(void);                      // show() called: bin the time since the last one
+  static uint8_t
+    statsBin(uint32_t us);
+  DotStarStats
+    stats;                                  // Derived fields are filled by getStats()
+  uint32_t
+    statsSince,                             // micros() of resetStats()
+    transferTotal,                          // Sum of transfer times, us
+    submitTime[DOTSTAR_MAX_BUFFERS],        // micros() each buffer was shown
+    showReturnTime;                         // micros() the last show() returned, 0 = none yet
+#endif
+
+  static void hw_spi_DMA_TransferComplete_Callback(void);  // SPI DMA done
+  static void hw_spi1_DMA_TransferComplete_Callback(void); // SPI1 DMA done
+  static void hw_spi_DMA_TransferComplete(uint8_t bus);
+
+  static Adafruit_DotStar * volatile
+    busOwner[2];                            // Strip on the wire per bus (SPI, SPI1)
+
+  friend class DotStarParallel;
+  friend class DotStarReceiver;
+  friend class DotStarMatrix;
+  friend class DotStarKernels;
+  friend class DotStarPlayer;
+  friend class DotStarFrameQueue;
+  friend class DotStarKeyframes;
+};
+
+// Inline so the per-pixel write paths only pay a compare
+inline void Adafruit_DotStar::markChanged(uint16_t n) {
+  if(n >= dirtyLEDs) dirtyLEDs = (n < numLEDs) ? (n + 1) : numLEDs;
+}
+
+// Raw writes bypass the power sums, so the limiter recounts them
+inline void Adafruit_DotStar::markDirty(uint16_t n) {
+  markChanged(n);
+  powerStale = true;
+}
+
+// Swap pixel p's old colors for the new ones in the power sums
+inline void Adafruit_DotStar::trackPower(const uint8_t *p, uint8_t r,
+  uint8_t g, uint8_t b) {
+  powerSum[0] += r - p[rOffset+1];
+  powerSum[1] += g - p[gOffset+1];
+  powerSum[2] += b - p[bOffset+1];
+}
+
+/* COMPILE-TIME STRIP ------------------------------------------------------
+
+  DotStarStrip<ORDER, BUS, N> is an Adafruit_DotStar on hardware SPI whose
+  color order and bus are template constants, so setPixelColor() and
+  getPixelColor() compile to fixed-offset stores and loads and show() goes
+  straight to the DMA path.  The bus is only fixed at construction: begin()
+  and the transfers are the core's, which pick SPI or SPI1 at run time (one
+  branch per DMA transfer), because chained chunks, end frames and queued
+  frames are all started from the shared completion callback.  With N > 0
+  the frame buffer is a member array sized at compile time, so the strip
+  needs no heap; with N == 0 the length is passed to the constructor as
+  usual.  Everything else (bulk writes, frame buffers, showAll() ...) is
+  inherited unchanged.
+
+    DotStarStrip<DOTSTAR_BGR, DOTSTAR_SPI1, 144> strip;
+    DotStarStrip<DOTSTAR_GRB>                    other(60);
+*/
+
+template <uint8_t ORDER = DOTSTAR_BGR, DotStarBus BUS = DOTSTAR_SPI,
+          uint16_t N = 0>
+class DotStarStrip : public Adafruit_DotStar {
+
+ public:
+
+  DotStarStrip(void) :
+   Adafruit_DotStar(N, frame, sizeof(frame), ORDER, BUS) { }
+  DotStarStrip(uint16_t n) : Adafruit_DotStar(n, ORDER, BUS) {
+    static_assert(N == 0, "length is fixed by the template for this strip");
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+    if(n < numLEDs) {
+      uint8_t *p = &pixels[4 + (n * 4)];
+      if(powerLimit) trackPower(p, r, g, b);
+      p[0] = pixelHeader;
+      p[R] = r;
+      p[G] = g;
+      p[B] = b;
+      markChanged(n);
+    }
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c) {
+    setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c);
+  }
+
+  uint32_t getPixelColor(uint16_t n) const {
+    if(n >= numLEDs) return 0;
+    const uint8_t *p = &pixels[4 + (n * 4)];
+    return ((uint32_t)p[R] << 16) | ((uint32_t)p[G] << 8) | p[B];
+  }
 
-  static bool
-    hw_spi_DMA_TransferCompleted;
+  void show(void) {
+    if(pixels) hw_spi_show();
+  }
 
-  static uint16_t
-    spiStartTime;
+ private:
+
+  enum {                                    // Byte of each color in a pixel
+    R = (ORDER & 3) + 1,
+    G = ((ORDER >> 2) & 3) + 1,
+    B = ((ORDER >> 4) & 3) + 1
+  };
+
+  uint8_t
+    frame[N ? DOTSTAR_FRAME_BYTES(N) : 1];  // Static frame (N > 0 only)
+
+};
+
+/* PARALLEL SOFT SPI -------------------------------------------------------
+
+  DotStarParallel bitbangs up to 8 soft SPI strips at once.  The strips
+  share one clock pin and their data pins sit on one GPIO port, so each
+  clock edge carries a bit for every strip: 8 strips take about as long as
+  one.  Each strip keeps its own buffer, length, color order and output
+  stage; shorter strips get extra end frame bytes while the longer ones
+  finish.  Strips always send whole frames here (partial show is ignored).
+
+    Adafruit_DotStar a(144, D0, D4), b(60, D1, D4), c(144, D2, D4);
+    DotStarParallel  out;
+    out.addStrip(a); out.addStrip(b); out.addStrip(c);
+    out.begin();
+    ...
+    out.show();
+*/
+
+#define DOTSTAR_PARALLEL_LANES 8
+
+class DotStarParallel {
+
+ public:
+
+  DotStarParallel(void);
+ ~DotStarParallel(void);
+  bool
+    addStrip(Adafruit_DotStar &strip),      // False if full or pins don't fit
+    begin(void);                            // Pins to output, build lane table
+  void
+    show(void);                             // Send every strip's frame
+  uint8_t
+    numStrips(void) const;
+
+ private:
+
+  static void
+    transpose8(const uint8_t *in, uint8_t *out); // 8 lane bytes to 8 bit planes
+
+  Adafruit_DotStar
+   *strips[DOTSTAR_PARALLEL_LANES];
+  uint8_t
+    lanes;                                  // Strips added
+  GPIO_TypeDef
+   *dataPort,                               // Port of all data pins
+   *clockPort;
+  uint16_t
+    dataMask,                               // All data pins
+    clockMask;
+  uint32_t
+   *laneTable;                              // Bit plane (lane 0 = MSB) to BSRR word
 
 };
 
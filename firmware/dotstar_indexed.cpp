@@ -0,0 +1,319 @@
+/*------------------------------------------------------------------------
+  Palette-indexed strips for the DotStar library.
+  See dotstar_indexed.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_indexed.h"
+
+#if DOTSTAR_STATS
+  #define STATS(_x) _x
+#else
+  #define STATS(_x)
+#endif
+
+#define USE_HW_SPI 255 // dataPin of hardware SPI strips (see dotstar.cpp)
+
+/* The palette is kept as ready-made frame words (brightness header, colors
+  in strip order), so expanding an LED is one 4-byte copy.  A streamed
+  frame is cut into chunks of DOTSTAR_INDEXED_CHUNK LEDs that alternate
+  between the two halves of the ping-pong buffer; chunk 0 goes out with
+  the start frame in front of it.  show() expands the first two chunks and
+  starts DMA, then each completion (through the core's dmaRefill hook)
+  starts the chunk already waiting and expands the next one into the half
+  that just went out.  If a completion ever arrives before that refill (a
+  bus whose callback runs inside transfer()), sendChunk() expands the
+  chunk itself first, so the order on the wire is always right.  The end
+  frame is the zero one of partial frames.  The wire sits idle for the
+  length of an interrupt between chunks, which the LEDs don't mind.
+*/
+
+DotStarIndexed::DotStarIndexed(uint16_t n, DotStarIndexBits bits,
+  bool fullFrame, uint8_t o, DotStarBus s) :
+  Adafruit_DotStar(fullFrame ? n : 0, o, s) {
+  init(n, bits, fullFrame);
+}
+
+DotStarIndexed::DotStarIndexed(uint16_t n, uint8_t d, uint8_t c,
+  DotStarIndexBits bits, bool fullFrame, uint8_t o) :
+  Adafruit_DotStar(fullFrame ? n : 0, d, c, o) {
+  init(n, bits, fullFrame);
+}
+
+DotStarIndexed::~DotStarIndexed(void) {
+  if(busOwner[use_spi_1] == this) busOwner[use_spi_1] = NULL;
+  dmaRefill = NULL;
+  showHook  = NULL;
+  free(indexes);
+  free(palette);
+  free(chunk);
+}
+
+// All or nothing: a strip that can't get its buffers has 0 LEDs
+void DotStarIndexed::init(uint16_t n, DotStarIndexBits bits, bool fullFrame) {
+  indexBits     = bits;
+  leds          = 0;
+  chunks        = 0;
+  chunkFilled   = 0;
+  chunkSent     = 0;
+  paletteHeader = pixelHeader;
+  showHook      = showIndexes;              // also when the buffers fail: nothing to send
+
+  uint32_t bytes = (bits == DOTSTAR_INDEX_8BIT) ? n : (n + 1) / 2;
+  indexes = (uint8_t *)calloc(bytes ? bytes : 1, 1);
+  palette = (uint32_t *)malloc(getPaletteSize() * sizeof(uint32_t));
+  chunk   = fullFrame ? NULL : (uint8_t *)calloc(4 + 2 * DOTSTAR_INDEXED_CHUNK * 4, 1);
+  if(!indexes || !palette || (fullFrame ? (numLEDs != n) : !chunk)) {
+    free(indexes);
+    free(palette);
+    free(chunk);
+    indexes = chunk = NULL;
+    palette = NULL;
+    return;
+  }
+
+  uint32_t black = frameWord(0);
+  for(uint16_t i=0; i<getPaletteSize(); i++) palette[i] = black;
+  leds   = n;
+  chunks = (n + DOTSTAR_INDEXED_CHUNK - 1) / DOTSTAR_INDEXED_CHUNK;
+  if(chunk) dmaRefill = streamNext;
+}
+
+// Frame bytes of LEDs first .. first + count - 1 into dst
+void DotStarIndexed::expand(uint8_t *dst, uint16_t first, uint16_t count) const {
+  const uint32_t *pal = palette;
+
+  if(indexBits == DOTSTAR_INDEX_8BIT) {
+    const uint8_t *src = &indexes[first];
+    while(count--) {
+      memcpy(dst, &pal[*src++], 4);
+      dst += 4;
+    }
+    return;
+  }
+
+  // 4 bit: an odd first LED, then two LEDs per byte
+  const uint8_t *src = &indexes[first >> 1];
+  if((first & 1) && count) {
+    memcpy(dst, &pal[*src++ >> 4], 4);
+    dst += 4;
+    count--;
+  }
+  for(; count >= 2; count -= 2) {
+    uint8_t b = *src++;
+    memcpy(dst,     &pal[b & 15], 4);
+    memcpy(dst + 4, &pal[b >> 4], 4);
+    dst += 8;
+  }
+  if(count) memcpy(dst, &pal[*src & 15], 4);
+}
+
+// setBrightness() or the power limit since the last show(): restamp the
+// palette headers
+void DotStarIndexed::refreshPalette(void) {
+  uint8_t header = pixelHeader;
+  if(header == paletteHeader) return;
+  for(uint16_t i=0; i<getPaletteSize(); i++) memcpy(&palette[i], &header, 1);
+  paletteHeader = header;
+  dirtyLEDs     = numLEDs;                  // full frame: every LED changes
+}
+
+// From the core's show(), so it runs through an Adafruit_DotStar& as well
+bool DotStarIndexed::showIndexes(Adafruit_DotStar *strip) {
+  return static_cast<DotStarIndexed *>(strip)->prepareShow();
+}
+
+bool DotStarIndexed::prepareShow(void) {
+  if(!leds) return true;
+  refreshPalette();
+
+  if(!chunk) {
+    // full frame: expand what changed, then the core sends it as usual
+    if(dirtyLEDs) powerStale = true;        // the limiter can't follow expand()
+    expand(&pixels[4], 0, dirtyLEDs);
+    return false;
+  }
+
+  if(dataPin != USE_HW_SPI) {
+    sw_spi_stream();
+    return true;
+  }
+  if(busOwner[use_spi_1]) {
+    STATS(stats.framesDropped++);
+    return true; // dropped, as on a single-buffer strip
+  }
+  STATS(statsSubmit(0));
+
+  chunkFilled = 0;
+  chunkSent   = 0;
+  fillChunk();
+  if(chunks > 1) fillChunk();
+
+  hw_spi_DMA_TransferCompleted = false;
+  busOwner[use_spi_1] = this;
+  STATS(spiStartTime = micros());
+  tailBytes = 1 + leds/8;
+  sendChunk();
+  return true;
+}
+
+uint8_t *DotStarIndexed::chunkData(uint16_t c) const {
+  return &chunk[4 + (c & 1) * (DOTSTAR_INDEXED_CHUNK * 4)];
+}
+
+void DotStarIndexed::fillChunk(void) {
+  uint16_t c     = chunkFilled;
+  uint32_t first = (uint32_t)c * DOTSTAR_INDEXED_CHUNK,
+           count = leds - first;
+  if(count > DOTSTAR_INDEXED_CHUNK) count = DOTSTAR_INDEXED_CHUNK;
+  expand(chunkData(c), first, count);
+  chunkFilled = c + 1;
+}
+
+// Start the next chunk, false after the last one.  From show() and the
+// DMA completion interrupt.
+bool DotStarIndexed::sendChunk(void) {
+  if(chunkSent >= chunks) return false;
+  if(chunkFilled == chunkSent) fillChunk(); // completion came before the refill
+
+  uint16_t c     = chunkSent;
+  uint32_t first = (uint32_t)c * DOTSTAR_INDEXED_CHUNK,
+           count = leds - first;
+  if(count > DOTSTAR_INDEXED_CHUNK) count = DOTSTAR_INDEXED_CHUNK;
+  uint8_t *buf = chunkData(c);
+  uint32_t len = count * 4;
+  if(!c) {                                  // with the start frame
+    buf -= 4;
+    len += 4;
+  }
+  chunkSent = c + 1;
+  hw_spi_dma(buf, len);
+
+  // the other half has been sent: refill it while this one is on the wire
+  if((chunkFilled == chunkSent) && (chunkFilled < chunks)) fillChunk();
+  return true;
+}
+
+bool DotStarIndexed::streamNext(Adafruit_DotStar *strip) {
+  return static_cast<DotStarIndexed *>(strip)->sendChunk();
+}
+
+// Soft SPI: expand and bitbang one chunk at a time
+void DotStarIndexed::sw_spi_stream(void) {
+  STATS(statsSubmit(0));
+  STATS(spiStartTime = micros());
+
+  for(uint32_t first=0; first<leds; first+=DOTSTAR_INDEXED_CHUNK) {
+    uint32_t count = leds - first;
+    if(count > DOTSTAR_INDEXED_CHUNK) count = DOTSTAR_INDEXED_CHUNK;
+    expand(&chunk[4], first, count);
+    if(first) sw_spi_write(&chunk[4], count * 4);
+    else      sw_spi_write(chunk, 4 + count * 4);
+  }
+
+  memset(&chunk[4], 0, DOTSTAR_INDEXED_CHUNK * 4);
+  for(uint16_t tail = 1 + leds/8; tail; ) {
+    uint16_t len = (tail > DOTSTAR_INDEXED_CHUNK * 4) ? DOTSTAR_INDEXED_CHUNK * 4 : tail;
+    sw_spi_write(&chunk[4], len);
+    tail -= len;
+  }
+  STATS(statsDone(0));
+}
+
+void DotStarIndexed::setPixelIndex(uint16_t n, uint8_t i) {
+  if(n >= leds) return;
+  if(indexBits == DOTSTAR_INDEX_8BIT) {
+    indexes[n] = i;
+  } else {
+    uint8_t shift = (n & 1) * 4, *p = &indexes[n >> 1];
+    *p = (*p & ~(15 << shift)) | ((i & 15) << shift);
+  }
+  markDirty(n);
+}
+
+// Set 'count' LEDs starting at 'first' to index i
+void DotStarIndexed::fillIndex(uint8_t i, uint16_t first, uint16_t count) {
+  if(first >= leds) return;
+  uint16_t room = leds - first;
+  if(!count || (count > room)) count = room;
+  markDirty(first + count - 1);
+
+  if(indexBits == DOTSTAR_INDEX_8BIT) {
+    memset(&indexes[first], i, count);
+    return;
+  }
+  uint16_t n = first, end = first + count;
+  if(n & 1) setPixelIndex(n++, i);
+  i &= 15;
+  memset(&indexes[n >> 1], i | (i << 4), (end - n) >> 1);
+  if((end - n) & 1) setPixelIndex(end - 1, i);
+}
+
+void DotStarIndexed::setPaletteColor(uint8_t i, uint32_t c) {
+  if(!leds || (i >= getPaletteSize())) return;
+  palette[i] = frameWord(c);
+  dirtyLEDs  = numLEDs;
+}
+
+void DotStarIndexed::setPaletteColor(uint8_t i, uint8_t r, uint8_t g, uint8_t b) {
+  setPaletteColor(i, Color(r, g, b));
+}
+
+static void reversePalette(uint32_t *p, uint16_t count) {
+  for(uint32_t *q = p + count - 1; p < q; p++, q--) {
+    uint32_t t = *p;
+    *p = *q;
+    *q = t;
+  }
+}
+
+// Entry first + k moves to first + (k + step) % count; three reversals,
+// in place
+void DotStarIndexed::rotatePalette(uint8_t first, uint16_t count, uint8_t step) {
+  if(!leds || (first >= getPaletteSize())) return;
+  if(count > getPaletteSize() - first) count = getPaletteSize() - first;
+  if((count < 2) || !(step %= count)) return;
+
+  uint32_t *p = &palette[first];
+  reversePalette(p, count);
+  reversePalette(p, step);
+  reversePalette(p + step, count - step);
+  dirtyLEDs = numLEDs;
+}
+
+uint8_t DotStarIndexed::getPixelIndex(uint16_t n) const {
+  if(n >= leds) return 0;
+  if(indexBits == DOTSTAR_INDEX_8BIT) return indexes[n];
+  return (indexes[n >> 1] >> ((n & 1) * 4)) & 15;
+}
+
+uint8_t *DotStarIndexed::getIndexes(void) const {
+  return indexes;
+}
+
+uint32_t DotStarIndexed::wordColor(uint32_t word) const {
+  uint8_t frame[4];
+  memcpy(frame, &word, 4);
+  return ((uint32_t)frame[rOffset+1] << 16) |
+         ((uint32_t)frame[gOffset+1] <<  8) |
+                    frame[bOffset+1];
+}
+
+uint32_t DotStarIndexed::getPaletteColor(uint8_t i) const {
+  return (leds && (i < getPaletteSize())) ? wordColor(palette[i]) : 0;
+}
+
+uint32_t DotStarIndexed::getPixelColor(uint16_t n) const {
+  return (n < leds) ? wordColor(palette[getPixelIndex(n)]) : 0;
+}
+
+uint16_t DotStarIndexed::numPixels(void) const {
+  return leds;
+}
+
+uint16_t DotStarIndexed::getPaletteSize(void) const {
+  return 1 << indexBits;
+}
+
+bool DotStarIndexed::isStreamed(void) const {
+  return chunk != NULL;
+}
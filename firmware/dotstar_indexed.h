@@ -0,0 +1,116 @@
+/*------------------------------------------------------------------------
+  Palette-indexed strips for the DotStar library.
+
+  DotStarIndexed keeps one palette index per LED (8 or 4 bits) instead of
+  the 4-byte frame, and expands it into APA102 frame bytes at show().  By
+  default the frame is never stored whole: show() expands a few LEDs at a
+  time into a small ping-pong buffer and the DMA completion callback
+  refills one half while the other is on the wire.  An 8192-LED strip
+  then needs 8 KB of indexes (4 KB at 4 bits) instead of a 32 KB frame.
+  Recoloring means changing the palette, which costs O(palette) rather
+  than O(LEDs): a rotating rainbow is one rotatePalette() per frame.
+
+    DotStarIndexed strip(1024);               // 8 bit, streamed, SPI
+    DotStarIndexed small(1024, DOTSTAR_INDEX_4BIT);
+
+    strip.setPaletteColor(1, 0xFF0000);
+    strip.fillIndex(1, 0, 100);               // LEDs 0-99 use color 1
+    strip.rotatePalette(1, 255);              // colors 1-255 move up one
+    strip.show();
+
+  Streamed strips always send the whole frame from the indexes; the
+  output stage, extra frame buffers, partial show and the power limit
+  need a full frame, which the fullFrame constructor argument keeps (the
+  indexes then expand into it at show()).  setPowerLimit() returns false
+  on a streamed strip.  Draw with the index calls; the length is fixed
+  at construction.
+  The expansion runs from the core's show() hook, so a strip passed on
+  as an Adafruit_DotStar& (showAll(), the scheduler, a frame queue) still
+  sends its indexes.  Through that reference numPixels() and
+  getPixelColor() are the core's: a streamed strip has no frame and
+  looks 0 LEDs long, a full-frame one reads the frame as last expanded.
+  Parallel output takes neither kind.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_INDEXED_H_
+#define _DOTSTAR_INDEXED_H_
+
+#include "dotstar.h"
+
+// LEDs expanded per half of the ping-pong buffer (2 * 4 bytes each)
+#ifndef DOTSTAR_INDEXED_CHUNK
+  #define DOTSTAR_INDEXED_CHUNK 32
+#endif
+
+// Bits per index; a distinct type so the hardware and soft SPI
+// constructors can't be mistaken for each other
+enum DotStarIndexBits {
+  DOTSTAR_INDEX_4BIT = 4,                   // 16 colors, two LEDs per byte
+  DOTSTAR_INDEX_8BIT = 8                    // 256 colors
+};
+
+class DotStarIndexed : public Adafruit_DotStar {
+
+ public:
+
+  DotStarIndexed(uint16_t n, DotStarIndexBits bits=DOTSTAR_INDEX_8BIT,
+                 bool fullFrame=false, uint8_t o=DOTSTAR_BGR, DotStarBus s=DOTSTAR_SPI);
+  DotStarIndexed(uint16_t n, uint8_t d, uint8_t c,
+                 DotStarIndexBits bits=DOTSTAR_INDEX_8BIT, bool fullFrame=false,
+                 uint8_t o=DOTSTAR_BGR);
+ ~DotStarIndexed(void);
+
+  void
+    setPixelIndex(uint16_t n, uint8_t i),
+    fillIndex(uint8_t i, uint16_t first=0, uint16_t count=0), // 0 = to end
+    setPaletteColor(uint8_t i, uint32_t c),
+    setPaletteColor(uint8_t i, uint8_t r, uint8_t g, uint8_t b),
+    rotatePalette(uint8_t first, uint16_t count, uint8_t step=1); // Entries move up 'step'
+  uint8_t
+    getPixelIndex(uint16_t n) const,
+   *getIndexes(void) const;                 // Raw indexes (4 bit: LED 2k in the low nibble)
+  uint32_t
+    getPaletteColor(uint8_t i) const,
+    getPixelColor(uint16_t n) const;        // Palette color of LED n
+  uint16_t
+    numPixels(void) const,                  // 0 if the buffers could not be allocated
+    getPaletteSize(void) const;             // 16 or 256
+  bool
+    isStreamed(void) const;
+
+ private:
+
+  void
+    init(uint16_t n, DotStarIndexBits bits, bool fullFrame),
+    expand(uint8_t *dst, uint16_t first, uint16_t count) const,
+    refreshPalette(void),                   // Brightness header of the palette words
+    fillChunk(void),
+    sw_spi_stream(void);
+  bool
+    prepareShow(void),                      // Expand; true if the frame was sent too
+    sendChunk(void);
+  uint8_t
+   *chunkData(uint16_t c) const;            // Half of the ping-pong buffer of chunk c
+  uint32_t
+    wordColor(uint32_t word) const;         // Frame word back to packed RGB
+  static bool
+    showIndexes(Adafruit_DotStar *strip),   // showHook
+    streamNext(Adafruit_DotStar *strip);    // dmaRefill hook
+
+  uint8_t
+   *indexes,
+   *chunk,                                  // 4 start bytes + 2 halves, streamed only
+    indexBits,
+    paletteHeader;                          // Brightness header in the palette words
+  uint32_t
+   *palette;                                // Colors as frame words
+  uint16_t
+    leds,
+    chunks;                                 // Chunks in a frame
+  volatile uint16_t
+    chunkFilled,                            // Chunks expanded so far this frame
+    chunkSent;                              // ... and started on the wire
+
+};
+
+#endif // _DOTSTAR_INDEXED_H_
@@ -0,0 +1,246 @@
+/*------------------------------------------------------------------------
+  Pixel math kernels for the DotStar library.
+  See dotstar_kernels.h for usage and the exact results.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_kernels.h"
+
+#if defined(__SSE2__) && !defined(DOTSTAR_NO_SIMD)
+ #include <emmintrin.h>
+ #define KERNELS_SSE2                       // 4 LEDs per step, then the word loop
+#endif
+
+/* WORD OPERATIONS ---------------------------------------------------------
+
+  One LED is one 32-bit word, header in the low byte (both targets and the
+  host are little endian), so the loops work a word at a time and put the
+  destination's header back.  Every supported device (Core STM32F103,
+  Photon/P1/Electron STM32F205) is a Cortex-M3, which has no byte-lane
+  SIMD, so saturating and halving adds are SWAR bit tricks on the device
+  build; only the host uses SSE2.  Multiplies split a word into two 16-bit
+  lanes (bytes 0,2 and 1,3): 255 * 256 still fits a lane, so two MULs
+  scale four bytes.
+*/
+
+#define HEADER 0x000000FFUL
+#define LANES  0x00FF00FFUL
+
+static inline uint32_t loadLED(const uint8_t *p) {
+  uint32_t w;
+  memcpy(&w, p, 4);                         // caller storage may be unaligned
+  return w;
+}
+
+static inline void storeLED(uint8_t *p, uint32_t w) {
+  memcpy(p, &w, 4);
+}
+
+// Per byte min(a + b, 255)
+static inline uint32_t adds8x4(uint32_t a, uint32_t b) {
+  uint32_t sum   = ((a & 0x7F7F7F7F) + (b & 0x7F7F7F7F)) ^ ((a ^ b) & 0x80808080),
+           carry = ((a & b) | ((a | b) & ~sum)) & 0x80808080;
+  return sum | ((carry >> 7) * 0xFF);       // bytes that carried out become 255
+}
+
+// Per byte (a + b) >> 1
+static inline uint32_t average8x4(uint32_t a, uint32_t b) {
+  return (a & b) + (((a ^ b) >> 1) & 0x7F7F7F7F);
+}
+
+// Per byte c * m >> 8, m = 1-256
+static inline uint32_t scale8x4(uint32_t w, uint32_t m) {
+  return (((w & LANES) * m >> 8) & LANES) | (((w >> 8) & LANES) * m & ~LANES);
+}
+
+// Per byte (a * (256 - t) + b * t) >> 8
+static inline uint32_t blend8x4(uint32_t a, uint32_t b, uint32_t t) {
+  uint32_t u = 256 - t;
+  return ((((a & LANES) * u + (b & LANES) * t) >> 8) & LANES) |
+         ((((a >> 8) & LANES) * u + ((b >> 8) & LANES) * t) & ~LANES);
+}
+
+static inline uint32_t keepHeader(uint32_t w, uint32_t dst) {
+  return (w & ~HEADER) | (dst & HEADER);
+}
+
+#ifdef KERNELS_SSE2
+
+static inline __m128i keepHeader(__m128i v, __m128i dst) {
+  const __m128i header = _mm_set1_epi32(HEADER);
+  return _mm_or_si128(_mm_andnot_si128(header, v), _mm_and_si128(header, dst));
+}
+
+// Bytes times 16-bit factors m (per byte of two LEDs), >> 8
+static inline __m128i scale16x8(__m128i v, __m128i m) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), m), 8),
+          hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), m), 8);
+  return _mm_packus_epi16(lo, hi);
+}
+
+#endif
+
+// KERNELS -----------------------------------------------------------------
+
+void DotStarKernels::scale(uint8_t *leds, uint16_t n, uint8_t f) {
+  uint32_t m = f + 1;
+#ifdef KERNELS_SSE2
+  // a factor of 256 leaves the header lanes as they are
+  const __m128i mv = _mm_set_epi16(m, m, m, 256, m, m, m, 256);
+  for(; n >= 4; n -= 4, leds += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)leds);
+    _mm_storeu_si128((__m128i *)leds, scale16x8(v, mv));
+  }
+#endif
+  for(; n; n--, leds += 4) {
+    uint32_t w = loadLED(leds);
+    storeLED(leds, keepHeader(scale8x4(w, m), w));
+  }
+}
+
+void DotStarKernels::scale(uint8_t *leds, uint16_t n, uint8_t f1, uint8_t f2,
+  uint8_t f3) {
+  uint16_t m1 = f1 + 1, m2 = f2 + 1, m3 = f3 + 1;
+#ifdef KERNELS_SSE2
+  const __m128i mv = _mm_set_epi16(m3, m2, m1, 256, m3, m2, m1, 256);
+  for(; n >= 4; n -= 4, leds += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)leds);
+    _mm_storeu_si128((__m128i *)leds, scale16x8(v, mv));
+  }
+#endif
+  // three different factors don't share a MUL; one per byte
+  for(; n; n--, leds += 4) {
+    leds[1] = (leds[1] * m1) >> 8;
+    leds[2] = (leds[2] * m2) >> 8;
+    leds[3] = (leds[3] * m3) >> 8;
+  }
+}
+
+void DotStarKernels::add(uint8_t *dst, const uint8_t *src, uint16_t n) {
+#ifdef KERNELS_SSE2
+  for(; n >= 4; n -= 4, dst += 16, src += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)dst),
+            s = _mm_loadu_si128((const __m128i *)src);
+    _mm_storeu_si128((__m128i *)dst, keepHeader(_mm_adds_epu8(d, s), d));
+  }
+#endif
+  for(; n; n--, dst += 4, src += 4) {
+    uint32_t d = loadLED(dst);
+    storeLED(dst, keepHeader(adds8x4(d, loadLED(src)), d));
+  }
+}
+
+void DotStarKernels::average(uint8_t *dst, const uint8_t *src, uint16_t n) {
+#ifdef KERNELS_SSE2
+  // pavgb rounds up; take the odd sums' 1 back off
+  const __m128i ones = _mm_set1_epi8(1);
+  for(; n >= 4; n -= 4, dst += 16, src += 16) {
+    __m128i d   = _mm_loadu_si128((const __m128i *)dst),
+            s   = _mm_loadu_si128((const __m128i *)src),
+            avg = _mm_sub_epi8(_mm_avg_epu8(d, s),
+                               _mm_and_si128(_mm_xor_si128(d, s), ones));
+    _mm_storeu_si128((__m128i *)dst, keepHeader(avg, d));
+  }
+#endif
+  for(; n; n--, dst += 4, src += 4) {
+    uint32_t d = loadLED(dst);
+    storeLED(dst, keepHeader(average8x4(d, loadLED(src)), d));
+  }
+}
+
+void DotStarKernels::blend(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+  uint16_t n, uint8_t t) {
+#ifdef KERNELS_SSE2
+  const __m128i zero = _mm_setzero_si128(),
+                tv   = _mm_set1_epi16(t),
+                uv   = _mm_set1_epi16(256 - t);
+  for(; n >= 4; n -= 4, dst += 16, a += 16, b += 16) {
+    __m128i d  = _mm_loadu_si128((const __m128i *)dst),
+            va = _mm_loadu_si128((const __m128i *)a),
+            vb = _mm_loadu_si128((const __m128i *)b),
+            lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), uv),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), tv)),
+            hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), uv),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), tv));
+    __m128i v  = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+    _mm_storeu_si128((__m128i *)dst, keepHeader(v, d));
+  }
+#endif
+  for(; n; n--, dst += 4, a += 4, b += 4)
+    storeLED(dst, keepHeader(blend8x4(loadLED(a), loadLED(b), t), loadLED(dst)));
+}
+
+// STRIPS ------------------------------------------------------------------
+
+/* The strip versions count the LEDs they change out of the power
+  limiter's sums and back in afterwards, a second pass over the same
+  bytes, so show() doesn't recount the strip.
+  With DOTSTAR_OUTPUT_DITHER a pixel whose header is below 0xE0 is sent
+  from pixels16, which the kernels don't touch.  Its frame bytes hold the
+  top 8 bits, so the strip versions give it the strip's header first:
+  the result is then an ordinary 8-bit pixel, and that is what goes out.
+*/
+void DotStarKernels::drop16(Adafruit_DotStar &strip, uint16_t n) {
+  if(!strip.pixels16) return;
+  uint8_t *p = &strip.pixels[4];
+  for(; n--; p += 4) {
+    if(p[0] < 0xE0) p[0] = strip.pixelHeader;
+  }
+}
+
+void DotStarKernels::fade(Adafruit_DotStar &strip, uint8_t f) {
+  if(!strip.numLEDs) return;
+  drop16(strip, strip.numLEDs);
+  if(strip.powerLimit) strip.sumPower(0, strip.numLEDs, false);
+  scale(&strip.pixels[4], strip.numLEDs, f);
+  if(strip.powerLimit) strip.sumPower(0, strip.numLEDs, true);
+  strip.markChanged(strip.numLEDs - 1);
+}
+
+void DotStarKernels::scale(Adafruit_DotStar &strip, uint8_t r, uint8_t g,
+  uint8_t b) {
+  if(!strip.numLEDs) return;
+  uint8_t f[3];
+  f[strip.rOffset] = r;
+  f[strip.gOffset] = g;
+  f[strip.bOffset] = b;
+  drop16(strip, strip.numLEDs);
+  if(strip.powerLimit) strip.sumPower(0, strip.numLEDs, false);
+  scale(&strip.pixels[4], strip.numLEDs, f[0], f[1], f[2]);
+  if(strip.powerLimit) strip.sumPower(0, strip.numLEDs, true);
+  strip.markChanged(strip.numLEDs - 1);
+}
+
+void DotStarKernels::add(Adafruit_DotStar &dst, const Adafruit_DotStar &src) {
+  uint16_t n = (src.numLEDs < dst.numLEDs) ? src.numLEDs : dst.numLEDs;
+  if(!n) return;
+  drop16(dst, n);
+  if(dst.powerLimit) dst.sumPower(0, n, false);
+  add(&dst.pixels[4], &src.pixels[4], n);
+  if(dst.powerLimit) dst.sumPower(0, n, true);
+  dst.markChanged(n - 1);
+}
+
+void DotStarKernels::average(Adafruit_DotStar &dst,
+  const Adafruit_DotStar &src) {
+  uint16_t n = (src.numLEDs < dst.numLEDs) ? src.numLEDs : dst.numLEDs;
+  if(!n) return;
+  drop16(dst, n);
+  if(dst.powerLimit) dst.sumPower(0, n, false);
+  average(&dst.pixels[4], &src.pixels[4], n);
+  if(dst.powerLimit) dst.sumPower(0, n, true);
+  dst.markChanged(n - 1);
+}
+
+void DotStarKernels::blend(Adafruit_DotStar &dst, const Adafruit_DotStar &a,
+  const Adafruit_DotStar &b, uint8_t t) {
+  uint16_t n = dst.numLEDs;
+  if(a.numLEDs < n) n = a.numLEDs;
+  if(b.numLEDs < n) n = b.numLEDs;
+  if(!n) return;
+  drop16(dst, n);
+  if(dst.powerLimit) dst.sumPower(0, n, false);
+  blend(&dst.pixels[4], &a.pixels[4], &b.pixels[4], n, t);
+  if(dst.powerLimit) dst.sumPower(0, n, true);
+  dst.markChanged(n - 1);
+}
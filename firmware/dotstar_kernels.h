@@ -0,0 +1,60 @@
+/*------------------------------------------------------------------------
+  Pixel math kernels for the DotStar library.
+
+  Fade, scale, add, average and crossfade whole runs of LEDs in the
+  4-byte-per-LED frame layout (brightness header + three color bytes in
+  strip order) without unpacking colors.  The header byte of the
+  destination is kept.  The raw versions take the first LED's header,
+  getPixels() + 4, and leave markDirty() to the caller; the strip
+  versions do both.  Under DOTSTAR_OUTPUT_DITHER the strip versions turn
+  16-bit pixels (setPixelColor16(), DotStarKeyframes) they write into
+  8-bit ones first, so what they compute is what is sent.
+
+    DotStarKernels::fade(strip, 240);             // 6% towards black
+    DotStarKernels::blend(strip, from, to, t);    // crossfade two frames
+
+  Every result is defined per color byte c (and source byte s):
+    scale    c * (f + 1) >> 8          f = 255 keeps c, 0 gives 0
+    add      min(c + s, 255)
+    average  (c + s) >> 1
+    blend    (a * (256 - t) + b * t) >> 8, t = 0 gives a
+  and every build (SSE2 on the host, portable SWAR on the devices) gives
+  the same bytes.  Define DOTSTAR_NO_SIMD to build the portable code on
+  the host too.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_KERNELS_H_
+#define _DOTSTAR_KERNELS_H_
+
+#include "dotstar.h"
+
+class DotStarKernels {
+
+ public:
+
+  // Raw frames: n LEDs starting at a header byte
+  static void
+    scale(uint8_t *leds, uint16_t n, uint8_t f),
+    scale(uint8_t *leds, uint16_t n, uint8_t f1, uint8_t f2, uint8_t f3), // Frame bytes 1-3
+    add(uint8_t *dst, const uint8_t *src, uint16_t n),
+    average(uint8_t *dst, const uint8_t *src, uint16_t n),
+    blend(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint16_t n,
+          uint8_t t);
+
+  // Whole strips (same color order; the shorter length is used)
+  static void
+    fade(Adafruit_DotStar &strip, uint8_t f),
+    scale(Adafruit_DotStar &strip, uint8_t r, uint8_t g, uint8_t b),
+    add(Adafruit_DotStar &dst, const Adafruit_DotStar &src),
+    average(Adafruit_DotStar &dst, const Adafruit_DotStar &src),
+    blend(Adafruit_DotStar &dst, const Adafruit_DotStar &a,
+          const Adafruit_DotStar &b, uint8_t t);
+
+ private:
+
+  static void
+    drop16(Adafruit_DotStar &strip, uint16_t n); // 16-bit pixels back to 8 bit
+
+};
+
+#endif // _DOTSTAR_KERNELS_H_
@@ -0,0 +1,270 @@
+/*------------------------------------------------------------------------
+  Keyframe interpolation for the DotStar library.
+  See dotstar_keyframes.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_keyframes.h"
+
+/* A transition of L frames runs from key 'from' to key 'to'.  Its pieces
+  end at frames L*j/P (see transitionPieces(); never more than L, so no
+  piece is empty).  At frame 0 and at every joint startPiece() sets each
+  changing pixel to from + (to - from) * ease(frame / L) exactly and works
+  out the step that reaches the next joint; the frames in between only
+  add it.  A step is 8.8 and rounded toward zero, so over a piece of up to
+  DOTSTAR_KEYFRAME_SPAN frames it falls behind by a quarter at most, and
+  the chords of DOTSTAR_KEYFRAME_PIECES pieces stay within 0.2 of the
+  curves.  As the curves only rise, an accumulator never passes the next
+  exact value either, so it can't leave 8.8 range.
+  The last frame of a transition is a joint, so every key is reached
+  exactly.  Pixels outside the 'active' list are never written after
+  key 0, so keys should only change while the engine is stopped or in
+  keys the running transition doesn't use.
+*/
+
+DotStarKeyframes::DotStarKeyframes(Adafruit_DotStar &s) : strip(s),
+  colors(NULL), keyCount(0), from(0), to(0), active(NULL), first(0),
+  count(0), changing(0), frame(0), piece(0), pieceEnd(0), looping(false),
+  started(false), done(true) {
+}
+
+DotStarKeyframes::~DotStarKeyframes(void) {
+  end();
+}
+
+// Keys start black, with cuts (0 frames) between them
+bool DotStarKeyframes::begin(uint8_t keys, uint16_t f, uint16_t c) {
+  end();
+  uint16_t leds = strip.numLEDs;
+  if((keys < 2) || (keys > DOTSTAR_KEYFRAMES) || (f >= leds)) return false;
+  if(!c || (c > leds - f)) c = leds - f;
+
+  colors = (uint8_t *)calloc((uint32_t)keys * c * 3, 1);
+  active = (Pixel *)malloc((uint32_t)c * sizeof(Pixel));
+  if(!colors || !active) {
+    end();
+    return false;
+  }
+  keyCount = keys;
+  first    = f;
+  count    = c;
+  for(uint8_t k=0; k<DOTSTAR_KEYFRAMES; k++) {
+    frames[k] = 0;
+    eases[k]  = DOTSTAR_EASE_LINEAR;
+  }
+  rewind();
+  return true;
+}
+
+void DotStarKeyframes::end(void) {
+  free(colors);
+  free(active);
+  colors   = NULL;
+  active   = NULL;
+  keyCount = 0;
+  count    = 0;
+  changing = 0;
+  done     = true;
+}
+
+void DotStarKeyframes::setKey(uint8_t k, const uint32_t *c) {
+  if(k >= keyCount) return;
+  for(uint16_t i=0; i<count; i++) setKeyPixel(k, i, c[i]);
+}
+
+void DotStarKeyframes::fillKey(uint8_t k, uint32_t c) {
+  if(k >= keyCount) return;
+  for(uint16_t i=0; i<count; i++) setKeyPixel(k, i, c);
+}
+
+void DotStarKeyframes::setKeyPixel(uint8_t k, uint16_t i, uint32_t c) {
+  if((k >= keyCount) || (i >= count)) return;
+  uint8_t *p = &colors[((uint32_t)k * count + i) * 3];
+  p[0] = c >> 16;
+  p[1] = c >> 8;
+  p[2] = c;
+}
+
+void DotStarKeyframes::captureKey(uint8_t k) {
+  if(k >= keyCount) return;
+  for(uint16_t i=0; i<count; i++) setKeyPixel(k, i, strip.getPixelColor(first + i));
+}
+
+void DotStarKeyframes::setTransition(uint8_t k, uint16_t f, DotStarEase e) {
+  if(k >= keyCount) return;
+  frames[k] = f;
+  eases[k]  = e;
+}
+
+void DotStarKeyframes::setLoop(bool on) {
+  looping = on;
+}
+
+void DotStarKeyframes::rewind(void) {
+  started  = false;
+  done     = !keyCount;
+  from     = to = 0;
+  frame    = 0;
+  changing = 0;
+}
+
+bool DotStarKeyframes::isDone(void) const {
+  return done;
+}
+
+uint8_t DotStarKeyframes::getKey(void) const {
+  return to;
+}
+
+uint16_t DotStarKeyframes::getFrame(void) const {
+  return frame;
+}
+
+uint16_t DotStarKeyframes::getActive(void) const {
+  return changing;
+}
+
+// Fixed-point easing, x and the result in 0-65536
+uint32_t DotStarKeyframes::ease(DotStarEase e, uint32_t x) {
+  if(x > 65536) x = 65536;
+  uint32_t sq = ((uint64_t)x * x) >> 16;
+  switch(e) {
+    case DOTSTAR_EASE_IN:     return sq;
+    case DOTSTAR_EASE_OUT:    x = 65536 - x;
+                              return 65536 - (uint32_t)(((uint64_t)x * x) >> 16);
+    case DOTSTAR_EASE_IN_OUT: return ((uint64_t)sq * (3 * 65536 - 2 * x)) >> 16;
+    default:                  return x;
+  }
+}
+
+static inline uint16_t transitionFrames(uint16_t f) {
+  return f ? f : 1;                         // a cut is one frame
+}
+
+// Enough pieces that chords follow the curve and steps don't drift
+static uint16_t transitionPieces(uint8_t e, uint16_t len) {
+  uint16_t pieces = (len + DOTSTAR_KEYFRAME_SPAN - 1) / DOTSTAR_KEYFRAME_SPAN;
+  if((e != DOTSTAR_EASE_LINEAR) && (pieces < DOTSTAR_KEYFRAME_PIECES))
+    pieces = DOTSTAR_KEYFRAME_PIECES;
+  return (pieces < len) ? pieces : len;
+}
+
+// Pixels that differ between the two keys, then the first piece
+void DotStarKeyframes::startTransition(void) {
+  const uint8_t *a = &colors[(uint32_t)from * count * 3],
+                *b = &colors[(uint32_t)to * count * 3];
+  changing = 0;
+  for(uint16_t i=0; i<count; i++, a += 3, b += 3) {
+    if((a[0] != b[0]) || (a[1] != b[1]) || (a[2] != b[2])) active[changing++].n = i;
+  }
+  frame = 0;
+  piece = 0;
+  startPiece();
+}
+
+void DotStarKeyframes::startPiece(void) {
+  DotStarEase e      = (DotStarEase)eases[to];
+  uint16_t    len    = transitionFrames(frames[to]),
+              pieces = transitionPieces(e, len);
+  int32_t     at     = ease(e, ((uint32_t)frame << 16) / len),
+              rise   = 0,                   // 0-65536 scale, over the piece
+              span   = 1;
+  if(piece < pieces) {
+    pieceEnd = (uint32_t)len * (piece + 1) / pieces;
+    rise     = (int32_t)ease(e, ((uint32_t)pieceEnd << 16) / len) - at;
+    span     = (pieceEnd - frame) * 256;
+  }
+
+  const uint8_t *a = &colors[(uint32_t)from * count * 3],
+                *b = &colors[(uint32_t)to * count * 3];
+  for(Pixel *px = active, *stop = active + changing; px < stop; px++) {
+    const uint8_t *pa = &a[px->n * 3], *pb = &b[px->n * 3];
+    for(uint8_t c=0; c<3; c++) {
+      int32_t d = pb[c] - pa[c];
+      px->acc[c]  = (pa[c] << 8) + 0x80 + (d * at) / 256;
+      px->step[c] = (d * rise) / span;
+    }
+  }
+}
+
+// The changing pixels into the strip, 16 bit when it dithers
+void DotStarKeyframes::writeActive(void) {
+  if(!changing) return;
+  uint8_t  *pixels = &strip.pixels[4 + ((uint32_t)first * 4)],
+            header = strip.pixelHeader,
+            rOff   = strip.rOffset,
+            gOff   = strip.gOffset,
+            bOff   = strip.bOffset;
+  uint16_t *wide   = strip.pixels16 ? &strip.pixels16[(uint32_t)first * 3] : NULL;
+  bool      track  = strip.powerLimit;
+
+  for(const Pixel *px = active, *stop = active + changing; px < stop; px++) {
+    uint8_t *p = &pixels[px->n * 4],
+             r = px->acc[0] >> 8,
+             g = px->acc[1] >> 8,
+             b = px->acc[2] >> 8;
+    if(track) strip.trackPower(p, r, g, b);
+    p[0]      = header;
+    p[rOff+1] = r;
+    p[gOff+1] = g;
+    p[bOff+1] = b;
+    if(wide) {
+      uint16_t *w = &wide[px->n * 3];
+      w[rOff] = px->acc[0] - 0x80;
+      w[gOff] = px->acc[1] - 0x80;
+      w[bOff] = px->acc[2] - 0x80;
+      p[0]    = 0x00;                       // 16-bit pixel
+    }
+  }
+  strip.markChanged(first + active[changing - 1].n);
+}
+
+void DotStarKeyframes::writeKey(uint8_t k) {
+  strip.setPixelsRGB(first, &colors[(uint32_t)k * count * 3], count);
+}
+
+// Key 0 first, then one frame of the running transition: an add per
+// channel of each changing pixel, or exact values at a joint
+bool DotStarKeyframes::step(void) {
+  if(done || !keyCount) return false;
+  if(!started) {
+    writeKey(0);
+    started = true;
+    from    = 0;
+    to      = 1;
+    startTransition();
+    return true;
+  }
+
+  frame++;
+  if(frame >= pieceEnd) {
+    piece++;
+    startPiece();
+  } else {
+    for(Pixel *px = active, *stop = active + changing; px < stop; px++) {
+      px->acc[0] += px->step[0];
+      px->acc[1] += px->step[1];
+      px->acc[2] += px->step[2];
+    }
+  }
+  writeActive();
+
+  if(frame >= transitionFrames(frames[to])) {
+    from = to;
+    if(++to < keyCount) startTransition();
+    else if(looping) {
+      to = 0;
+      startTransition();
+    } else {
+      to       = from;
+      changing = 0;
+      done     = true;
+    }
+  }
+  return true;
+}
+
+bool DotStarKeyframes::show(void) {
+  if(!step()) return false;
+  strip.show();
+  return true;
+}
@@ -0,0 +1,124 @@
+/*------------------------------------------------------------------------
+  Keyframe interpolation for the DotStar library.
+
+  Holds a few keyframes for the whole strip or one segment of it and
+  makes the frames between them as they are shown, in fixed point: when
+  a transition starts every pixel that differs between its two keys gets
+  a per-channel step, and each frame after that adds the step to an 8.8
+  accumulator and stores the top byte.  Pixels equal in both keys are
+  left out of the transition entirely, so a slow fade of part of a scene
+  costs only the pixels that fade.
+
+    DotStarKeyframes keys(strip);
+
+    keys.begin(3);                            // 3 keys over the whole strip
+    keys.fillKey(0, 0x000010);
+    keys.setKey(1, colors);                   // one packed color per LED
+    keys.fillKey(2, 0x200800);
+    keys.setTransition(1, 120, DOTSTAR_EASE_IN_OUT); // 120 frames from key 0 to 1
+    keys.setTransition(2, 300);               // linear, key 1 to 2
+    keys.setTransition(0, 60);                // key 2 back to 0 when looping
+    keys.setLoop(true);
+    void loop() { keys.show(); delay(20); }   // or step() from a scheduler
+
+  Transitions are cut into straight pieces (at least DOTSTAR_KEYFRAME_PIECES
+  for an eased curve, none longer than DOTSTAR_KEYFRAME_SPAN frames); at
+  each joint the pixels are set to the exact eased value and get the step
+  of the next piece, so the error never builds up past one piece and every
+  frame stays within one step of the exact curve.
+  The engine owns its pixels while it runs; one per segment of a strip
+  lets each segment run on its own and share one strip.show().  With
+  DOTSTAR_OUTPUT_DITHER the 8.8 values go out as 16-bit pixels.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_KEYFRAMES_H_
+#define _DOTSTAR_KEYFRAMES_H_
+
+#include "dotstar.h"
+
+#define DOTSTAR_KEYFRAMES       8             // Most keys an engine holds
+#define DOTSTAR_KEYFRAME_PIECES 32            // Straight pieces per eased transition, at least
+#define DOTSTAR_KEYFRAME_SPAN   64            // Longest piece, frames
+
+// Shape of a transition (fixed point, see ease())
+enum DotStarEase {
+  DOTSTAR_EASE_LINEAR = 0,
+  DOTSTAR_EASE_IN     = 1,                    // Slow start (quadratic)
+  DOTSTAR_EASE_OUT    = 2,                    // Slow end
+  DOTSTAR_EASE_IN_OUT = 3                     // Slow start and end (smoothstep)
+};
+
+class DotStarKeyframes {
+
+ public:
+
+  DotStarKeyframes(Adafruit_DotStar &strip);
+ ~DotStarKeyframes(void);
+
+  bool
+    begin(uint8_t keys, uint16_t first=0, uint16_t count=0), // 2+ keys, segment (0 = to end)
+    step(void),                               // Next frame into the strip, false when done
+    show(void),                               // step(), then strip.show() if it drew
+    isDone(void) const;                       // Last key reached (no loop)
+  void
+    end(void),
+    setKey(uint8_t k, const uint32_t *colors),// One packed color per segment pixel
+    fillKey(uint8_t k, uint32_t c),
+    setKeyPixel(uint8_t k, uint16_t i, uint32_t c),
+    captureKey(uint8_t k),                    // The segment as the strip holds it
+    setTransition(uint8_t k, uint16_t frames, DotStarEase ease=DOTSTAR_EASE_LINEAR), // Into key k
+    setLoop(bool on),                         // After the last key, on to key 0
+    rewind(void);                             // Key 0 at the next step()
+  uint8_t
+    getKey(void) const;                       // Key being approached (or shown)
+  uint16_t
+    getFrame(void) const,                     // Frames into the transition
+    getActive(void) const;                    // Pixels changing in it
+
+  static uint32_t
+    ease(DotStarEase e, uint32_t x);          // 0-65536 to 0-65536
+
+ private:
+
+  struct Pixel {
+    uint16_t
+      n;                                      // Segment pixel
+    uint16_t
+      acc[3];                                 // R, G, B, 8.8 (+0.5 for rounding)
+    int16_t
+      step[3];                                // Added each frame of the piece
+  };
+
+  void
+    startTransition(void),                    // Pixels that differ, first piece
+    startPiece(void),                         // Exact values, steps to the next joint
+    writeActive(void),                        // Accumulators into the strip
+    writeKey(uint8_t k);                      // Whole key into the strip
+
+  Adafruit_DotStar
+   &strip;
+  uint8_t
+   *colors,                                   // keys * count R,G,B
+    keyCount,
+    from,                                     // Keys of the transition
+    to;
+  Pixel
+   *active;                                   // count entries, 'changing' in use
+  uint16_t
+    first,
+    count,
+    changing,
+    frames[DOTSTAR_KEYFRAMES],                // Into each key
+    frame,                                    // Of the transition, 0 = at 'from'
+    piece,
+    pieceEnd;                                 // Frame the current piece ends at
+  uint8_t
+    eases[DOTSTAR_KEYFRAMES];
+  bool
+    looping,
+    started,                                  // Key 0 is in the strip
+    done;
+
+};
+
+#endif // _DOTSTAR_KEYFRAMES_H_
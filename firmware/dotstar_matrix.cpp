@@ -0,0 +1,215 @@
+/*------------------------------------------------------------------------
+  Matrix and segment mapping for the DotStar library.
+  See dotstar_matrix.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_matrix.h"
+
+/* MATRIX ------------------------------------------------------------------
+
+  table[y * viewWidth + x] holds the LED at logical (x, y).  It is built
+  from the wiring or the map each time the rotation or flip changes, so
+  setXY() is a bounds check, one table load and the frame store.  The
+  fills walk the table row by row, which reads it in order; the frame
+  stores follow the wiring.  LEDs past the end of the strip are left out
+  of the table.
+*/
+
+DotStarMatrix::DotStarMatrix(Adafruit_DotStar &s, uint16_t w, uint16_t h,
+  uint8_t l) : strip(s), map(NULL), panelWidth(w), panelHeight(h),
+  table(NULL), layout(l), rotation(0), flipX(false), flipY(false) {
+  buildTable();
+}
+
+DotStarMatrix::DotStarMatrix(Adafruit_DotStar &s, uint16_t w, uint16_t h,
+  const uint16_t *m) : strip(s), map(m), panelWidth(w), panelHeight(h),
+  table(NULL), layout(0), rotation(0), flipX(false), flipY(false) {
+  buildTable();
+}
+
+DotStarMatrix::~DotStarMatrix(void) {
+  free(table);
+}
+
+void DotStarMatrix::setRotation(uint8_t r) {
+  rotation = r & 3;
+  buildTable();
+}
+
+void DotStarMatrix::setFlip(bool x, bool y) {
+  flipX = x;
+  flipY = y;
+  buildTable();
+}
+
+uint16_t DotStarMatrix::width(void) const {
+  return viewWidth;
+}
+
+uint16_t DotStarMatrix::height(void) const {
+  return viewHeight;
+}
+
+bool DotStarMatrix::ok(void) const {
+  return table != NULL;
+}
+
+// LED at physical column px, row py (0,0 = top left seen from the front)
+uint16_t DotStarMatrix::wiredIndex(uint16_t px, uint16_t py) const {
+  if(map) return map[py * panelWidth + px];
+
+  if(layout & DOTSTAR_MATRIX_RIGHT)  px = panelWidth  - 1 - px;
+  if(layout & DOTSTAR_MATRIX_BOTTOM) py = panelHeight - 1 - py;
+
+  uint16_t major, minor, length;
+  if(layout & DOTSTAR_MATRIX_COLUMNS) {
+    major = px; minor = py; length = panelHeight;
+  } else {
+    major = py; minor = px; length = panelWidth;
+  }
+  if((layout & DOTSTAR_MATRIX_ZIGZAG) && (major & 1)) minor = length - 1 - minor;
+  return major * length + minor;
+}
+
+void DotStarMatrix::buildTable(void) {
+  bool turned = rotation & 1;
+  viewWidth   = turned ? panelHeight : panelWidth;
+  viewHeight  = turned ? panelWidth  : panelHeight;
+
+  if(!table && !(table = (uint16_t *)malloc((uint32_t)viewWidth * viewHeight * sizeof(uint16_t)))) {
+    viewWidth = viewHeight = 0;
+    return;
+  }
+
+  uint16_t *t = table;
+  for(uint16_t y=0; y<viewHeight; y++) {
+    for(uint16_t x=0; x<viewWidth; x++) {
+      uint16_t vx = flipX ? (viewWidth  - 1 - x) : x,
+               vy = flipY ? (viewHeight - 1 - y) : y,
+               px, py;
+      switch(rotation) {
+        default: px = vx;                   py = vy;                   break;
+        case 1:  px = panelWidth - 1 - vy;  py = vx;                   break;
+        case 2:  px = panelWidth - 1 - vx;  py = panelHeight - 1 - vy; break;
+        case 3:  px = vy;                   py = panelHeight - 1 - vx; break;
+      }
+      uint16_t i = wiredIndex(px, py);
+      *t++ = (i < strip.numLEDs) ? i : DOTSTAR_NO_LED;
+    }
+  }
+}
+
+uint16_t DotStarMatrix::index(uint16_t x, uint16_t y) const {
+  if(x >= viewWidth || y >= viewHeight) return DOTSTAR_NO_LED;
+  return table[y * viewWidth + x];
+}
+
+void DotStarMatrix::setXY(uint16_t x, uint16_t y, uint8_t r, uint8_t g,
+  uint8_t b) {
+  if(x >= viewWidth || y >= viewHeight) return;
+  uint16_t i = table[y * viewWidth + x];
+  if(i >= strip.numLEDs) return;            // no LED, or the strip was shortened
+
+  uint8_t *p = &strip.pixels[4 + (i * 4)];
+  if(strip.powerLimit) strip.trackPower(p, r, g, b);
+  p[0]               = strip.pixelHeader;
+  p[strip.rOffset+1] = r;
+  p[strip.gOffset+1] = g;
+  p[strip.bOffset+1] = b;
+  strip.markChanged(i);
+}
+
+uint32_t DotStarMatrix::getXY(uint16_t x, uint16_t y) const {
+  uint16_t i = index(x, y);
+  return strip.getPixelColor(i);            // 0 for DOTSTAR_NO_LED
+}
+
+void DotStarMatrix::fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+  uint32_t c) {
+  if(x >= viewWidth || y >= viewHeight) return;
+  if(w > viewWidth  - x) w = viewWidth  - x;
+  if(h > viewHeight - y) h = viewHeight - y;
+
+  uint32_t word   = strip.frameWord(c);
+  uint8_t *pixels = strip.pixels;
+  uint16_t leds   = strip.numLEDs,
+           last   = 0;
+  bool     any    = false,
+           track  = strip.powerLimit;
+
+  for(uint16_t row=0; row<h; row++) {
+    const uint16_t *t = &table[(y + row) * viewWidth + x];
+    for(uint16_t n=w; n--; ) {
+      uint16_t i = *t++;
+      if(i >= leds) continue;
+      if(track) strip.trackPower(&pixels[4 + (i * 4)], c >> 16, c >> 8, c);
+      memcpy(&pixels[4 + (i * 4)], &word, 4);
+      if(i >= last) last = i;
+      any = true;
+    }
+  }
+  if(any) strip.markChanged(last);
+}
+
+void DotStarMatrix::fillRow(uint16_t y, uint32_t c) {
+  fillRect(0, y, viewWidth, 1, c);
+}
+
+void DotStarMatrix::fillColumn(uint16_t x, uint32_t c) {
+  fillRect(x, 0, 1, viewHeight, c);
+}
+
+void DotStarMatrix::fill(uint32_t c) {
+  fillRect(0, 0, viewWidth, viewHeight, c);
+}
+
+/* SEGMENTS ----------------------------------------------------------------
+
+  A segment only stores where it starts, its length and direction; all
+  segments of a strip draw into the strip's one buffer and go out with its
+  show().
+*/
+
+DotStarSegment::DotStarSegment(Adafruit_DotStar &s, uint16_t f, uint16_t n,
+  const char *l, bool r) : strip(s), start(f), count(n), label(l),
+  reverse(r) {
+}
+
+void DotStarSegment::setPixelColor(uint16_t n, uint8_t r, uint8_t g,
+  uint8_t b) {
+  if(n >= count) return;
+  strip.setPixelColor(start + (reverse ? (count - 1 - n) : n), r, g, b);
+}
+
+void DotStarSegment::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c);
+}
+
+uint32_t DotStarSegment::getPixelColor(uint16_t n) const {
+  if(n >= count) return 0;
+  return strip.getPixelColor(start + (reverse ? (count - 1 - n) : n));
+}
+
+void DotStarSegment::fill(uint32_t c) {
+  if(count) strip.fill(c, start, count);
+}
+
+uint16_t DotStarSegment::numPixels(void) const {
+  return count;
+}
+
+uint16_t DotStarSegment::first(void) const {
+  return start;
+}
+
+const char *DotStarSegment::name(void) const {
+  return label;
+}
+
+DotStarSegment *DotStarSegment::find(DotStarSegment *list, uint8_t n,
+  const char *name) {
+  for(uint8_t i=0; i<n; i++) {
+    if(list[i].label && name && !strcmp(list[i].label, name)) return &list[i];
+  }
+  return NULL;
+}
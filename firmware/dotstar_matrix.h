@@ -0,0 +1,148 @@
+/*------------------------------------------------------------------------
+  Matrix and segment mapping for the DotStar library.
+
+  DotStarMatrix addresses a strip wired as a panel by (x, y).  The wiring
+  (corner of the first LED, rows or columns, progressive or zigzag) and
+  the view (rotation, flip) are folded into an index table once, so every
+  pixel write is one table load.  Any other wiring can be given as a map.
+
+    Adafruit_DotStar strip(16 * 16);
+    DotStarMatrix    matrix(strip, 16, 16,
+                       DOTSTAR_MATRIX_TOP + DOTSTAR_MATRIX_LEFT +
+                       DOTSTAR_MATRIX_ROWS + DOTSTAR_MATRIX_ZIGZAG);
+    matrix.setXY(3, 5, 0xFF0000);
+    matrix.fillRect(0, 0, 8, 4, 0x000020);
+
+  DotStarSegment is a named view of a run of LEDs on a strip, so several
+  fixtures sharing one strip (and one buffer) can be drawn separately.
+
+    DotStarSegment roof(strip, 0, 60, "roof"), door(strip, 60, 24, "door", true);
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_MATRIX_H_
+#define _DOTSTAR_MATRIX_H_
+
+#include "dotstar.h"
+
+// Matrix wiring (add one of each pair), as seen from the front:
+#define DOTSTAR_MATRIX_TOP         0x00     // First LED in the top row ...
+#define DOTSTAR_MATRIX_BOTTOM      0x01     // ... or the bottom row
+#define DOTSTAR_MATRIX_LEFT        0x00     // First LED in the left column ...
+#define DOTSTAR_MATRIX_RIGHT       0x02     // ... or the right column
+#define DOTSTAR_MATRIX_ROWS        0x00     // LEDs run along rows ...
+#define DOTSTAR_MATRIX_COLUMNS     0x04     // ... or along columns
+#define DOTSTAR_MATRIX_PROGRESSIVE 0x00     // Every line in the same direction ...
+#define DOTSTAR_MATRIX_ZIGZAG      0x08     // ... or alternating (serpentine)
+
+#define DOTSTAR_NO_LED 0xFFFF               // Map entry without an LED
+
+class DotStarMatrix {
+
+ public:
+
+  DotStarMatrix(Adafruit_DotStar &strip, uint16_t w, uint16_t h,
+                uint8_t layout=DOTSTAR_MATRIX_TOP + DOTSTAR_MATRIX_LEFT +
+                               DOTSTAR_MATRIX_ROWS + DOTSTAR_MATRIX_PROGRESSIVE);
+  // Any wiring: map[y * w + x] is the LED at (x, y) or DOTSTAR_NO_LED
+  DotStarMatrix(Adafruit_DotStar &strip, uint16_t w, uint16_t h,
+                const uint16_t *map);
+ ~DotStarMatrix(void);
+
+  void
+    setRotation(uint8_t r),                 // 0-3, quarter turns clockwise
+    setFlip(bool x, bool y),                // Mirror after rotation
+    setXY(uint16_t x, uint16_t y, uint32_t c),
+    setXY(uint16_t x, uint16_t y, uint8_t r, uint8_t g, uint8_t b),
+    fill(uint32_t c),
+    fillRow(uint16_t y, uint32_t c),
+    fillColumn(uint16_t x, uint32_t c),
+    fillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t c);
+  uint32_t
+    getXY(uint16_t x, uint16_t y) const;
+  uint16_t
+    width(void) const,                      // After rotation
+    height(void) const,
+    index(uint16_t x, uint16_t y) const;    // LED at (x, y) or DOTSTAR_NO_LED
+  bool
+    ok(void) const;                         // False if the table couldn't be allocated
+
+ private:
+
+  void
+    buildTable(void);
+  uint16_t
+    wiredIndex(uint16_t px, uint16_t py) const; // LED at physical (px, py)
+
+  Adafruit_DotStar
+   &strip;
+  const uint16_t
+   *map;                                    // Caller's map, or NULL for layout
+  uint16_t
+    panelWidth,                             // Physical size
+    panelHeight,
+    viewWidth,                              // Logical size (after rotation)
+    viewHeight,
+   *table;                                  // viewWidth * viewHeight LED indexes
+  uint8_t
+    layout,
+    rotation;
+  bool
+    flipX,
+    flipY;
+
+};
+
+class DotStarSegment {
+
+ public:
+
+  DotStarSegment(Adafruit_DotStar &strip, uint16_t first, uint16_t count,
+                 const char *name=NULL, bool reverse=false);
+
+  void
+    setPixelColor(uint16_t n, uint32_t c),
+    setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b),
+    fill(uint32_t c);
+  uint32_t
+    getPixelColor(uint16_t n) const;
+  uint16_t
+    numPixels(void) const,
+    first(void) const;
+  const char
+   *name(void) const;
+
+  // Segment called 'name' in list, or NULL
+  static DotStarSegment
+   *find(DotStarSegment *list, uint8_t n, const char *name);
+
+ private:
+
+  Adafruit_DotStar
+   &strip;
+  uint16_t
+    start,
+    count;
+  const char
+   *label;
+  bool
+    reverse;
+
+};
+
+// Inline so a drawing loop pays the bounds check, one table load and the
+// frame store per pixel
+inline void DotStarMatrix::setXY(uint16_t x, uint16_t y, uint32_t c) {
+  if(x >= viewWidth || y >= viewHeight) return;
+  uint16_t i = table[y * viewWidth + x];
+  if(i >= strip.numLEDs) return;            // no LED, or the strip was shortened
+
+  uint8_t *p = &strip.pixels[4 + (i * 4)];
+  if(strip.powerLimit) strip.trackPower(p, c >> 16, c >> 8, c);
+  p[0]               = strip.pixelHeader;
+  p[strip.rOffset+1] = (uint8_t)(c >> 16);
+  p[strip.gOffset+1] = (uint8_t)(c >>  8);
+  p[strip.bOffset+1] = (uint8_t)c;
+  strip.markChanged(i);
+}
+
+#endif // _DOTSTAR_MATRIX_H_
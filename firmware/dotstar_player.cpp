@@ -0,0 +1,279 @@
+/*------------------------------------------------------------------------
+  Recorded animation player for the DotStar library.
+  See dotstar_player.h for usage and the format.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_player.h"
+
+/* Bytes come through next(), which refills the chunk when it runs dry.
+  For a memory source the "chunk" is the whole animation, so nothing is
+  copied.  Ops are checked against the payload length and the LED count
+  before their bytes are read, so a damaged file stops the player instead
+  of writing past the frame.  Colors go straight into the strip's frame in
+  its color order with the brightness header; palette colors are kept as
+  ready-made frame words, so an indexed pixel is one 4-byte store.  LEDs
+  beyond the strip's length are decoded and dropped.
+*/
+
+DotStarPlayer::DotStarPlayer(Adafruit_DotStar &s) : strip(s), data(NULL),
+  cur(NULL), end(NULL), read(NULL), context(NULL), dataLength(0),
+  framesStart(0), frameCount(0), frameMicros(0), frame(0), lastShow(0),
+  remaining(0), palette(NULL), leds(0), paletteSize(0), paletteHeader(0),
+  looping(false), failed(true), eof(false), started(false) {
+}
+
+DotStarPlayer::~DotStarPlayer(void) {
+  free(palette);
+}
+
+bool DotStarPlayer::begin(const uint8_t *d, uint32_t len) {
+  data       = d;
+  dataLength = len;
+  read       = NULL;
+  cur        = d;
+  end        = d + len;
+  return readHeader();
+}
+
+bool DotStarPlayer::begin(DotStarRead r, void *c) {
+  data       = NULL;
+  dataLength = 0;
+  read       = r;
+  context    = c;
+  cur        = end = chunk;
+  return readHeader();
+}
+
+bool DotStarPlayer::fill(void) {
+  if(!read) return false;
+  int n = read(context, chunk, sizeof(chunk));
+  if(n <= 0) return false;
+  cur = chunk;
+  end = chunk + n;
+  return true;
+}
+
+inline uint8_t DotStarPlayer::next(void) {
+  if((cur == end) && !fill()) {
+    eof = true;
+    return 0;
+  }
+  return *cur++;
+}
+
+bool DotStarPlayer::readHeader(void) {
+  free(palette);
+  palette     = NULL;
+  paletteSize = 0;
+  frame       = 0;
+  failed      = true;
+  eof         = false;
+  started     = false;
+
+  uint8_t h[DOTSTAR_DSA_HEADER];
+  for(uint8_t i=0; i<sizeof(h); i++) h[i] = next();
+  if(eof || memcmp(h, "DSA1", 4)) return false;
+
+  leds        = h[4] | (h[5] << 8);
+  frameCount  = h[8]  | (h[9] << 8)  | ((uint32_t)h[10] << 16) | ((uint32_t)h[11] << 24);
+  frameMicros = h[12] | (h[13] << 8) | ((uint32_t)h[14] << 16) | ((uint32_t)h[15] << 24);
+  uint16_t colors = h[16] | (h[17] << 8);
+  if(!(h[6] & 1)) colors = 0;
+  if(colors > 256) return false;
+
+  if(colors) {
+    if(!(palette = (uint32_t *)malloc(colors * sizeof(uint32_t)))) return false;
+    for(uint16_t i=0; i<colors; i++) {
+      uint8_t r = next(), g = next(), b = next();
+      palette[i] = strip.frameWord(((uint32_t)r << 16) | ((uint16_t)g << 8) | b);
+    }
+    paletteSize   = colors;
+    paletteHeader = strip.pixelHeader;
+  }
+  if(eof) return false;
+
+  framesStart = data ? (cur - data) : 0;
+  failed      = false;
+  return true;
+}
+
+bool DotStarPlayer::decodeFrame(bool draw) {
+  uint8_t type = next();
+  remaining = next();
+  remaining |= (uint32_t)next() << 8;
+  remaining |= (uint32_t)next() << 16;
+  if(eof || ((type != DOTSTAR_DSA_KEY) && (type != DOTSTAR_DSA_DELTA))) return false;
+
+  if(!draw) {
+    // memory only: step over the payload
+    if(remaining > (uint32_t)(end - cur)) return false;
+    cur += remaining;
+    return true;
+  }
+
+  // brightness changed since the palette words were made?
+  uint8_t header = strip.pixelHeader;
+  if(palette && (header != paletteHeader)) {
+    for(uint16_t i=0; i<paletteSize; i++) memcpy(&palette[i], &header, 1);
+    paletteHeader = header;
+  }
+
+  uint8_t  *pixels = &strip.pixels[4],
+            rOff   = strip.rOffset + 1,
+            gOff   = strip.gOffset + 1,
+            bOff   = strip.bOffset + 1,
+            size   = palette ? 1 : 3;       // bytes per color
+  uint16_t  visible = strip.numLEDs;
+  uint32_t  pos = 0, top = 0;
+  bool      track = strip.powerLimit;       // keep the limiter's sums, no recount
+
+  while(remaining) {
+    uint8_t  op = next();
+    uint32_t n  = (op & 63) + 1,
+             bytes = (op < 0x40) ? 0 : (op < 0x80) ? size : n * size;
+    remaining--;
+    if((pos + n > leds) || (bytes > remaining)) return false;
+    remaining -= bytes;
+
+    if(op < 0x40) {                         // skip
+      pos += n;
+      continue;
+    }
+
+    if(op < 0x80) {                         // run
+      uint32_t word;
+      if(palette) {
+        uint8_t i = next();
+        if(i >= paletteSize) return false;
+        word = palette[i];
+      } else {
+        uint8_t r = next(), g = next(), b = next();
+        word = strip.frameWord(((uint32_t)r << 16) | ((uint16_t)g << 8) | b);
+      }
+      uint32_t stop = pos + n,
+               last = (stop < visible) ? stop : visible;
+      if(track && (last > pos)) strip.sumPower(pos, last - pos, false);
+      for(uint32_t k=pos; k<last; k++) memcpy(&pixels[k * 4], &word, 4);
+      if(track && (last > pos)) strip.sumPower(pos, last - pos, true);
+      pos = stop;
+    } else if(palette) {                    // literal, indexed
+      for(uint32_t k=0; k<n; k++, pos++) {
+        uint8_t i = next();
+        if(i >= paletteSize) return false;
+        if(pos < visible) {
+          if(track) strip.sumPower(pos, 1, false);
+          memcpy(&pixels[pos * 4], &palette[i], 4);
+          if(track) strip.sumPower(pos, 1, true);
+        }
+      }
+    } else {                                // literal, R,G,B
+      for(uint32_t k=0; k<n; k++, pos++) {
+        uint8_t r = next(), g = next(), b = next();
+        if(pos < visible) {
+          uint8_t *p = &pixels[pos * 4];
+          if(track) strip.trackPower(p, r, g, b);
+          p[0]    = header;
+          p[rOff] = r;
+          p[gOff] = g;
+          p[bOff] = b;
+        }
+      }
+    }
+    top = pos;
+    if(eof) return false;
+  }
+
+  if(top) strip.markChanged((top < visible ? top : visible) - 1);
+  return !eof;
+}
+
+bool DotStarPlayer::nextFrame(void) {
+  if(failed) return false;
+  if(frame >= frameCount) {
+    if(!looping || !rewind()) return false;
+  }
+  if(!decodeFrame(true)) {
+    failed = true;
+    return false;
+  }
+  frame++;
+  return true;
+}
+
+// Shows the next frame once the recorded frame time has passed since the
+// last one.  Falling behind by more than a frame restarts the timing
+// rather than rushing to catch up.
+bool DotStarPlayer::update(void) {
+  uint32_t now = micros();
+  if(started && ((now - lastShow) < frameMicros)) return false;
+  if(!nextFrame()) return false;
+  strip.show();
+  lastShow = (started && ((now - lastShow) < 2 * frameMicros)) ?
+    (lastShow + frameMicros) : now;
+  started  = true;
+  return true;
+}
+
+bool DotStarPlayer::rewind(void) {
+  if(!data) return false;
+  cur    = data + framesStart;
+  eof    = false;
+  frame  = 0;
+  return !failed;
+}
+
+// Decodes from the last key frame at or before 'f' up to f - 1, so the
+// next nextFrame() gives frame f
+bool DotStarPlayer::seek(uint32_t f) {
+  if(!rewind() || (f >= frameCount)) return false;
+
+  const uint8_t *key = cur;
+  uint32_t       keyFrame = 0;
+  for(uint32_t i=0; i<f; i++) {
+    if((cur < end) && (*cur == DOTSTAR_DSA_KEY)) {
+      key      = cur;
+      keyFrame = i;
+    }
+    if(!decodeFrame(false)) {
+      failed = true;
+      return false;
+    }
+  }
+  if((cur < end) && (*cur == DOTSTAR_DSA_KEY)) {
+    key      = cur;
+    keyFrame = f;
+  }
+
+  cur = key;
+  for(frame = keyFrame; frame < f; frame++) {
+    if(!decodeFrame(true)) {
+      failed = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DotStarPlayer::ok(void) const {
+  return !failed;
+}
+
+void DotStarPlayer::setLoop(bool on) {
+  looping = on;
+}
+
+uint16_t DotStarPlayer::numLEDs(void) const {
+  return leds;
+}
+
+uint32_t DotStarPlayer::getFrameCount(void) const {
+  return frameCount;
+}
+
+uint32_t DotStarPlayer::getFrame(void) const {
+  return frame;
+}
+
+uint32_t DotStarPlayer::getFrameMicros(void) const {
+  return frameMicros;
+}
@@ -0,0 +1,115 @@
+/*------------------------------------------------------------------------
+  Recorded animation player for the DotStar library.
+
+  Plays animations in the DotStar animation format (DSA, made by the host
+  encoder in host/dsa-encode) from flash, RAM or any byte source such as
+  an SD card file.  Frames are decoded a chunk at a time straight into the
+  strip's frame buffer; there is no intermediate frame.
+
+    DotStarPlayer player(strip);
+
+    player.begin(animation, sizeof(animation));   // const array in flash
+    player.setLoop(true);
+    void loop() { player.update(); }              // shows at the recorded rate
+
+  Format, little endian:
+    header   "DSA1", u16 LEDs, u16 flags (bit 0: palette), u32 frames,
+             u32 frame time in us, u16 palette colors (0-256), then
+             3 bytes R,G,B per palette color
+    frame    u8 type (1 = key, 2 = delta), u24 payload bytes, payload
+    payload  ops on a pixel cursor starting at LED 0; n = (op & 63) + 1
+               0x00-0x3F  skip n LEDs (delta frames: unchanged)
+               0x40-0x7F  run: one color for n LEDs
+               0x80-0xFF  literal: n colors
+             a color is R,G,B or, with a palette, one palette index.
+  Key frames cover every LED, so playback can start at any of them; delta
+  frames only the LEDs that changed since the frame before.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_PLAYER_H_
+#define _DOTSTAR_PLAYER_H_
+
+#include "dotstar.h"
+
+#define DOTSTAR_DSA_HEADER 18                 // Bytes before the palette
+#define DOTSTAR_DSA_KEY    1                  // Frame types
+#define DOTSTAR_DSA_DELTA  2
+
+#ifndef DOTSTAR_PLAYER_CHUNK
+  #define DOTSTAR_PLAYER_CHUNK 64             // Bytes read from a DotStarRead source at a time
+#endif
+
+// Byte source for streamed animations: up to len bytes into buf, return
+// the count, 0 at the end.  E.g. for an SdFat file:
+//   int readFile(void *f, uint8_t *buf, uint16_t len) { return ((File *)f)->read(buf, len); }
+typedef int (*DotStarRead)(void *context, uint8_t *buf, uint16_t len);
+
+class DotStarPlayer {
+
+ public:
+
+  DotStarPlayer(Adafruit_DotStar &strip);
+ ~DotStarPlayer(void);
+
+  bool
+    begin(const uint8_t *data, uint32_t len), // Whole animation in memory/flash
+    begin(DotStarRead read, void *context),   // Streamed (no rewind or seek)
+    nextFrame(void),                          // Decode the next frame, no show()
+    update(void),                             // nextFrame() and show() when due
+    rewind(void),                             // Back to frame 0 (memory only)
+    seek(uint32_t frame),                     // From the key frame before it (memory only)
+    ok(void) const;                           // False after malformed data
+  void
+    setLoop(bool on);                         // Restart at the end (memory only)
+  uint16_t
+    numLEDs(void) const;                      // LEDs in the animation
+  uint32_t
+    getFrameCount(void) const,
+    getFrame(void) const,                     // Frames decoded since frame 0
+    getFrameMicros(void) const;               // Recorded frame time
+
+ private:
+
+  bool
+    readHeader(void),
+    decodeFrame(bool draw),                   // draw = false: skip its payload
+    fill(void);                               // Refill the chunk
+  uint8_t
+    next(void);                               // Next byte of the animation
+
+  Adafruit_DotStar
+   &strip;
+  const uint8_t
+   *data,                                     // Memory source, or NULL
+   *cur,                                      // Unread bytes of the chunk ...
+   *end;                                      // ... and their end
+  DotStarRead
+    read;
+  void
+   *context;
+  uint32_t
+    dataLength,
+    framesStart,                              // Offset of frame 0 (memory source)
+    frameCount,
+    frameMicros,
+    frame,
+    lastShow,                                 // micros() of the last update() show
+    remaining;                                // Payload bytes left in this frame
+  uint32_t
+   *palette;                                  // Palette as frame words, or NULL
+  uint16_t
+    leds,
+    paletteSize;
+  uint8_t
+    paletteHeader;                            // Brightness header in the palette words
+  bool
+    looping,
+    failed,
+    eof,                                      // Source ran out mid-read
+    started;                                  // update() has shown a frame
+  uint8_t
+    chunk[DOTSTAR_PLAYER_CHUNK];
+
+};
+
+#endif // _DOTSTAR_PLAYER_H_
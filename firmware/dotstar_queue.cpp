@@ -0,0 +1,177 @@
+/*------------------------------------------------------------------------
+  Lock-free frame queue for the DotStar library.
+  See dotstar_queue.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_queue.h"
+
+#if DOTSTAR_STATS
+  #define STATS(_x) _x
+#else
+  #define STATS(_x)
+#endif
+
+#define USE_HW_SPI 255 // dataPin of hardware SPI strips (see dotstar.cpp)
+#define NONE       0xFF
+
+// Orders the frame and ring writes of one side before the index store the
+// other side reads (a DMB on the Cortex-M3/M4, a fence on the host)
+#define QUEUE_BARRIER() __sync_synchronize()
+
+/* Every frame is in exactly one place: the producer's hands ('drawing'),
+  the ready ring, the wire ('sending') or the recycle ring.  The producer
+  pops recycle and pushes ready; the output side pops ready and pushes
+  recycle.  The output side is loop() (poll()) and the DMA completion
+  interrupt, which poll() keeps out with interrupts off while it starts a
+  frame, so each ring has one writer per index.  A frame is only pushed
+  after everything written to it, and only reused after the pop that
+  took it, so neither side ever sees the other's half-written frame.
+*/
+
+void DotStarFrameQueue::Ring::push(uint8_t f) {
+  uint8_t h = head;
+  slot[h & (DOTSTAR_QUEUE_FRAMES - 1)] = f;
+  QUEUE_BARRIER();                          // frame and slot before head
+  head = h + 1;
+}
+
+bool DotStarFrameQueue::Ring::pop(uint8_t &f) {
+  uint8_t t = tail;
+  if(t == head) return false;
+  QUEUE_BARRIER();                          // head before slot and frame
+  f = slot[t & (DOTSTAR_QUEUE_FRAMES - 1)];
+  QUEUE_BARRIER();                          // slot read before it may be reused
+  tail = t + 1;
+  return true;
+}
+
+DotStarFrameQueue::DotStarFrameQueue(Adafruit_DotStar &s) : strip(s), count(0),
+  drawing(NONE), sending(NONE), published(0), sent(0), skipped(0) {
+  ready.head   = ready.tail   = 0;
+  recycle.head = recycle.tail = 0;
+}
+
+DotStarFrameQueue::~DotStarFrameQueue(void) {
+  end();
+}
+
+// Hooks the strip's DMA completion; the strip must have one frame buffer
+// and no output stage.  Every frame starts as a copy of the strip's, so
+// start and end frames are in place.
+bool DotStarFrameQueue::begin(uint8_t n) {
+  end();
+  if((n < 2) || (n > DOTSTAR_QUEUE_FRAMES) || !strip.pixels ||
+     (strip.bufferCount != 1) || (strip.outputMode != DOTSTAR_OUTPUT_DIRECT)) return false;
+  strip.waitForShow();
+
+  for(count=0; count<n; count++) {
+    if(!(frames[count] = (uint8_t *)malloc(strip.pixelArrayLength))) {
+      end();
+      return false;
+    }
+    memcpy(frames[count], strip.pixels, strip.pixelArrayLength);
+    recycle.push(count);
+  }
+  published = sent = skipped = 0;
+  strip.frameSentContext = this;
+  strip.frameSent        = frameDone;
+  return true;
+}
+
+void DotStarFrameQueue::end(void) {
+  if(!count) return;
+  strip.waitForShow();
+  strip.frameSent        = NULL;
+  strip.frameSentContext = NULL;
+  while(count) free(frames[--count]);
+  ready.head   = ready.tail   = 0;
+  recycle.head = recycle.tail = 0;
+  drawing = sending = NONE;
+}
+
+// The same frame until it is published
+uint8_t *DotStarFrameQueue::acquire(void) {
+  if(drawing == NONE) recycle.pop(drawing);
+  return (drawing == NONE) ? NULL : frames[drawing];
+}
+
+void DotStarFrameQueue::publish(void) {
+  if(drawing == NONE) return;
+  ready.push(drawing);
+  drawing = NONE;
+  published++;
+}
+
+void DotStarFrameQueue::setPixelColor(uint8_t *frame, uint16_t n, uint32_t c) const {
+  if(n >= strip.numLEDs) return;
+  uint32_t word = strip.frameWord(c);
+  memcpy(&frame[4 + n * 4], &word, 4);
+}
+
+void DotStarFrameQueue::fill(uint8_t *frame, uint32_t c) const {
+  uint32_t word = strip.frameWord(c);
+  uint8_t *p    = &frame[4];
+  for(uint16_t n=strip.numLEDs; n--; p += 4) memcpy(p, &word, 4);
+}
+
+// Take the newest published frame, recycling any older ones, and send it.
+// Soft SPI strips send it here and now.
+bool DotStarFrameQueue::sendNewest(void) {
+  uint8_t f, newest = NONE;
+  while(ready.pop(f)) {
+    if(newest != NONE) {
+      recycle.push(newest);
+      skipped++;
+    }
+    newest = f;
+  }
+  if(newest == NONE) return false;
+  sent++;
+
+  if(strip.dataPin != USE_HW_SPI) {
+    STATS(strip.statsSubmit(0));
+    STATS(strip.spiStartTime = micros());
+    strip.sw_spi_write(frames[newest], strip.pixelArrayLength);
+    STATS(strip.statsDone(0));
+    recycle.push(newest);
+    return true;
+  }
+  sending = newest;                         // before the transfer: it may complete at once
+  STATS(strip.statsSubmit(0));
+  strip.hw_spi_transfer(frames[newest], strip.numLEDs);
+  return true;
+}
+
+// From the DMA completion interrupt: recycle the frame just sent, start
+// the next if there is one
+void DotStarFrameQueue::frameDone(void *q) {
+  DotStarFrameQueue *queue = (DotStarFrameQueue *)q;
+  if(queue->sending == NONE) return;        // not one of ours
+
+  queue->recycle.push(queue->sending);
+  queue->sending = NONE;
+  if(!Adafruit_DotStar::busOwner[queue->strip.use_spi_1]) queue->sendNewest();
+}
+
+bool DotStarFrameQueue::poll(void) {
+  if(!count) return false;
+  if(strip.dataPin != USE_HW_SPI) return sendNewest();
+
+  bool started = false;
+  __disable_irq();
+  if((sending == NONE) && !Adafruit_DotStar::busOwner[strip.use_spi_1]) started = sendNewest();
+  __enable_irq();
+  return started;
+}
+
+uint32_t DotStarFrameQueue::getPublished(void) const {
+  return published;
+}
+
+uint32_t DotStarFrameQueue::getSent(void) const {
+  return sent;
+}
+
+uint32_t DotStarFrameQueue::getSkipped(void) const {
+  return skipped;
+}
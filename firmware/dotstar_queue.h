@@ -0,0 +1,104 @@
+/*------------------------------------------------------------------------
+  Lock-free frame queue for the DotStar library.
+
+  Lets one thread draw frames while another sends them, e.g. a network or
+  render thread under SYSTEM_THREAD(ENABLED) and loop().  The queue owns
+  a few preallocated frames.  The producer acquires a free one, draws into
+  it (getPixels() layout: LED n at byte 4 + 4n) and publishes it; the
+  output side sends the newest published frame and hands every older
+  one, and each frame once it is sent, back to the producer.  Nobody
+  draws into a frame DMA is reading, nobody blocks, and no lock is taken:
+  the two sides only meet in two single-producer/single-consumer rings of
+  frame numbers.
+
+    DotStarFrameQueue queue(strip);
+
+    queue.begin(3);                         // in setup(), after strip.begin()
+
+    // producer thread
+    uint8_t *frame = queue.acquire();       // NULL: all frames busy, try later
+    if(frame) {
+      queue.fill(frame, 0x000010);
+      queue.setPixelColor(frame, 5, 0xFF0000);
+      queue.publish();
+    }
+
+    // loop()
+    queue.poll();                           // starts the bus when it is idle
+
+  After the first frame the DMA completion callback starts each next one,
+  so poll() only matters when the producer has fallen behind.  The strip
+  itself is not drawn into or shown while the queue feeds it; it needs one
+  frame buffer and no output stage.  One producer thread and one output
+  side (loop() plus the DMA interrupt) per queue.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_QUEUE_H_
+#define _DOTSTAR_QUEUE_H_
+
+#include "dotstar.h"
+
+#define DOTSTAR_QUEUE_FRAMES 8                // Most frames a queue holds (power of 2)
+
+class DotStarFrameQueue {
+
+ public:
+
+  DotStarFrameQueue(Adafruit_DotStar &strip);
+ ~DotStarFrameQueue(void);
+
+  bool
+    begin(uint8_t frames=3),                  // 2-8 frames, copies of the strip's frame
+    poll(void);                               // Output side: send the newest frame if idle
+  void
+    end(void),
+    publish(void),                            // Producer: hand the acquired frame over
+    setPixelColor(uint8_t *frame, uint16_t n, uint32_t c) const,
+    fill(uint8_t *frame, uint32_t c) const;
+  uint8_t
+   *acquire(void);                            // Producer: a free frame, NULL if none
+  uint32_t
+    getPublished(void) const,
+    getSent(void) const,                      // Frames put on the wire
+    getSkipped(void) const;                   // Published frames replaced before being sent
+
+ private:
+
+  // Frame numbers from one side to the other; head is only written by the
+  // pushing side, tail only by the popping side
+  struct Ring {
+    volatile uint8_t
+      head,
+      tail;
+    uint8_t
+      slot[DOTSTAR_QUEUE_FRAMES];
+    void
+      push(uint8_t f);                        // Never full: there are only as many frames
+    bool
+      pop(uint8_t &f);
+  };
+
+  bool
+    sendNewest(void);                         // Output side
+  static void
+    frameDone(void *queue);                   // Strip's frameSent hook
+
+  Adafruit_DotStar
+   &strip;
+  uint8_t
+   *frames[DOTSTAR_QUEUE_FRAMES],
+    count,
+    drawing;                                  // Producer's frame, or NONE
+  volatile uint8_t
+    sending;                                  // Frame on the wire, or NONE
+  Ring
+    ready,                                    // Published, producer -> output
+    recycle;                                  // Free, output -> producer
+  volatile uint32_t
+    published,
+    sent,
+    skipped;
+
+};
+
+#endif // _DOTSTAR_QUEUE_H_
@@ -0,0 +1,253 @@
+/*------------------------------------------------------------------------
+  Network pixel stream receiver for the DotStar library.
+  See dotstar_receiver.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_receiver.h"
+
+/* Every protocol carries R,G,B byte triplets addressed by channel (byte)
+  number.  writeChannels() puts them into the frame in the strip's color
+  order and stamps the brightness header, one pass and no 32-bit colors in
+  between; channels past the strip end are ignored.  The frame pointer is
+  fetched per packet because show() swaps buffers when the strip has more
+  than one.
+*/
+
+DotStarReceiver::DotStarReceiver(Adafruit_DotStar &s) : strip(s),
+  protocol(DOTSTAR_DDP), opcChannel(0), opcHeaderFill(0), opcRemaining(0),
+  firstUniverse(1), universePixels(170), opcOffset(0), packets(0), frames(0),
+  errors(0), server(NULL) {
+}
+
+bool DotStarReceiver::begin(DotStarProtocol p, uint16_t port) {
+  stop();
+  protocol = p;
+  switch(p) {
+    case DOTSTAR_DDP:
+      return udp.begin(port ? port : DOTSTAR_DDP_PORT);
+    case DOTSTAR_E131:
+      return udp.begin(port ? port : DOTSTAR_E131_PORT);
+    case DOTSTAR_OPC:
+      server = new TCPServer(port ? port : DOTSTAR_OPC_PORT);
+      return server && server->begin();
+  }
+  return false;
+}
+
+void DotStarReceiver::stop(void) {
+  udp.stop();
+  client.stop();
+  if(server) {
+    server->stop();
+    delete server;
+    server = NULL;
+  }
+  opcHeaderFill = 0;
+  opcRemaining  = 0;
+}
+
+void DotStarReceiver::setUniverse(uint16_t first, uint16_t pixels) {
+  firstUniverse  = first;
+  universePixels = (pixels && pixels <= 170) ? pixels : 170;
+}
+
+void DotStarReceiver::setOpcChannel(uint8_t channel) {
+  opcChannel = channel;
+}
+
+uint32_t DotStarReceiver::getPackets(void) const {
+  return packets;
+}
+
+uint32_t DotStarReceiver::getFrames(void) const {
+  return frames;
+}
+
+uint32_t DotStarReceiver::getErrors(void) const {
+  return errors;
+}
+
+uint16_t DotStarReceiver::poll(void) {
+  uint16_t shown = 0;
+
+  if(protocol == DOTSTAR_OPC) {
+    if(!server) return 0;
+    if(!client.connected()) {
+      client = server->available();
+      opcHeaderFill = 0;                    // a new connection starts a new message
+      opcRemaining  = 0;
+    }
+    int n;
+    while(client.available() > 0 && (n = client.read(packet, sizeof(packet))) > 0)
+      shown += handleStream(packet, n);
+    return shown;
+  }
+
+  int n;
+  while((n = udp.receivePacket(packet, sizeof(packet))) > 0)
+    shown += handlePacket(packet, n);
+  return shown;
+}
+
+bool DotStarReceiver::handlePacket(const uint8_t *buf, uint16_t len) {
+  return (protocol == DOTSTAR_E131) ? handleE131(buf, len) : handleDDP(buf, len);
+}
+
+void DotStarReceiver::showFrame(void) {
+  strip.show();
+  frames++;
+}
+
+void DotStarReceiver::writeChannels(uint32_t first, const uint8_t *src,
+  uint16_t count) {
+  uint32_t channels = (uint32_t)strip.numLEDs * 3;
+  if(first >= channels || !count) return;
+  if(count > channels - first) count = channels - first;
+
+  uint8_t  *pixels = strip.getPixels(),
+            header = strip.pixelHeader,
+            offset[3] = { (uint8_t)(strip.rOffset + 1),
+                          (uint8_t)(strip.gOffset + 1),
+                          (uint8_t)(strip.bOffset + 1) };
+  uint32_t  c   = first,
+            end = first + count;
+  uint8_t  *p   = &pixels[4 + (c / 3) * 4];
+  uint16_t  lo  = first / 3,                // LEDs the packet touches
+            n   = (end - 1) / 3 - lo + 1;
+  bool      track = strip.powerLimit;
+  if(track) strip.sumPower(lo, n, false);   // counted out, and back in below
+
+  // a packet may start or end in the middle of a pixel
+  for(; (c % 3) && (c < end); c++) {
+    p[0] = header;
+    p[offset[c % 3]] = *src++;
+  }
+  p = &pixels[4 + (c / 3) * 4];
+  for(; end - c >= 3; c += 3) {
+    p[0]         = header;
+    p[offset[0]] = src[0];
+    p[offset[1]] = src[1];
+    p[offset[2]] = src[2];
+    p   += 4;
+    src += 3;
+  }
+  for(; c < end; c++) {
+    p[0] = header;
+    p[offset[c % 3]] = *src++;
+  }
+
+  if(track) strip.sumPower(lo, n, true);
+  strip.markChanged((end - 1) / 3);
+}
+
+/* DDP (www.3waylabs.com/ddp): 10 byte header, 14 with a timecode.
+    0     flags: version (bits 7-6 = 01), timecode 0x10, push 0x01
+    1     sequence
+    2     data type
+    3     destination id (1 = default output)
+    4-7   byte offset of the data, big endian
+    8-9   data length, big endian
+  A frame may span several packets; the one with the push flag completes it.
+*/
+bool DotStarReceiver::handleDDP(const uint8_t *buf, uint16_t len) {
+  if(len < 10 || (buf[0] & 0xC0) != 0x40 || buf[3] > 1) {
+    errors++;
+    return false;
+  }
+  uint16_t hdr    = (buf[0] & 0x10) ? 14 : 10,
+           length = (buf[8] << 8) | buf[9];
+  uint32_t offset = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) |
+                    ((uint32_t)buf[6] << 8)  | buf[7];
+  if(len < hdr + length) {
+    errors++;
+    return false;
+  }
+  packets++;
+  writeChannels(offset, buf + hdr, length);
+
+  if(!(buf[0] & 0x01)) return false;
+  showFrame();
+  return true;
+}
+
+/* E1.31 data packet (ANSI E1.31-2016), fixed offsets:
+    4-15    ACN packet identifier "ASC-E1.17"
+    18-21   root vector 0x00000004 (data)
+    40-43   framing vector 0x00000002 (DMP)
+    112     options: preview 0x80, stream terminated 0x40
+    113-114 universe
+    117     DMP vector 0x02, 118 address type 0xA1
+    123-124 property value count (start code + channels)
+    125     DMX start code (0), 126... channels
+  Each universe holds universePixels (170) pixels; the strip's last
+  universe completes the frame, so a lost earlier one doesn't stall it.
+*/
+bool DotStarReceiver::handleE131(const uint8_t *buf, uint16_t len) {
+  static const uint8_t acnId[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+  if(len < 126 || memcmp(&buf[4], acnId, sizeof(acnId)) ||
+     buf[21] != 0x04 || buf[43] != 0x02 || buf[117] != 0x02 || buf[125] != 0) {
+    errors++;
+    return false;
+  }
+  uint16_t universe = (buf[113] << 8) | buf[114],
+           count    = ((buf[123] << 8) | buf[124]) - 1,
+           last     = firstUniverse + (strip.numLEDs ? (strip.numLEDs - 1) / universePixels : 0);
+  if((buf[112] & 0xC0) || universe < firstUniverse || universe > last ||
+     count > 512 || len < 126 + count) {
+    errors++;
+    return false;
+  }
+  packets++;
+  if(count > universePixels * 3) count = universePixels * 3;
+  writeChannels((uint32_t)(universe - firstUniverse) * universePixels * 3,
+                buf + 126, count);
+
+  if(universe != last) return false;
+  showFrame();
+  return true;
+}
+
+/* OPC (openpixelcontrol.org) over TCP: messages of channel, command and a
+  16-bit big endian length followed by that many bytes.  Command 0 sets
+  pixels from R,G,B triplets and is one frame.  The stream may be split
+  anywhere, so the header is collected across calls and payload bytes are
+  written as they come.
+*/
+uint16_t DotStarReceiver::handleStream(const uint8_t *buf, uint16_t len) {
+  uint16_t shown = 0;
+
+  while(len) {
+    if(opcHeaderFill < 4) {
+      opcHeader[opcHeaderFill++] = *buf++;
+      len--;
+      if(opcHeaderFill == 4) {
+        opcRemaining = (opcHeader[2] << 8) | opcHeader[3];
+        opcOffset    = 0;
+      } else continue;
+    } else {
+      uint16_t n = (len < opcRemaining) ? len : opcRemaining;
+      if(opcForUs()) writeChannels(opcOffset, buf, n);
+      opcOffset    += n;
+      opcRemaining -= n;
+      buf          += n;
+      len          -= n;
+    }
+
+    if(!opcRemaining) {                     // message complete
+      opcHeaderFill = 0;
+      if(opcForUs()) {
+        packets++;
+        showFrame();
+        shown++;
+      } else errors++;
+    }
+  }
+  return shown;
+}
+
+// Set-pixels message on our channel (or broadcast on channel 0)?
+bool DotStarReceiver::opcForUs(void) const {
+  return !opcHeader[1] &&
+         (!opcChannel || !opcHeader[0] || (opcHeader[0] == opcChannel));
+}
@@ -0,0 +1,94 @@
+/*------------------------------------------------------------------------
+  Network pixel stream receiver for the DotStar library.
+
+  Decodes DDP, Open Pixel Control and E1.31 (sACN) and writes the RGB
+  channels straight into a strip's 4-byte-per-LED frame in its color
+  order; when a frame is complete it calls the strip's show().
+
+    Adafruit_DotStar strip(170 * 4);
+    DotStarReceiver  rx(strip);
+
+    void setup() {
+      strip.begin();
+      rx.begin(DOTSTAR_DDP);               // UDP port 4048
+    }
+    void loop() {
+      rx.poll();
+    }
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_RECEIVER_H_
+#define _DOTSTAR_RECEIVER_H_
+
+#include "dotstar.h"
+
+enum DotStarProtocol {
+  DOTSTAR_DDP  = 0,                         // UDP 4048, frame shown on the push flag
+  DOTSTAR_OPC  = 1,                         // TCP 7890, each set-pixels message is a frame
+  DOTSTAR_E131 = 2                          // UDP 5568, shown when the last universe arrives
+};
+
+#define DOTSTAR_DDP_PORT  4048
+#define DOTSTAR_OPC_PORT  7890
+#define DOTSTAR_E131_PORT 5568
+
+#define DOTSTAR_RECEIVER_PACKET 1472        // Largest UDP payload read (Ethernet MTU)
+
+class DotStarReceiver {
+
+ public:
+
+  DotStarReceiver(Adafruit_DotStar &strip);
+  bool
+    begin(DotStarProtocol p, uint16_t port=0), // 0 = the protocol's port
+    handlePacket(const uint8_t *buf, uint16_t len); // One DDP/E1.31 datagram, true if shown
+  void
+    stop(void),
+    setUniverse(uint16_t first, uint16_t pixels=170), // E1.31 universes of the strip
+    setOpcChannel(uint8_t channel);         // OPC channel to accept, 0 = all
+  uint16_t
+    poll(void),                             // Read what arrived, return frames shown
+    handleStream(const uint8_t *buf, uint16_t len); // OPC bytes, return frames shown
+  uint32_t
+    getPackets(void) const,                 // Packets (OPC: messages) decoded
+    getFrames(void) const,                  // Frames shown
+    getErrors(void) const;                  // Packets ignored as malformed or not ours
+
+ private:
+
+  bool
+    handleDDP(const uint8_t *buf, uint16_t len),
+    handleE131(const uint8_t *buf, uint16_t len),
+    opcForUs(void) const;
+  void
+    writeChannels(uint32_t first, const uint8_t *src, uint16_t count),
+    showFrame(void);
+
+  Adafruit_DotStar
+   &strip;
+  uint8_t
+    protocol,
+    opcChannel,
+    opcHeader[4],                           // OPC message header being read
+    opcHeaderFill;                          // Bytes of it read so far
+  uint16_t
+    opcRemaining,                           // Payload bytes left in the message
+    firstUniverse,
+    universePixels;
+  uint32_t
+    opcOffset,                              // Channel the next payload byte goes to
+    packets,
+    frames,
+    errors;
+  UDP
+    udp;
+  TCPServer
+   *server;
+  TCPClient
+    client;
+  uint8_t
+    packet[DOTSTAR_RECEIVER_PACKET];
+
+};
+
+#endif // _DOTSTAR_RECEIVER_H_
@@ -0,0 +1,127 @@
+/*------------------------------------------------------------------------
+  Fixed-rate frame scheduler for the DotStar library.
+  See dotstar_scheduler.h for usage.
+  ------------------------------------------------------------------------*/
+
+#include "dotstar_scheduler.h"
+
+/* tick() and poll() split the work so the part that may run from a timer
+  is short: tick() only compares micros() with the next deadline and, if a
+  frame is ready and the bus is idle, marks it due.  show() itself runs in
+  poll(), from loop(): with two or more buffers it copies the whole frame
+  into the next back buffer (32 KB at 8192 LEDs), which is too long for a
+  timer callback.  Rendering happens in poll() as well.  'ready' and 'due'
+  hand a frame from one to the other; neither touches the buffers while
+  the other owns them.  A frame finished after its deadline waits for the
+  next one rather than going out late, so the pacing stays steady even
+  when nobody ticks during a long render; a due frame goes out at the
+  first poll() after its tick.  Deadlines are computed from frame numbers,
+  not by adding a rounded period, so 60 fps doesn't drift.
+*/
+
+DotStarScheduler::DotStarScheduler(Adafruit_DotStar &s) : strip(s),
+  render(NULL), fps(0), timerTick(false), running(false), ready(false),
+  due(false), startTime(0), readyTime(0), dueTime(0), frame(0), frames(0), misses(0), wireMisses(0),
+  maxLateness(0) {
+}
+
+// Frame 0 is due one period from now, so it can be rendered in time.
+// Two frame buffers let rendering overlap the transfer; a strip with one
+// gets a second here.
+bool DotStarScheduler::begin(uint16_t f, DotStarRender r, bool t) {
+  if(!f || !r) return false;
+  stop();
+  if((strip.getBufferCount() < 2) && !strip.setBufferCount(2)) return false;
+
+  fps       = f;
+  render    = r;
+  timerTick = t;
+  frame     = 0;
+  ready     = false;
+  due       = false;
+  resetCounters();
+  startTime = micros() + 1000000UL / fps;
+  running   = true;
+  return true;
+}
+
+void DotStarScheduler::stop(void) {
+  running = false;
+}
+
+void DotStarScheduler::resetCounters(void) {
+  frames      = 0;
+  misses      = 0;
+  wireMisses  = 0;
+  maxLateness = 0;
+}
+
+uint32_t DotStarScheduler::deadline(uint32_t n) const {
+  return startTime + (uint32_t)((uint64_t)n * 1000000UL / fps);
+}
+
+void DotStarScheduler::tick(void) {
+  if(!running) return;
+
+  uint32_t now = micros();
+  if((int32_t)(now - deadline(frame)) < 0) return;
+
+  if(due || !ready || ((int32_t)(readyTime - deadline(frame)) > 0)) {
+    misses++;                               // render didn't finish in time (or poll() hasn't shown it)
+  } else if(strip.isShowing()) {
+    misses++;                               // last frame still on the wire
+    wireMisses++;
+  } else {
+    dueTime = deadline(frame);
+    due     = true;                         // poll() shows it
+  }
+
+  // deadlines that passed while nobody ticked are missed as well
+  while((int32_t)(now - deadline(++frame)) >= 0) misses++;
+}
+
+// 'ready' is cleared first, so a tick() in between can't mark the same
+// frame due again
+void DotStarScheduler::showDue(void) {
+  uint32_t late = micros() - dueTime;
+  strip.show();
+  ready = false;
+  due   = false;
+  frames++;
+  if(late > maxLateness) maxLateness = late;
+}
+
+void DotStarScheduler::poll(void) {
+  if(!running) return;
+  if(!timerTick) tick();
+  if(due) showDue();
+
+  // with one buffer the frame on the wire is the one we'd draw into
+  if(!ready && ((strip.getBufferCount() > 1) || !strip.isShowing())) {
+    render(strip, frame);
+    readyTime = micros();
+    ready     = true;
+    if(!timerTick) tick();                  // rendering may have run to the deadline
+    if(due) showDue();
+  }
+}
+
+uint16_t DotStarScheduler::getFPS(void) const {
+  return fps;
+}
+
+uint32_t DotStarScheduler::getFrames(void) const {
+  return frames;
+}
+
+uint32_t DotStarScheduler::getMisses(void) const {
+  return misses;
+}
+
+uint32_t DotStarScheduler::getWireMisses(void) const {
+  return wireMisses;
+}
+
+uint32_t DotStarScheduler::getMaxLateness(void) const {
+  return maxLateness;
+}
@@ -0,0 +1,93 @@
+/*------------------------------------------------------------------------
+  Fixed-rate frame scheduler for the DotStar library.
+
+  Shows a strip at a steady frame rate instead of whenever loop() gets to
+  show().  Frames go out on deadlines spaced 1/fps apart; the render
+  callback draws the next frame as soon as there is a buffer to draw into,
+  which with two frame buffers is right after the previous show(), so
+  drawing frame N+1 overlaps sending frame N.  A deadline that finds no
+  finished frame, or the previous one still on the wire, is counted as a
+  miss and the LEDs keep the last frame.  tick() only marks a frame due;
+  poll() shows it, so the frame copy show() makes stays out of the timer.
+
+    void render(Adafruit_DotStar &strip, uint32_t frame) { ... }
+
+    DotStarScheduler scheduler(strip);
+    Timer            ticker(1, [] { scheduler.tick(); });
+
+    void setup() {
+      strip.begin();
+      scheduler.begin(100, render, true);  // 100 fps, tick() from the timer
+      ticker.start();
+    }
+    void loop() {
+      scheduler.poll();                    // shows due frames, renders when a buffer is free
+    }
+
+  Without a timer, poll() calls tick() itself and the frames go out at the
+  first poll() after each deadline.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_SCHEDULER_H_
+#define _DOTSTAR_SCHEDULER_H_
+
+#include "dotstar.h"
+
+// Draws the frame to be shown at deadline 'frame' (frame / fps seconds
+// after begin()) into the strip
+typedef void (*DotStarRender)(Adafruit_DotStar &strip, uint32_t frame);
+
+class DotStarScheduler {
+
+ public:
+
+  DotStarScheduler(Adafruit_DotStar &strip);
+
+  bool
+    begin(uint16_t fps, DotStarRender render, bool timerTick=false);
+  void
+    stop(void),
+    poll(void),                             // Call from loop(): shows, renders, ticks without a timer
+    tick(void),                             // Marks the frame due; timer/interrupt safe
+    resetCounters(void);
+  uint16_t
+    getFPS(void) const;
+  uint32_t
+    getFrames(void) const,                  // Frames shown
+    getMisses(void) const,                  // Deadlines that showed nothing
+    getWireMisses(void) const,              // ... of them because the bus was still busy
+    getMaxLateness(void) const;             // Longest show() after its deadline, us
+
+ private:
+
+  uint32_t
+    deadline(uint32_t frame) const;         // micros() frame is due at
+  void
+    showDue(void);                          // From poll(): show() the due frame
+
+  Adafruit_DotStar
+   &strip;
+  DotStarRender
+    render;
+  uint16_t
+    fps;
+  bool
+    timerTick;
+  volatile bool
+    running,
+    ready,                                  // A rendered frame waits for its deadline
+    due;                                    // ... which has passed: poll() shows it
+  uint32_t
+    startTime;                              // micros() of frame 0
+  volatile uint32_t
+    readyTime,                              // micros() the ready frame was finished
+    dueTime,                                // Deadline of the due frame
+    frame,                                  // Next deadline to serve
+    frames,
+    misses,
+    wireMisses,
+    maxLateness;
+
+};
+
+#endif // _DOTSTAR_SCHEDULER_H_
@@ -0,0 +1,36 @@
+#include "application.h"
+#include "dotstar/dotstar.h"
+#include "dotstar/dotstar_keyframes.h"
+
+// A slow ambient scene: night blue, a warm sunrise that starts at one end,
+// daylight, and back.  The engine makes every frame in between; only the
+// pixels that differ between two keys cost anything.
+
+#define NUM_LEDS 300
+
+Adafruit_DotStar strip = Adafruit_DotStar(NUM_LEDS, DOTSTAR_BGR);
+DotStarKeyframes scene(strip);
+
+void setup() {
+  strip.begin(); // Initialize pins for output
+  strip.show();  // Turn all LEDs off ASAP
+  strip.setPartialShow(true);
+
+  scene.begin(3);
+  scene.fillKey(0, 0x000008);                   // night
+  scene.fillKey(1, 0x000008);
+  for(uint16_t i=0; i<NUM_LEDS / 3; i++)        // sunrise at the first third
+    scene.setKeyPixel(1, i, strip.Color(255 - i * 2, 64 - i / 2, 8));
+  scene.fillKey(2, 0x806040);                   // day
+  scene.setTransition(1, 1500, DOTSTAR_EASE_IN);      // 30 s at 50 fps
+  scene.setTransition(2, 3000, DOTSTAR_EASE_IN_OUT);  // 60 s
+  scene.setTransition(0, 3000, DOTSTAR_EASE_OUT);     // and back to night
+  scene.setLoop(true);
+}
+
+void loop() {
+  static uint32_t last = 0;
+  if(millis() - last < 20) return;
+  last = millis();
+  scene.show();
+}
@@ -0,0 +1,29 @@
+#include "application.h"
+#include "dotstar/dotstar.h"
+#include "dotstar/dotstar_receiver.h"
+
+// Shows frames sent by a media server (xLights, Resolume, LedFx ...) as DDP
+// on UDP port 4048.  Use DOTSTAR_E131 or DOTSTAR_OPC for the other protocols.
+
+#define NUM_LEDS 512
+
+Adafruit_DotStar strip = Adafruit_DotStar(NUM_LEDS, DOTSTAR_BGR);
+DotStarReceiver  receiver(strip);
+
+void setup() {
+
+  Serial.begin(57600);
+
+  strip.begin(); // Initialize pins for output
+  strip.setBufferCount(2); // keep receiving while the last frame is sent
+  strip.show();  // Turn all LEDs off ASAP
+
+  waitUntil(WiFi.ready);
+  receiver.begin(DOTSTAR_DDP);
+  //receiver.begin(DOTSTAR_E131); receiver.setUniverse(1);
+  Serial.println(WiFi.localIP());
+}
+
+void loop() {
+  receiver.poll();
+}
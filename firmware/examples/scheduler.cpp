@@ -0,0 +1,55 @@
+#include "application.h"
+#include "dotstar/dotstar.h"
+#include "dotstar/dotstar_scheduler.h"
+
+// A rainbow at a steady 100 frames per second.  A 1 ms software timer
+// ticks the scheduler, loop() shows and renders; the serial port reports
+// frames shown and deadlines missed every second.
+
+#define NUM_LEDS 300
+#define FPS      100
+
+Adafruit_DotStar strip = Adafruit_DotStar(NUM_LEDS, DOTSTAR_BGR);
+DotStarScheduler scheduler(strip);
+
+void tick() {
+  scheduler.tick();
+}
+
+Timer ticker(1, tick);
+
+// Frame 'frame' is shown frame / FPS seconds after begin()
+void render(Adafruit_DotStar &s, uint32_t frame) {
+  for(uint16_t i=0; i<NUM_LEDS; i++) {
+    uint8_t  pos = (i * 256 / NUM_LEDS + frame) & 0xFF;
+    uint32_t c;
+    if(pos < 85)       c = s.Color(255 - pos * 3, pos * 3, 0);
+    else if(pos < 170) c = s.Color(0, 255 - (pos - 85) * 3, (pos - 85) * 3);
+    else               c = s.Color((pos - 170) * 3, 0, 255 - (pos - 170) * 3);
+    s.setPixelColor(i, c);
+  }
+}
+
+void setup() {
+
+  Serial.begin(57600);
+
+  strip.begin(); // Initialize pins for output
+  strip.show();  // Turn all LEDs off ASAP
+
+  scheduler.begin(FPS, render, true); // true: tick() comes from the timer
+  ticker.start();
+}
+
+void loop() {
+  static uint32_t lastReport = 0;
+
+  scheduler.poll();
+
+  if(millis() - lastReport >= 1000) {
+    lastReport = millis();
+    Serial.printlnf("shown %lu missed %lu (bus busy %lu), up to %lu us late",
+                    scheduler.getFrames(), scheduler.getMisses(),
+                    scheduler.getWireMisses(), scheduler.getMaxLateness());
+  }
+}
@@ -0,0 +1,44 @@
+#include "application.h"
+#include "dotstar/dotstar.h"
+#include "dotstar/dotstar_queue.h"
+
+// A render thread draws a moving comet as fast as it can while loop()
+// only keeps the bus busy.  The queue hands over whole frames, so the
+// thread never draws into the frame DMA is sending.
+
+SYSTEM_THREAD(ENABLED);
+
+#define NUM_LEDS 300
+
+Adafruit_DotStar  strip = Adafruit_DotStar(NUM_LEDS, DOTSTAR_BGR);
+DotStarFrameQueue queue(strip);
+
+void render(void) {
+  uint16_t head = 0;
+  for(;;) {
+    uint8_t *frame = queue.acquire();
+    if(!frame) {               // every frame busy: the bus is the limit
+      os_thread_yield();
+      continue;
+    }
+    queue.fill(frame, 0);
+    for(uint8_t i=0; i<16; i++)
+      queue.setPixelColor(frame, (head + NUM_LEDS - i) % NUM_LEDS, strip.Color(255 - i * 16, 0, 0));
+    queue.publish();
+    head = (head + 1) % NUM_LEDS;
+    delay(5);
+  }
+}
+
+Thread *renderer;
+
+void setup() {
+  strip.begin(); // Initialize pins for output
+  strip.show();  // Turn all LEDs off ASAP
+  queue.begin(3);
+  renderer = new Thread("render", render);
+}
+
+void loop() {
+  queue.poll(); // DMA completion sends the rest
+}
@@ -0,0 +1,355 @@
+/*------------------------------------------------------------------------
+  Host (Linux) stand-in for Particle's application.h -- implementation.
+  See application.h for what is modelled.
+  ------------------------------------------------------------------------*/
+
+#include "application.h"
+
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// GPIO ---------------------------------------------------------------------
+
+GPIO_TypeDef HOST_GPIOA(0), HOST_GPIOB(1), HOST_GPIOC(2);
+
+static GPIO_TypeDef *const hostPorts[] = { &HOST_GPIOA, &HOST_GPIOB, &HOST_GPIOC };
+
+// Levels of all three ports at each probed clock edge
+struct HostGpioSnapshot { uint16_t odr[3]; };
+static std::vector<HostGpioSnapshot> hostEdges;
+
+// Roughly the Photon pin map: D0-D4 on port B, D5-D7 and A3-A5 on port A.
+STM32_Pin_Info PIN_MAP[TOTAL_PINS] = {
+  { &HOST_GPIOB, 1 << 7,  0 }, // D0
+  { &HOST_GPIOB, 1 << 6,  0 }, // D1
+  { &HOST_GPIOB, 1 << 5,  0 }, // D2
+  { &HOST_GPIOB, 1 << 4,  0 }, // D3
+  { &HOST_GPIOB, 1 << 3,  0 }, // D4
+  { &HOST_GPIOA, 1 << 15, 0 }, // D5
+  { &HOST_GPIOA, 1 << 14, 0 }, // D6
+  { &HOST_GPIOA, 1 << 13, 0 }, // D7
+  { &HOST_GPIOC, 1 << 8,  0 }, // (8)
+  { &HOST_GPIOC, 1 << 9,  0 }, // (9)
+  { &HOST_GPIOC, 1 << 5,  0 }, // A0
+  { &HOST_GPIOC, 1 << 3,  0 }, // A1
+  { &HOST_GPIOC, 1 << 2,  0 }, // A2
+  { &HOST_GPIOA, 1 << 5,  0 }, // A3
+  { &HOST_GPIOA, 1 << 6,  0 }, // A4
+  { &HOST_GPIOA, 1 << 7,  0 }, // A5
+  { &HOST_GPIOA, 1 << 4,  0 }, // A6
+  { &HOST_GPIOA, 1 << 0,  0 }, // A7
+  { &HOST_GPIOC, 1 << 10, 0 }, // (18)
+  { &HOST_GPIOC, 1 << 11, 0 }, // (19)
+  { &HOST_GPIOC, 1 << 12, 0 }, // (20)
+  { &HOST_GPIOC, 1 << 13, 0 }, // (21)
+  { &HOST_GPIOC, 1 << 14, 0 }, // (22)
+  { &HOST_GPIOC, 1 << 15, 0 }, // (23)
+};
+
+static void hostGpioWrite(GPIO_TypeDef *port, uint16_t set, uint16_t reset) {
+  uint16_t before = port->ODR;
+  port->ODR = (before & ~reset) | set;     // set wins, as on the STM32
+  port->writes++;
+  if(port->probeClockMask & ~before & port->ODR) {
+    HostGpioSnapshot snap;
+    for(int i=0; i<3; i++) snap.odr[i] = hostPorts[i]->ODR;
+    hostEdges.push_back(snap);
+  }
+}
+
+void HostGpioSetReset::operator=(uint16_t mask) {
+  if(set) hostGpioWrite(port, mask, 0);
+  else    hostGpioWrite(port, 0, mask);
+}
+
+void host_gpio_bsrr(GPIO_TypeDef *port, uint32_t word) {
+  hostGpioWrite(port, word & 0xFFFF, word >> 16);
+}
+
+STM32_Pin_Info *HAL_Pin_Map(void) {
+  return PIN_MAP;
+}
+
+void pinMode(pin_t pin, uint8_t mode) {
+  if(pin < TOTAL_PINS) PIN_MAP[pin].mode = mode;
+}
+
+void host_gpio_reset(void) {
+  for(GPIO_TypeDef *p : hostPorts) {
+    p->ODR            = 0;
+    p->probeClockMask = 0;
+    p->writes         = 0;
+  }
+  std::vector<HostGpioSnapshot>().swap(hostEdges); // give the memory back
+}
+
+void host_gpio_probe(pin_t clockPin) {
+  host_gpio_reset();
+  PIN_MAP[clockPin].gpio_peripheral->probeClockMask = PIN_MAP[clockPin].gpio_pin;
+}
+
+std::vector<uint8_t> host_gpio_bytes(pin_t dataPin) {
+  const STM32_Pin_Info &p = PIN_MAP[dataPin];
+  std::vector<uint8_t>  out;
+  uint8_t               b = 0;
+  size_t                n = 0;
+  for(const HostGpioSnapshot &snap : hostEdges) {
+    b = (b << 1) | ((snap.odr[p.gpio_peripheral->index] & p.gpio_pin) ? 1 : 0);
+    if(!(++n & 7)) out.push_back(b);
+  }
+  return out;
+}
+
+uint32_t host_gpio_edges(void) {
+  return hostEdges.size();
+}
+
+uint32_t host_gpio_writes(void) {
+  uint32_t n = 0;
+  for(GPIO_TypeDef *p : hostPorts) n += p->writes;
+  return n;
+}
+
+// Network ------------------------------------------------------------------
+
+static int hostSocket(int type, uint16_t port) {
+  int fd = socket(AF_INET, type, 0), on = 1;
+  if(fd < 0) return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  int size = 1 << 20;                       // room for bursts from a fast sender
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+UDP::UDP(void) : fd(-1) { }
+UDP::~UDP(void) { stop(); }
+
+uint8_t UDP::begin(uint16_t port) {
+  stop();
+  fd = hostSocket(SOCK_DGRAM, port);
+  return fd >= 0;
+}
+
+void UDP::stop(void) {
+  if(fd >= 0) close(fd);
+  fd = -1;
+}
+
+int UDP::receivePacket(uint8_t *buf, size_t size) {
+  if(fd < 0) return -1;
+  ssize_t n = recv(fd, buf, size, 0);
+  if(n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  return (int)n;
+}
+
+uint8_t TCPClient::connected(void) {
+  if(fd < 0) return 0;
+  uint8_t b;
+  ssize_t n = recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+  if(!n || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+int TCPClient::available(void) {
+  int n = 0;
+  if((fd < 0) || ioctl(fd, FIONREAD, &n) < 0) return 0;
+  return n;
+}
+
+int TCPClient::read(uint8_t *buf, size_t size) {
+  if(fd < 0) return -1;
+  ssize_t n = recv(fd, buf, size, MSG_DONTWAIT);
+  return (n > 0) ? (int)n : -1;
+}
+
+void TCPClient::stop(void) {
+  if(fd >= 0) close(fd);
+  fd = -1;
+}
+
+TCPServer::TCPServer(uint16_t p) : port(p), fd(-1) { }
+TCPServer::~TCPServer(void) { stop(); }
+
+bool TCPServer::begin(void) {
+  stop();
+  fd = hostSocket(SOCK_STREAM, port);
+  if(fd >= 0 && listen(fd, 1) < 0) stop();
+  return fd >= 0;
+}
+
+TCPClient TCPServer::available(void) {
+  if(!client.connected() && fd >= 0) {
+    int c = accept(fd, NULL, NULL);
+    if(c >= 0) {
+      fcntl(c, F_SETFL, fcntl(c, F_GETFL) | O_NONBLOCK);
+      client = TCPClient(c);
+    }
+  }
+  return (client.available() > 0) ? client : TCPClient();
+}
+
+void TCPServer::stop(void) {
+  client.stop();
+  if(fd >= 0) close(fd);
+  fd = -1;
+}
+
+// Time ---------------------------------------------------------------------
+
+static bool     simulatedClock = false;
+static uint32_t simulatedMicros = 0;
+static const std::chrono::steady_clock::time_point clockStart =
+  std::chrono::steady_clock::now();
+
+unsigned long micros(void) {
+  if(simulatedClock) return simulatedMicros;
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - clockStart).count();
+}
+
+unsigned long millis(void) {
+  return micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+  delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  if(simulatedClock) host_clock_advance(us);
+  else {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+    host_dma_poll();
+  }
+}
+
+void host_clock_simulate(bool on) {
+  simulatedClock  = on;
+  simulatedMicros = 0;
+}
+
+void host_clock_advance(uint32_t us) {
+  uint32_t target = simulatedMicros + us;
+  // Step through DMA completions in time order so a callback that starts
+  // the next transfer sees the clock at the moment the previous one ended.
+  for(;;) {
+    SPIClass *next = NULL;
+    if(SPI.hostBusy()  && (int32_t)(SPI.busyUntil  - target) <= 0) next = &SPI;
+    if(SPI1.hostBusy() && (int32_t)(SPI1.busyUntil - target) <= 0 &&
+       (!next || (int32_t)(SPI1.busyUntil - next->busyUntil) < 0)) next = &SPI1;
+    if(!next) break;
+    if((int32_t)(next->busyUntil - simulatedMicros) > 0)
+      simulatedMicros = next->busyUntil;
+    next->hostComplete();
+  }
+  simulatedMicros = target;
+}
+
+// SPI ----------------------------------------------------------------------
+
+SPIClass SPI("SPI"), SPI1("SPI1");
+
+SPIClass::SPIClass(const char *n) :
+ name(n), enabled(false), clockHz(0), bytes(0), clockEdges(0), transfers(0),
+ largest(0), busyUntil(0), completion(IMMEDIATE), capture(true), captureAtEnd(false),
+ pending(false), pendingTx(NULL), pendingLen(0), pendingCallback(NULL)
+{ }
+
+void SPIClass::begin(void)                         { enabled = true;  }
+void SPIClass::end(void)                           { enabled = false; }
+void SPIClass::setBitOrder(uint8_t)                { }
+void SPIClass::setDataMode(uint8_t)                { }
+void SPIClass::setClockSpeed(unsigned v, unsigned s) { clockHz = v * s; }
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  if(capture) wire.push_back(data);
+  bytes++;
+  clockEdges += 8;
+  return 0;
+}
+
+void SPIClass::transfer(void *tx, void *rx, size_t len,
+  wiring_spi_dma_transfercomplete_callback_t cb) {
+  const uint8_t *p = (const uint8_t *)tx;
+  bool late = captureAtEnd && (completion == DEFERRED);
+  if(capture && p && !late) wire.insert(wire.end(), p, p + len);
+  if(rx) memset(rx, 0, len);
+  bytes      += len;
+  clockEdges += (uint64_t)len * 8;
+  transfers++;
+  if(len > largest) largest = len;
+
+  if(completion == IMMEDIATE) {
+    if(cb) cb();
+  } else {
+    pending         = true;
+    pendingCallback = cb;
+    pendingTx       = (capture && late) ? p : NULL;
+    pendingLen      = len;
+    busyUntil       = micros() + hostWireMicros(len);
+  }
+}
+
+uint32_t SPIClass::hostWireMicros(size_t len) const {
+  unsigned hz = clockHz ? clockHz : 18000000;
+  return (uint32_t)(((uint64_t)len * 8 * 1000000 + hz - 1) / hz);
+}
+
+void SPIClass::hostSetCompletion(Completion c) { completion = c; }
+void SPIClass::hostSetCapture(bool on)         { capture = on; }
+void SPIClass::hostSetCaptureAtEnd(bool on)    { captureAtEnd = on; }
+bool SPIClass::hostBusy(void) const            { return pending; }
+
+void SPIClass::hostReset(void) {
+  std::vector<uint8_t>().swap(wire);
+  bytes = clockEdges = transfers = 0;
+  largest         = 0;
+  pending         = false;
+  pendingTx       = NULL;
+  pendingCallback = NULL;
+}
+
+bool SPIClass::hostComplete(void) {
+  if(!pending) return false;
+  wiring_spi_dma_transfercomplete_callback_t cb = pendingCallback;
+  if(pendingTx) wire.insert(wire.end(), pendingTx, pendingTx + pendingLen);
+  pending         = false;
+  pendingTx       = NULL;
+  pendingCallback = NULL;
+  if(cb) cb(); // May start the next transfer
+  return true;
+}
+
+void host_dma_poll(void) {
+  bool done;
+  do {
+    uint32_t now = micros();
+    done  = SPI.hostBusy()  && (int32_t)(SPI.busyUntil  - now) <= 0 && SPI.hostComplete();
+    done |= SPI1.hostBusy() && (int32_t)(SPI1.busyUntil - now) <= 0 && SPI1.hostComplete();
+  } while(done);
+}
+
+void host_dma_complete(void) {
+  while(SPI.hostComplete() | SPI1.hostComplete()) { }
+}
@@ -0,0 +1,211 @@
+/*------------------------------------------------------------------------
+  Host (Linux) stand-in for the parts of Particle's application.h that the
+  DotStar library uses.  Lets firmware/dotstar.cpp be compiled, measured and
+  checked on a PC without flashing a device.
+
+  What is modelled:
+  - GPIO ports with BSRRL/BSRRH set/reset registers, reached through the
+    same PIN_MAP / HAL_Pin_Map() fast-pin macros the library uses.  Every
+    write is applied to the port's output register and every rising edge of
+    the probed clock pin records a snapshot of the port, so bitbanged data
+    can be decoded afterwards (one or more data lanes).
+  - SPI and SPI1 with the DMA-style transfer(tx, rx, len, callback) call.
+    Every byte is captured and clock edges are counted.  Completion is
+    either immediate (callback fires before transfer() returns) or deferred
+    until host_dma_complete() / simulated time passes the wire time.
+  - micros()/millis() on either the real clock or a simulated clock.
+  - UDP, TCPServer and TCPClient on non-blocking POSIX sockets, so network
+    code can be driven from a sender on the loopback interface.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DOTSTAR_HOST_APPLICATION_H_
+#define _DOTSTAR_HOST_APPLICATION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define PLATFORM_ID 6 // pretend to be a Photon
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0x00
+
+typedef uint16_t pin_t;
+typedef void (*wiring_spi_dma_transfercomplete_callback_t)(void);
+
+enum {
+  D0 = 0, D1, D2, D3, D4, D5, D6, D7,
+  A0 = 10, A1, A2, A3, A4, A5, A6, A7,
+  TOTAL_PINS = 24
+};
+
+// GPIO ---------------------------------------------------------------------
+
+struct GPIO_TypeDef;
+
+// One half of the STM32F2 BSRR register.  Assigning to it sets (BSRRL) or
+// clears (BSRRH) the given bits in the owning port's output register.
+struct HostGpioSetReset {
+  GPIO_TypeDef *port;
+  bool          set;
+  void operator=(uint16_t mask);
+};
+
+struct GPIO_TypeDef {
+  HostGpioSetReset BSRRL, BSRRH;
+  uint16_t         ODR;                     // Current output levels
+  uint16_t         probeClockMask;          // Rising edges of these bits are recorded
+  uint32_t         writes;                  // Number of BSRR writes
+  uint8_t          index;                   // 0 = A, 1 = B, 2 = C
+  GPIO_TypeDef(uint8_t i) : ODR(0), probeClockMask(0), writes(0), index(i) {
+    BSRRL.port = this; BSRRL.set = true;
+    BSRRH.port = this; BSRRH.set = false;
+  }
+};
+
+// A full 32-bit BSRR write: low half sets, high half clears, in one go.
+void host_gpio_bsrr(GPIO_TypeDef *port, uint32_t word);
+#define portBSRR(_port, _word) host_gpio_bsrr((_port), (_word))
+
+typedef struct STM32_Pin_Info {
+  GPIO_TypeDef *gpio_peripheral;
+  uint16_t      gpio_pin;
+  uint8_t       mode;
+} STM32_Pin_Info;
+
+extern GPIO_TypeDef   HOST_GPIOA, HOST_GPIOB, HOST_GPIOC;
+extern STM32_Pin_Info PIN_MAP[TOTAL_PINS];
+
+STM32_Pin_Info *HAL_Pin_Map(void);
+void            pinMode(pin_t pin, uint8_t mode);
+
+// Record every port's levels at each rising edge of 'clockPin'; clears
+// earlier captures and write counts.
+void     host_gpio_probe(pin_t clockPin);
+void     host_gpio_reset(void);
+// Decode the bytes shifted out MSB first on 'dataPin' at the probed edges.
+std::vector<uint8_t> host_gpio_bytes(pin_t dataPin);
+uint32_t host_gpio_edges(void);
+uint32_t host_gpio_writes(void);            // BSRR writes, all ports
+
+// SPI ----------------------------------------------------------------------
+
+class SPIClass {
+ public:
+  SPIClass(const char *name);
+
+  void
+    begin(void),
+    end(void),
+    setBitOrder(uint8_t),
+    setDataMode(uint8_t),
+    setClockSpeed(unsigned value, unsigned scale=1),
+    transfer(void *tx, void *rx, size_t len,
+             wiring_spi_dma_transfercomplete_callback_t cb);
+  uint8_t
+    transfer(uint8_t data);
+
+  // Host-side controls and capture
+  enum Completion { IMMEDIATE, DEFERRED };
+  void
+    hostSetCompletion(Completion c),        // When DMA callbacks fire
+    hostSetCapture(bool on),                // Keep a copy of the wire bytes
+    hostSetCaptureAtEnd(bool on),           // DEFERRED: copy them when the transfer ends, as DMA
+                                            // reads them, so writes during a transfer show
+    hostReset(void);                        // Clear capture and counters
+  bool
+    hostComplete(void),                     // Finish pending DMA, true if one was pending
+    hostBusy(void) const;
+  uint32_t
+    hostWireMicros(size_t len) const;       // Time 'len' bytes take on the wire
+
+  const char *name;
+  bool        enabled;
+  unsigned    clockHz;
+  std::vector<uint8_t> wire;                // Captured bytes (if capture is on)
+  uint64_t    bytes, clockEdges, transfers;
+  size_t      largest;                      // Longest DMA transfer (the device limit is 65535)
+  uint32_t    busyUntil;                    // micros() the pending DMA ends at
+
+ private:
+  Completion completion;
+  bool       capture, captureAtEnd, pending;
+  const uint8_t *pendingTx;                 // Transfer to capture when it ends
+  size_t     pendingLen;
+  wiring_spi_dma_transfercomplete_callback_t pendingCallback;
+};
+
+extern SPIClass SPI, SPI1;
+
+// Complete every deferred DMA transfer on both buses.
+void host_dma_complete(void);
+// Complete deferred DMA transfers whose wire time has passed.
+void host_dma_poll(void);
+
+// Network ------------------------------------------------------------------
+
+// Only the calls the library uses; all sockets are non-blocking.
+class UDP {
+ public:
+  UDP(void);
+ ~UDP(void);
+  uint8_t begin(uint16_t port);             // 1 on success
+  void    stop(void);
+  // Next datagram straight into 'buf': its length, 0 if none, < 0 on error
+  int     receivePacket(uint8_t *buf, size_t size);
+ private:
+  int fd;
+};
+
+class TCPClient {
+ public:
+  TCPClient(void) : fd(-1) { }
+  explicit TCPClient(int socket) : fd(socket) { }
+  uint8_t connected(void);
+  int     available(void);
+  int     read(uint8_t *buf, size_t size);  // Bytes read, -1 if none
+  void    stop(void);
+  operator bool(void) { return connected(); }
+ private:
+  int fd;
+};
+
+class TCPServer {
+ public:
+  TCPServer(uint16_t port);
+ ~TCPServer(void);
+  bool      begin(void);
+  TCPClient available(void);                // Connected client with data, if any
+  void      stop(void);
+ private:
+  uint16_t  port;
+  int       fd;
+  TCPClient client;
+};
+
+// Time ---------------------------------------------------------------------
+
+unsigned long micros(void);
+unsigned long millis(void);
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+
+// Switch micros()/millis() to a simulated clock that only moves through
+// host_clock_advance(); deferred DMA transfers whose wire time has passed
+// complete as the clock is advanced.  On the real clock they complete from
+// delay()/delayMicroseconds() or host_dma_poll().
+void host_clock_simulate(bool on);
+void host_clock_advance(uint32_t us);
+
+inline void __disable_irq(void) { }
+inline void __enable_irq(void)  { }
+
+#endif // _DOTSTAR_HOST_APPLICATION_H_
@@ -0,0 +1,62 @@
+/*------------------------------------------------------------------------
+  Host benchmark suite for the DotStar library.
+
+  Builds firmware/dotstar.cpp against the application.h stand-in in this
+  directory and reports the cost of each public API per pixel and the
+  throughput of both show() paths.  Every section first checks that what
+  reached the (simulated) wire is what the strip buffer holds, so a
+  "faster" change that breaks the output fails here instead of on a strip.
+  Each module's sections are in bench_<module>.cpp, the helpers they
+  share in bench.h.
+
+  Usage: bench [section ...]   (no arguments runs every section)
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+
+const uint16_t    sizes[4] = { 30, 128, 1024, 8192 };
+int               failures = 0;
+volatile uint32_t sink;
+
+// ----------------------------------------------------------------------------
+
+struct Section { const char *name; void (*run)(void); };
+
+static const Section sections[] = {
+  { "api",     benchApi    },
+  { "show-hw", benchShowHw },
+  { "show-sw", benchShowSw },
+  { "parallel", benchParallel },
+  { "template", benchTemplate },
+  { "storage", benchStorage },
+  { "output",  benchOutput },
+  { "dither",  benchDither },
+  { "partial", benchPartial },
+  { "pipeline", benchPipeline },
+  { "scheduler", benchScheduler },
+  { "buses",   benchBuses  },
+  { "long",    benchLong   },
+  { "stats",   benchStats  },
+  { "receiver", benchReceiver },
+  { "matrix",  benchMatrix },
+  { "kernels", benchKernels },
+  { "player",  benchPlayer },
+  { "indexed", benchIndexed },
+  { "queue",   benchQueue },
+  { "power",   benchPower },
+  { "keyframes", benchKeyframes },
+};
+
+int main(int argc, char **argv) {
+  for(const Section &s : sections) {
+    bool run = argc < 2;
+    for(int i=1; i<argc; i++) run |= !strcmp(argv[i], s.name);
+    if(run) s.run();
+  }
+  if(failures) {
+    printf("\n%d check(s) FAILED\n", failures);
+    return 1;
+  }
+  printf("\nall checks passed\n");
+  return 0;
+}
@@ -0,0 +1,116 @@
+/*------------------------------------------------------------------------
+  Host benchmark suite for the DotStar library: what the sections share.
+
+  Each module has its own bench_<module>.cpp with its checks and
+  benchmarks; bench.cpp lists the sections and runs them.  The helpers
+  here are the ones more than one file uses.
+  ------------------------------------------------------------------------*/
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "application.h"
+#include "dotstar.h"
+
+#include <algorithm>
+#include <chrono>
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+extern const uint16_t sizes[4];             // Strip lengths of every table
+extern int            failures;             // CHECK()s failed so far
+extern volatile uint32_t sink;              // Keeps timed reads from being optimized out
+
+#define CHECK(cond, ...) do { if(!(cond)) {                    \
+    printf("  FAIL %s:%d: ", __FILE__, __LINE__);               \
+    printf(__VA_ARGS__); printf("\n"); failures++; } } while(0)
+
+// Sections, in the order bench.cpp runs them
+void
+  benchApi(void), benchShowHw(void), benchShowSw(void), benchParallel(void),
+  benchTemplate(void), benchStorage(void), benchOutput(void), benchDither(void),
+  benchPartial(void), benchPipeline(void), benchScheduler(void), benchBuses(void),
+  benchLong(void), benchStats(void), benchReceiver(void), benchMatrix(void),
+  benchKernels(void), benchPlayer(void), benchIndexed(void), benchQueue(void),
+  benchPower(void), benchKeyframes(void);
+
+// Run 'body' (which does 'ops' operations) until at least 20 ms have
+// passed, return nanoseconds per operation.
+template <typename F>
+static inline double timeIt(uint32_t ops, F body) {
+  typedef std::chrono::steady_clock clock;
+  uint64_t       iterations = 0;
+  clock::time_point start = clock::now(), now;
+  do {
+    body();
+    iterations++;
+    now = clock::now();
+  } while(now - start < std::chrono::milliseconds(20));
+  double ns = std::chrono::duration<double, std::nano>(now - start).count();
+  return ns / ((double)iterations * ops);
+}
+
+static inline void header(const char *title, const char *unit) {
+  printf("\n%-34s", title);
+  for(uint16_t n : sizes) printf("%10u", n);
+  printf("   %s\n", unit);
+}
+
+static inline uint32_t frameBytes(uint16_t n) {
+  return 4 + n * 4 + (1 + n / 8);
+}
+
+static inline void fillPattern(Adafruit_DotStar &strip) {
+  for(uint16_t i=0; i<strip.numPixels(); i++)
+    strip.setPixelColor(i, (uint8_t)(i * 7), (uint8_t)(i * 13), (uint8_t)(i * 29));
+}
+
+// show() into a fresh capture; the bytes that reached the wire
+static inline const std::vector<uint8_t> &showWire(Adafruit_DotStar &strip) {
+  SPI.hostReset();
+  strip.show();
+  return SPI.wire;
+}
+
+// The wire holds exactly the strip's whole frame buffer
+static inline bool wireIsFrame(Adafruit_DotStar &strip) {
+  return (SPI.wire.size() == frameBytes(strip.numPixels())) &&
+         !memcmp(SPI.wire.data(), strip.getPixels(), SPI.wire.size());
+}
+
+static inline size_t heapInUse(void) {
+  return mallinfo2().uordblks;
+}
+
+// Estimate from scratch: idle per LED plus channel currents at the 5-bit
+// global g, as limitPower() models it (defaults: 20 mA, 1000 uA)
+static inline uint32_t powerOf(const Adafruit_DotStar &strip, uint16_t n, uint8_t g) {
+  uint64_t full = 0;
+  for(uint16_t i=0; i<n; i++) {
+    uint32_t c = strip.getPixelColor(i);
+    full += ((c >> 16) & 0xFF) + ((c >> 8) & 0xFF) + (c & 0xFF);
+  }
+  return ((uint64_t)n * 1000 + full * 20 * 1000 / 255 * g / 31 + 500) / 1000;
+}
+
+// With the limiter on (and never reached), whether 'write' kept the power
+// sums itself: LED 'spy' is inverted behind the limiter's back first, so
+// a recount at show() would see it and the running sums don't
+template <typename F>
+static inline bool powerTracked(Adafruit_DotStar &strip, uint16_t spy, F write) {
+  strip.setPowerLimit(1000000);
+  strip.show();                             // the first show() counts the frame
+  uint8_t *p = &strip.getPixels()[4 + spy * 4], old[3];
+  memcpy(old, p + 1, 3);
+  for(int c=1; c<4; c++) p[c] = ~p[c];
+  write();
+  strip.show();
+  memcpy(p + 1, old, 3);
+  return strip.getPowerEstimate() == powerOf(strip, strip.numPixels(), 31);
+}
+
+#endif // _BENCH_H_
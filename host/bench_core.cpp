@@ -0,0 +1,842 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: the core strip (API cost, hardware SPI,
+  compile-time strips, storage, long strips, output stage, dithering,
+  partial show, frame pipeline, two buses, statistics).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar.h"
+
+// API cost per pixel ---------------------------------------------------------
+
+void benchApi(void) {
+  header("API", "ns/pixel");
+
+  const char *names[] = {
+    "setPixelColor(n, r, g, b)", "setPixelColor(n, c)", "getPixelColor(n)",
+    "clear()", "updateLength(n)", "fill(c)", "setPixels(0, src, n)",
+    "setPixelsRGB(0, rgb, n)"
+  };
+  for(int api=0; api<8; api++) {
+    printf("%-34s", names[api]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      std::vector<uint32_t> src(n);
+      std::vector<uint8_t>  rgb(n * 3);
+      for(uint16_t i=0; i<n; i++) src[i] = (uint32_t)i * 0x010203;
+      for(uint32_t i=0; i<n * 3u; i++) rgb[i] = (uint8_t)i;
+      double ns = 0;
+      switch(api) {
+        case 0: ns = timeIt(n, [&] {
+            for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, i, i >> 1, 255 - i);
+          }); break;
+        case 1: ns = timeIt(n, [&] {
+            for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, (uint32_t)i * 0x010203);
+          }); break;
+        case 2: ns = timeIt(n, [&] {
+            uint32_t s = 0;
+            for(uint16_t i=0; i<n; i++) s += strip.getPixelColor(i);
+            sink = s;
+          }); break;
+        case 3: ns = timeIt(n, [&] { strip.clear(); }); break;
+        case 4: ns = timeIt(n, [&] { strip.updateLength(n); }); break;
+        case 5: ns = timeIt(n, [&] { strip.fill(0x123456); }); break;
+        case 6: ns = timeIt(n, [&] { strip.setPixels(0, src.data(), n); }); break;
+        case 7: ns = timeIt(n, [&] { strip.setPixelsRGB(0, rgb.data(), n); }); break;
+      }
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+
+  // Sanity: what we set is what we read back and where the frame expects it
+  Adafruit_DotStar strip(4, DOTSTAR_BGR);
+  strip.setPixelColor(1, 0x11, 0x22, 0x33);
+  CHECK(strip.getPixelColor(1) == 0x112233, "getPixelColor returned %06x",
+        (unsigned)strip.getPixelColor(1));
+  const uint8_t *p = strip.getPixels();
+  CHECK(p[8] == 0xFF && p[9] == 0x33 && p[10] == 0x22 && p[11] == 0x11,
+        "pixel 1 frame is %02x %02x %02x %02x", p[8], p[9], p[10], p[11]);
+
+  // The packed overload and the bulk writes must produce exactly the
+  // frame the R,G,B setPixelColor() loop does
+  const uint16_t n = 37;
+  for(uint8_t order : { DOTSTAR_RGB, DOTSTAR_GRB, DOTSTAR_BGR }) {
+    Adafruit_DotStar ref(n, order), bulk(n, order);
+    ref.setBrightness(100);
+    bulk.setBrightness(100);
+    uint32_t src[n];
+    uint8_t  rgb[n * 3];
+    for(uint16_t i=0; i<n; i++) {
+      src[i] = 0x010203 * (i + 1) ^ 0xA05000;
+      rgb[i * 3] = src[i] >> 16; rgb[i * 3 + 1] = src[i] >> 8; rgb[i * 3 + 2] = src[i];
+    }
+    size_t len = frameBytes(n);
+
+    for(uint16_t i=0; i<n; i++) ref.setPixelColor(i, src[i] >> 16, src[i] >> 8, src[i]);
+    for(uint16_t i=0; i<n; i++) bulk.setPixelColor(i, src[i]);
+    CHECK(!memcmp(ref.getPixels(), bulk.getPixels(), len), "setPixelColor(n, c) frame differs");
+    bulk.clear();
+    bulk.setPixels(0, src, n);
+    CHECK(!memcmp(ref.getPixels(), bulk.getPixels(), len), "setPixels() frame differs");
+    bulk.clear();
+    bulk.setPixelsRGB(5, rgb + 15, 0);         // 0 = to the end
+    bulk.setPixelsRGB(0, rgb, 5);
+    CHECK(!memcmp(ref.getPixels(), bulk.getPixels(), len), "setPixelsRGB() frame differs");
+
+    for(uint16_t i=10; i<20; i++) ref.setPixelColor(i, 0x0A0B0C);
+    bulk.fill(0x0A0B0C, 10, 10);
+    bulk.fill(0x0A0B0C, n, 5);                 // past the end: no-op
+    CHECK(!memcmp(ref.getPixels(), bulk.getPixels(), len), "fill() frame differs");
+
+    for(uint16_t i=0; i<n; i++) ref.setPixelColor(i, 0, 0, 0);
+    bulk.clear();
+    CHECK(!memcmp(ref.getPixels(), bulk.getPixels(), len), "clear() frame differs");
+  }
+}
+
+// show() throughput ----------------------------------------------------------
+
+// The stub completes DMA inside transfer(), so show() is timed as CPU
+// time only; what the bus carries is the wire-time table
+void benchShowHw(void) {
+  header("show() hardware SPI (DMA), CPU", "ns/frame");
+
+  printf("%-34s", "SPI, CPU time of show()");
+  for(uint16_t n : sizes) {
+    Adafruit_DotStar strip(n, DOTSTAR_BGR);
+    strip.begin();
+    fillPattern(strip);
+
+    showWire(strip);
+    CHECK(wireIsFrame(strip), "SPI wire does not match the %u LED frame", n);
+
+    SPI.hostSetCapture(false);
+    double ns = timeIt(1, [&] { strip.show(); });
+    SPI.hostSetCapture(true);
+    printf("%10.0f", ns);
+  }
+  printf("\n");
+
+  header("show() hardware SPI (DMA), wire", "bytes/us");
+  printf("%-34s", "wire time at 18 MHz");
+  for(uint16_t n : sizes)
+    printf("%10.1f", (double)frameBytes(n) / SPI.hostWireMicros(frameBytes(n)));
+  printf("\n");
+}
+
+// Compile-time strip (DotStarStrip<>) ----------------------------------------
+
+template <uint16_t N>
+static void benchTemplateSize(int api) {
+  static DotStarStrip<DOTSTAR_GRB, DOTSTAR_SPI1, N> fixed;
+  Adafruit_DotStar runtime(N, DOTSTAR_GRB, DOTSTAR_SPI1);
+  double ns = 0;
+  switch(api) {
+    case 0: ns = timeIt(N, [&] {
+        for(uint16_t i=0; i<N; i++) runtime.setPixelColor(i, i, i >> 1, 255 - i);
+      }); break;
+    case 1: ns = timeIt(N, [&] {
+        for(uint16_t i=0; i<N; i++) fixed.setPixelColor(i, i, i >> 1, 255 - i);
+      }); break;
+    case 2: ns = timeIt(N, [&] {
+        uint32_t s = 0;
+        for(uint16_t i=0; i<N; i++) s += runtime.getPixelColor(i);
+        sink = s;
+      }); break;
+    case 3: ns = timeIt(N, [&] {
+        uint32_t s = 0;
+        for(uint16_t i=0; i<N; i++) s += fixed.getPixelColor(i);
+        sink = s;
+      }); break;
+  }
+  printf("%10.2f", ns);
+
+  // same frame either way, sent on the bus the template names
+  for(uint16_t i=0; i<N; i++) {
+    runtime.setPixelColor(i, i * 3, i * 5, i * 7);
+    fixed.setPixelColor(i, (uint32_t)runtime.getPixelColor(i));
+  }
+  CHECK(!memcmp(runtime.getPixels(), fixed.getPixels(), frameBytes(N)),
+        "DotStarStrip<%u> frame differs from Adafruit_DotStar", N);
+  fixed.begin();
+  SPI1.hostReset();
+  fixed.show();
+  CHECK(SPI1.wire.size() == frameBytes(N) &&
+        !memcmp(SPI1.wire.data(), fixed.getPixels(), frameBytes(N)),
+        "DotStarStrip<%u> did not send its frame on SPI1", N);
+}
+
+void benchTemplate(void) {
+  header("Adafruit_DotStar vs DotStarStrip<>", "ns/pixel");
+  const char *names[] = {
+    "setPixelColor(), runtime order", "setPixelColor(), template order",
+    "getPixelColor(), runtime order", "getPixelColor(), template order"
+  };
+  for(int api=0; api<4; api++) {
+    printf("%-34s", names[api]);
+    benchTemplateSize<30>(api);
+    benchTemplateSize<128>(api);
+    benchTemplateSize<1024>(api);
+    benchTemplateSize<8192>(api);
+    printf("\n");
+  }
+}
+
+// Caller-owned frame storage --------------------------------------------------
+
+void benchStorage(void) {
+  static uint8_t frames[3 * DOTSTAR_FRAME_BYTES(1024)];
+  static_assert(DOTSTAR_FRAME_BYTES(1024) == 4 + 1024 * 4 + 129, "frame size");
+
+  printf("\ncaller-owned storage, 1024 LEDs%26s heap bytes\n", "");
+  // capture buffers of the stub would count as heap use
+  SPI.hostSetCapture(false);
+  SPI.hostReset();
+  host_gpio_reset();
+  size_t before = heapInUse();
+  {
+    Adafruit_DotStar strip(1024, frames, sizeof(frames));
+    strip.begin();
+    CHECK(strip.numPixels() == 1024 && strip.getPixels() == frames, "frame not in storage");
+    CHECK(strip.setBufferCount(3), "setBufferCount(3) with storage for 3");
+    for(int f=0; f<5; f++) {
+      fillPattern(strip);
+      strip.show();
+      CHECK(strip.getPixels() >= frames && strip.getPixels() < frames + sizeof(frames),
+            "back buffer %d outside the storage", f);
+    }
+    strip.updateLength(500);
+    strip.updateLength(1024);
+    CHECK(strip.numPixels() == 1024, "updateLength() within storage");
+    strip.updateLength(4000);
+    CHECK(strip.numPixels() == 1024, "updateLength() past the storage accepted");
+    size_t used = heapInUse() - before;
+    printf("%-60s%10zu\n", "HW SPI, 3 buffers, 5 show(), 2 updateLength()", used);
+    CHECK(!used, "caller-owned strip used %zu heap bytes", used);
+  }
+  {
+    Adafruit_DotStar strip(1024, DOTSTAR_BGR);
+    strip.setBufferCount(3);
+    printf("%-60s%10zu\n", "HW SPI, heap, 3 buffers", heapInUse() - before);
+  }
+  CHECK(heapInUse() == before, "heap not returned after the strips");
+
+  // soft SPI with storage: a 4th buffer spills onto the heap
+  {
+    Adafruit_DotStar strip(1024, D2, D4, frames, sizeof(frames), DOTSTAR_GRB);
+    strip.begin();
+    fillPattern(strip);
+    host_gpio_probe(D4);
+    strip.show();
+    CHECK(host_gpio_bytes(D2) == std::vector<uint8_t>(strip.getPixels(),
+          strip.getPixels() + frameBytes(1024)), "soft SPI frame from storage");
+    host_gpio_reset();
+    before = heapInUse();                   // the edge capture may keep some
+    CHECK(strip.setBufferCount(4), "setBufferCount(4)");
+    size_t used = heapInUse() - before;
+    printf("%-60s%10zu\n", "soft SPI, storage for 3, 4 buffers", used);
+    CHECK(used >= frameBytes(1024) && used <= frameBytes(1024) + 64,
+          "%zu heap bytes for one buffer", used);
+  }
+  CHECK(heapInUse() == before, "heap not returned after the soft SPI strip");
+
+  Adafruit_DotStar tiny(1024, frames, 100);
+  CHECK(!tiny.numPixels(), "too small storage gives %u LEDs", tiny.numPixels());
+  SPI.hostSetCapture(true);
+
+  // updateLength() on the heap: same frame size reuses the buffer
+  header("updateLength() on the heap", "ns/call");
+  for(int same=1; same>=0; same--) {
+    printf("%-34s", same ? "same length" : "alternating length");
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      uint16_t k = 0;
+      printf("%10.1f", timeIt(1, [&] { strip.updateLength(same ? n : n + (++k & 1) * 8); }));
+    }
+    printf("\n");
+  }
+}
+
+// Long strips: chained DMA past 65535 bytes ---------------------------------
+
+void benchLong(void) {
+  const uint16_t lengths[] = { 8192, 16383, 16384, 30000, 65535 };
+  printf("\nlong strips, chained DMA (%u byte chunks)\n", DOTSTAR_DMA_CHUNK);
+  printf("%8s %10s %8s %10s %12s %12s %10s\n", "LEDs", "frame B", "chunks",
+         "largest", "show() us", "wire MB/s", "fps");
+
+  for(uint16_t n : lengths) {
+    Adafruit_DotStar strip(n, DOTSTAR_BGR);
+    strip.begin();
+    CHECK(strip.numPixels() == n, "%u LEDs: frame not allocated", n);
+    fillPattern(strip);
+    strip.setPixelColor(n - 1, 0xABCDEF);
+
+    showWire(strip);
+    uint32_t chunks = SPI.transfers;
+    CHECK(SPI.wire.size() == frameBytes(n) &&
+          !memcmp(SPI.wire.data(), strip.getPixels(), frameBytes(n)),
+          "%u LEDs: wire differs from the frame", n);
+    CHECK(SPI.largest <= 65535, "%u LEDs: %zu byte DMA transfer", n, SPI.largest);
+    CHECK(chunks == (frameBytes(n) + DOTSTAR_DMA_CHUNK - 1) / DOTSTAR_DMA_CHUNK,
+          "%u LEDs: %u transfers", n, chunks);
+    const uint8_t *last = &SPI.wire[4 + (n - 1) * 4];
+    CHECK(last[1] == 0xEF && last[2] == 0xCD && last[3] == 0xAB &&
+          SPI.wire.back() == 0xFF, "%u LEDs: last pixel / end frame", n);
+    size_t largest = SPI.largest;
+
+    // CPU time of show() (immediate completion, capture off)
+    SPI.hostSetCapture(false);
+    double us = timeIt(1, [&] { strip.show(); }) / 1000.0;
+    SPI.hostSetCapture(true);
+
+    // Frame rate on the wire: chunks chained from the callback, deferred
+    host_clock_simulate(true);
+    SPI.hostSetCompletion(SPIClass::DEFERRED);
+    SPI.hostReset();
+    for(int f=0; f<10; f++) {
+      strip.show();
+      strip.waitForShow();
+    }
+    uint32_t elapsed = micros();
+    CHECK(SPI.transfers == chunks * 10, "%u LEDs: %u deferred transfers for 10 frames",
+          n, (unsigned)SPI.transfers);
+    SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+    host_clock_simulate(false);
+
+    printf("%8u %10u %8u %10zu %12.2f %12.2f %10.1f\n", n, frameBytes(n), chunks,
+           largest, us, frameBytes(n) * 10.0 / elapsed, 10e6 / elapsed);
+  }
+
+  // Partial frame of a long strip: chunked pixels, then the zero tail
+  Adafruit_DotStar strip(30000, DOTSTAR_BGR);
+  strip.begin();
+  strip.setPartialShow(true);
+  strip.show();
+  strip.setPixelColor(20000, 0x123456);
+  showWire(strip);
+  uint32_t want = 4 + 20001 * 4 + 1 + 20001 / 8;
+  CHECK(SPI.wire.size() == want && !memcmp(SPI.wire.data(), strip.getPixels(), 4 + 20001 * 4) &&
+        !SPI.wire.back() && SPI.largest <= 65535,
+        "partial frame of 20001 LEDs: %zu bytes, want %u", SPI.wire.size(), want);
+
+  // Soft SPI past 64 KB
+  Adafruit_DotStar soft(20000, D2, D4);
+  soft.begin();
+  fillPattern(soft);
+  host_gpio_probe(D4);
+  soft.show();
+  CHECK(host_gpio_bytes(D2) == std::vector<uint8_t>(soft.getPixels(),
+        soft.getPixels() + frameBytes(20000)), "soft SPI frame of 20000 LEDs");
+  host_gpio_reset();
+}
+
+// Output stage (gamma / brightness / HD) -------------------------------------
+
+void benchOutput(void) {
+  header("show() CPU time by output stage", "ns/pixel");
+  const char *names[] = { "DOTSTAR_OUTPUT_DIRECT", "DOTSTAR_OUTPUT_LUT",
+                          "DOTSTAR_OUTPUT_HD", "DOTSTAR_OUTPUT_DITHER",
+                          "DOTSTAR_OUTPUT_HD, 3 buffers" };
+  for(int row=0; row<5; row++) {
+    printf("%-34s", names[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      strip.begin();
+      fillPattern(strip);
+      strip.setOutputMode((DotStarOutput)(row < 4 ? row : 2));
+      strip.setGamma(2.5f);
+      if(row == 4) strip.setBufferCount(3);
+      SPI.hostSetCapture(false);
+      printf("%10.2f", timeIt(n, [&] { strip.show(); }));
+      SPI.hostSetCapture(true);
+    }
+    printf("\n");
+  }
+
+  // Linear LUT at full brightness sends the colors untouched
+  const uint16_t n = 64;
+  Adafruit_DotStar strip(n, DOTSTAR_BGR);
+  strip.begin();
+  fillPattern(strip);
+  std::vector<uint8_t> frame(strip.getPixels(), strip.getPixels() + frameBytes(n));
+  CHECK(strip.setOutputMode(DOTSTAR_OUTPUT_LUT), "setOutputMode(LUT) failed");
+  showWire(strip);
+  CHECK(SPI.wire.size() == frame.size() &&
+        !memcmp(SPI.wire.data(), frame.data(), frame.size()),
+        "linear LUT output differs from the frame");
+
+  // Brightness is applied at show(), also to pixels set before the change
+  strip.setBrightness(127);
+  showWire(strip);
+  bool scaled = true;
+  for(uint16_t i=0; i<n; i++)
+    for(int c=1; c<4; c++) {
+      int want = (frame[4 + i * 4 + c] * 128 + 127) / 255;
+      scaled &= abs(SPI.wire[4 + i * 4 + c] - want) <= 1 && SPI.wire[4 + i * 4] == 0xFF;
+    }
+  CHECK(scaled, "brightness 127 not applied by the LUT stage");
+  CHECK(strip.getPixelColor(5) == (uint32_t)((frame[4 + 5*4 + 3] << 16) |
+        (frame[4 + 5*4 + 2] << 8) | frame[4 + 5*4 + 1]),
+        "getPixelColor() changed by the output stage");
+
+  // HD: global * pwm / 31 must reproduce the 16-bit value to within one
+  // PWM step, and dim values must use a low global instead of losing bits
+  strip.setBrightness(255);
+  strip.setGamma(2.5f);
+  CHECK(strip.setOutputMode(DOTSTAR_OUTPUT_HD), "setOutputMode(HD) failed");
+  for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, i * 4, i * 2, i);
+  showWire(strip);
+  bool exact = true, dimUsesGlobal = true;
+  for(uint16_t i=0; i<n; i++) {
+    const uint8_t *p = &SPI.wire[4 + i * 4];
+    uint8_t g = p[0] & 31;
+    uint8_t rgb[3] = { (uint8_t)i, (uint8_t)(i * 2), (uint8_t)(i * 4) }; // B, G, R bytes
+    for(int c=0; c<3; c++) {
+      double want = pow(rgb[c] / 255.0, 2.5) * 65535.0;
+      double got  = p[c + 1] * 257.0 * g / 31.0;
+      exact &= fabs(got - want) <= 257.0 * g / 31.0 + 1;
+    }
+    if(i * 4 < 40) dimUsesGlobal &= (g < 4);
+  }
+  CHECK(exact, "HD output does not reproduce the 16-bit gamma value");
+  CHECK(dimUsesGlobal, "HD output does not lower the global field for dim pixels");
+
+  CHECK(strip.setOutputMode(DOTSTAR_OUTPUT_DIRECT), "setOutputMode(DIRECT) failed");
+  CHECK(strip.getPixelColor(10) == 0x28140A, "frame lost leaving the output stage");
+}
+
+// Temporal dithering ---------------------------------------------------------
+
+// Sum of one wire byte over 'frames' shows, from the capture
+static uint32_t wireSum(Adafruit_DotStar &strip, uint32_t offset, uint32_t frames) {
+  uint32_t sum = 0;
+  for(uint32_t f=0; f<frames; f++) {
+    showWire(strip);
+    sum += SPI.wire[offset];
+  }
+  return sum;
+}
+
+void benchDither(void) {
+  const uint16_t n = 64;
+  Adafruit_DotStar strip(n, DOTSTAR_BGR);
+  strip.begin();
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  CHECK(strip.setOutputMode(DOTSTAR_OUTPUT_DITHER), "setOutputMode(DITHER) failed");
+  CHECK(strip.getPixels16() != NULL, "no 16-bit buffer");
+
+  // Over 256 frames each channel sends its 8.8 table value to within one step
+  strip.setGamma(2.5f);
+  for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, i, i * 2, i * 3);
+  bool exact = true;
+  for(uint16_t i=0; i<n; i += 7) {
+    for(int c=0; c<3; c++) {
+      uint8_t  v    = i * (3 - c);                      // B, G, R bytes
+      double   want = pow(v / 255.0, 2.5) * 255.0 * 256.0;
+      uint32_t sum  = wireSum(strip, 4 + i * 4 + 1 + c, 256);
+      exact &= fabs(sum - want) <= 2.0;
+    }
+  }
+  CHECK(exact, "dithered average differs from the gamma value");
+  showWire(strip);
+  CHECK(SPI.wire[4] == 0xFF && SPI.wire.size() == frameBytes(n), "dither frame header/length");
+
+  // 16-bit pixels: 1.5 steps at linear gamma averages to 1.5
+  strip.setGamma(1.0f);
+  strip.setPixelColor16(3, 0x0180, 0, 0xFFFF);
+  uint32_t red = wireSum(strip, 4 + 3 * 4 + 3, 256), blue = wireSum(strip, 4 + 3 * 4 + 1, 256);
+  CHECK(red >= 383 && red <= 385, "16-bit 0x0180 averaged %u/256", red);
+  CHECK(blue == 255 * 256, "16-bit 0xFFFF is not full on (%u)", blue);
+  CHECK(strip.getPixelColor(3) == 0x0100FF, "getPixelColor() of a 16-bit pixel");
+
+  // an 8-bit write replaces it: black is black on every frame
+  strip.setPixelColor(3, 0);
+  CHECK(wireSum(strip, 4 + 3 * 4 + 3, 64) == 0, "8-bit write did not replace the 16-bit pixel");
+
+  // partial show has nothing to skip while dithering
+  strip.setPartialShow(true);
+  strip.show();
+  CHECK(showWire(strip).size() == frameBytes(n), "dithered show() sent a partial frame");
+  strip.setPartialShow(false);
+
+  // leaving the stage gives 16-bit pixels a valid header again
+  strip.setPixelColor16(5, 0x8000, 0x8000, 0x8000);
+  CHECK(strip.setOutputMode(DOTSTAR_OUTPUT_DIRECT), "setOutputMode(DIRECT) failed");
+  showWire(strip);
+  CHECK(SPI.wire[4 + 5 * 4] >= 0xE0 && SPI.wire[4 + 5 * 4 + 1] == 0x80, "16-bit pixel after DITHER");
+  CHECK(!strip.getPixels16(), "16-bit buffer kept after DITHER");
+
+  // Low end of a gamma 2.5 fade: distinct average levels among inputs 0-63
+  printf("\ndistinct output levels, inputs 0-63 at gamma 2.5 (over 64 frames)\n");
+  const DotStarOutput modes[] = { DOTSTAR_OUTPUT_LUT, DOTSTAR_OUTPUT_DITHER };
+  const char *names[] = { "DOTSTAR_OUTPUT_LUT", "DOTSTAR_OUTPUT_DITHER" };
+  for(int m=0; m<2; m++) {
+    CHECK(strip.setOutputMode(modes[m]), "setOutputMode failed");
+    strip.setGamma(2.5f);
+    for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, 0, 0, i);
+    std::vector<uint32_t> sums(n, 0);
+    for(int f=0; f<64; f++) {
+      showWire(strip);
+      for(uint16_t i=0; i<n; i++) sums[i] += SPI.wire[4 + i * 4 + 1];
+    }
+    std::sort(sums.begin(), sums.end());
+    printf("%-34s%10u\n", names[m],
+           (unsigned)(std::unique(sums.begin(), sums.end()) - sums.begin()));
+  }
+
+  // render time against the wire time of the same frame at 18 MHz
+  printf("\n%-34s%10s%10s\n", "1024 LEDs, DOTSTAR_OUTPUT_DITHER", "ns/pixel", "% of wire");
+  Adafruit_DotStar big(1024, DOTSTAR_BGR);
+  big.begin();
+  fillPattern(big);
+  big.setOutputMode(DOTSTAR_OUTPUT_DITHER);
+  big.setGamma(2.5f);
+  for(int wide=0; wide<2; wide++) {
+    if(wide) for(uint16_t i=0; i<1024; i++) big.setPixelColor16(i, i * 64, i * 32, i * 16);
+    SPI.hostSetCapture(false);
+    double ns = timeIt(1024, [&] { big.show(); });
+    SPI.hostSetCapture(true);
+    double wireNs = SPI.hostWireMicros(frameBytes(1024)) * 1000.0 / 1024;
+    printf("%-34s%10.2f%10.1f\n", wide ? "show(), 16-bit pixels" : "show(), 8-bit pixels",
+           ns, 100.0 * ns / wireNs);
+  }
+}
+
+// Partial show (dirty range) -------------------------------------------------
+
+// Minimal APA102 chain: after a start frame each LED latches the next
+// 32-bit word if it has the 111 header, and data stops at the first word
+// that doesn't.  Applies 'len' bytes from 'wire' to 'leds' (4 bytes each).
+static void latchWire(std::vector<uint8_t> &leds, const uint8_t *wire, size_t len) {
+  size_t n = leds.size() / 4;
+  for(size_t i=0; i<n && 4 + i * 4 + 4 <= len; i++) {
+    const uint8_t *w = &wire[4 + i * 4];
+    if((w[0] & 0xE0) != 0xE0) break;
+    memcpy(&leds[i * 4], w, 4);
+  }
+}
+
+void benchPartial(void) {
+  printf("\npartial show(), 20 pixels animated at the start of the strip\n");
+  printf("%-34s", "");
+  for(uint16_t n : sizes) printf("%10u", n);
+  printf("\n");
+
+  for(int partial=0; partial<2; partial++) {
+    double fps[4], bytes[4];
+    int    col = 0;
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      strip.begin();
+      strip.setPartialShow(partial);
+      fillPattern(strip);
+
+      host_clock_simulate(true);
+      SPI.hostSetCompletion(SPIClass::DEFERRED);
+      SPI.hostReset();
+
+      std::vector<uint8_t> leds(n * 4, 0);
+      size_t   sent = 0;
+      bool     match = true;
+      const uint32_t frames = 50;
+      for(uint32_t f=0; f<frames; f++) {
+        for(uint16_t i=0; i<20; i++) strip.setPixelColor(i, f * 5, i * 9, 0x40);
+        if(f == 25) strip.setPixelColor(n - 1, 0xFFFFFF); // one write far out
+        strip.show();
+        strip.waitForShow();
+        latchWire(leds, SPI.wire.data() + sent, SPI.wire.size() - sent);
+        sent  = SPI.wire.size();
+        match &= !memcmp(leds.data(), strip.getPixels() + 4, n * 4);
+      }
+      CHECK(match, "%s show(): LEDs differ from the buffer (%u LEDs)",
+            partial ? "partial" : "full", n);
+      fps[col]   = frames * 1e6 / micros();
+      bytes[col] = (double)SPI.bytes / frames;
+      col++;
+
+      // the zero end frame of a partial frame must not latch the next LED
+      if(partial) {
+        size_t tail = frameBytes(20) - 84;
+        CHECK(SPI.wire.size() > 84 + tail &&
+              std::vector<uint8_t>(SPI.wire.end() - tail, SPI.wire.end()) ==
+              std::vector<uint8_t>(tail, 0),
+              "partial frame does not end in %u zero bytes", (unsigned)tail);
+      }
+
+      SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+      host_clock_simulate(false);
+    }
+    printf("%-34s", partial ? "partial: bytes/frame" : "full: bytes/frame");
+    for(int i=0; i<4; i++) printf("%10.0f", bytes[i]);
+    printf("\n%-34s", partial ? "partial: frames/s (wire bound)" : "full: frames/s (wire bound)");
+    for(int i=0; i<4; i++) printf("%10.0f", fps[i]);
+    printf("\n");
+  }
+
+  // nothing changed: nothing sent
+  Adafruit_DotStar strip(100, DOTSTAR_BGR);
+  strip.begin();
+  strip.setPartialShow(true);
+  strip.show();
+  showWire(strip);
+  CHECK(SPI.bytes == 0, "unchanged partial show() sent %u bytes", (unsigned)SPI.bytes);
+  strip.fill(0x010101, 30, 5);
+  CHECK(strip.getDirtyLength() == 35, "fill(30, 5) dirty length %u", strip.getDirtyLength());
+}
+
+// Frame pipeline (setBufferCount) --------------------------------------------
+
+// Render 'frames' frames of 1024 LEDs, each taking 'renderUs' of simulated
+// time, against DMA that completes after the real wire time.  Every frame
+// is one flat color (its index) so the wire can be checked for order.
+static void runPipeline(uint8_t buffers, uint32_t renderUs, uint32_t frames) {
+  const uint16_t n = 1024;
+  Adafruit_DotStar strip(n, DOTSTAR_BGR);
+  strip.begin();
+  CHECK(strip.setBufferCount(buffers), "setBufferCount(%u) failed", buffers);
+
+  host_clock_simulate(true);
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+  SPI.hostReset();
+
+  for(uint32_t f=1; f<=frames; f++) {
+    host_clock_advance(renderUs);
+    for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, f & 0xFF, f >> 8, 0x55);
+    strip.show();
+  }
+  host_clock_advance(SPI.hostWireMicros(frameBytes(n)) * (buffers + 1));
+  uint32_t elapsed = micros();
+
+  // every transmitted frame must be whole and newer than the one before
+  uint32_t sent = SPI.transfers, last = 0;
+  bool     ordered = true;
+  for(uint32_t t=0; t<sent; t++) {
+    const uint8_t *p = &SPI.wire[t * frameBytes(n) + 4];
+    uint32_t f = p[3] | (p[2] << 8);
+    for(uint16_t i=1; i<n; i++) ordered &= !memcmp(p, p + i * 4, 4);
+    ordered &= (f > last);
+    last = f;
+  }
+  CHECK(ordered, "%u buffer(s): frames torn or out of order on the wire", buffers);
+
+  // a single buffer drops frames while DMA is busy, more must not
+  uint32_t lost = frames - sent - strip.getCoalescedFrames();
+  if(buffers > 1) {
+    CHECK(last == frames, "%u buffers: last frame on the wire is %u, not %u",
+          buffers, last, frames);
+    CHECK(!lost, "%u buffers: %u frames lost", buffers, lost);
+  }
+
+  printf("%8u %10u %8u %8u %8u %8u %10u %8u %8.1f\n", buffers, renderUs,
+         frames, sent, strip.getQueuedFrames(), strip.getWaitedFrames(),
+         strip.getCoalescedFrames(), lost, sent * 1e6 / elapsed);
+
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  host_clock_simulate(false);
+}
+
+void benchPipeline(void) {
+  printf("\nshow() frame pipeline, 1024 LEDs, %u us on the wire per frame\n",
+         SPI.hostWireMicros(frameBytes(1024)));
+  printf("%8s %10s %8s %8s %8s %8s %10s %8s %8s\n", "buffers", "render us",
+         "shown", "sent", "queued", "waited", "coalesced", "dropped", "fps");
+  for(uint32_t renderUs : { 2500u, 1200u, 400u })
+    for(uint8_t buffers=1; buffers<=DOTSTAR_MAX_BUFFERS; buffers++)
+      runPipeline(buffers, renderUs, 200);
+
+  // CPU cost of show() including the back buffer copy
+  header("show() CPU time by buffer count", "ns/pixel");
+  for(uint8_t buffers=1; buffers<=3; buffers++) {
+    printf("%-34u", buffers);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      strip.begin();
+      strip.setBufferCount(buffers);
+      SPI.hostSetCapture(false);
+      printf("%10.2f", timeIt(n, [&] { strip.show(); }));
+      SPI.hostSetCapture(true);
+    }
+    printf("\n");
+  }
+}
+
+// Two buses at once (SPI + SPI1) ---------------------------------------------
+
+// The pre-DotStarBus (n, order, 1) must not compile as soft SPI; the
+// bus, soft SPI (pins and orders as plain integers) forms still do
+static_assert(!std::is_constructible<Adafruit_DotStar, int, DotStarOrder, int>::value &&
+              !std::is_constructible<Adafruit_DotStar, int, DotStarOrder, unsigned>::value,
+              "integer bus argument");
+static_assert(std::is_constructible<Adafruit_DotStar, int, DotStarOrder, DotStarBus>::value &&
+              std::is_constructible<Adafruit_DotStar, int, uint8_t, DotStarBus>::value &&
+              std::is_constructible<Adafruit_DotStar, int, int, int>::value &&
+              std::is_constructible<Adafruit_DotStar, int, int, int, DotStarOrder>::value,
+              "bus and soft SPI constructors");
+
+void benchBuses(void) {
+  header("showAll() on SPI + SPI1", "bytes/us");
+
+  host_clock_simulate(true);
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+  SPI1.hostSetCompletion(SPIClass::DEFERRED);
+
+  const char *rows[] = { "one strip (SPI)", "two strips, sequential", "two strips, showAll()" };
+  for(int row=0; row<3; row++) {
+    printf("%-34s", rows[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar a(n, DOTSTAR_BGR, DOTSTAR_SPI), b(n, DOTSTAR_BGR, DOTSTAR_SPI1);
+      a.begin();
+      b.begin();
+      fillPattern(a);
+      fillPattern(b);
+      SPI.hostReset();
+      SPI1.hostReset();
+
+      const uint32_t frames = 20;
+      uint32_t start = micros();
+      for(uint32_t f=0; f<frames; f++) {
+        switch(row) {
+          case 0: a.show(); a.waitForShow(); break;
+          case 1: a.show(); a.waitForShow(); b.show(); b.waitForShow(); break;
+          case 2: Adafruit_DotStar::showAll(a, b, true); break;
+        }
+      }
+      uint32_t elapsed = micros() - start;
+      printf("%10.2f", (double)(SPI.bytes + SPI1.bytes) / elapsed);
+
+      // neither strip may lose a frame to the other bus being busy
+      CHECK(SPI.transfers == frames && SPI1.transfers == (row ? frames : 0),
+            "%s: %u + %u transfers for %u frames", rows[row],
+            (unsigned)SPI.transfers, (unsigned)SPI1.transfers, frames);
+      if(row == 2)
+        CHECK(!memcmp(SPI1.wire.data(), b.getPixels(), frameBytes(n)),
+              "SPI1 wire does not match strip b (%u LEDs)", n);
+    }
+    printf("\n");
+  }
+
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  SPI1.hostSetCompletion(SPIClass::IMMEDIATE);
+  host_clock_simulate(false);
+}
+
+// Transfer statistics (DOTSTAR_STATS, see bench-stats) ------------------------
+
+#if DOTSTAR_STATS
+static void printHist(const char *name, const uint32_t *hist) {
+  printf("  %-10s", name);
+  for(int b=0; b<DOTSTAR_STATS_BINS; b++) printf("%6u", hist[b]);
+  printf("\n");
+}
+#endif
+
+void benchStats(void) {
+  // The same numbers from bench and bench-stats show what the hooks cost
+  header(DOTSTAR_STATS ? "show() CPU time, DOTSTAR_STATS=1" :
+                         "show() CPU time, DOTSTAR_STATS=0", "ns/frame");
+  printf("%-34s", "hardware SPI");
+  for(uint16_t n : sizes) {
+    Adafruit_DotStar strip(n, DOTSTAR_BGR);
+    strip.begin();
+    SPI.hostSetCapture(false);
+    printf("%10.1f", timeIt(1, [&] { strip.show(); }));
+    SPI.hostSetCapture(true);
+  }
+  printf("\n");
+
+  DotStarStats st;
+  Adafruit_DotStar strip(1024, DOTSTAR_BGR);
+  strip.begin();
+#if !DOTSTAR_STATS
+  CHECK(!strip.getStats(st) && !st.framesSubmitted, "getStats() without DOTSTAR_STATS");
+#else
+  const uint32_t wire = SPI.hostWireMicros(frameBytes(1024));
+  host_clock_simulate(true);
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+
+  // Single buffer, show() every 1 ms: most frames find the bus busy
+  strip.resetStats();
+  for(int f=0; f<100; f++) {
+    strip.show();
+    host_clock_advance(1000);
+  }
+  host_clock_advance(wire);
+  CHECK(strip.getStats(st), "getStats()");
+  CHECK(st.framesSubmitted + st.framesDropped == 100 &&
+        st.framesTransmitted == st.framesSubmitted && st.framesDropped > 0,
+        "submitted %u dropped %u transmitted %u", st.framesSubmitted,
+        st.framesDropped, st.framesTransmitted);
+  CHECK(st.transferLast == wire && st.transferMin == wire && st.transferMax == wire &&
+        st.transferAvg == wire, "transfer %u/%u/%u/%u us, wire %u us",
+        st.transferLast, st.transferMin, st.transferMax, st.transferAvg, wire);
+  uint32_t fps = (uint64_t)st.framesTransmitted * 1000000 / (100 * 1000 + wire);
+  CHECK(st.fps == fps, "fps %u, expected %u", st.fps, fps);
+  printf("\n1024 LEDs, %u us wire time, show() every 1 ms\n", wire);
+  printf("  1 buffer:  submitted %u, transmitted %u, dropped %u, %u fps\n",
+         st.framesSubmitted, st.framesTransmitted, st.framesDropped, st.fps);
+
+  // Three buffers: nothing is dropped but frames wait in the queue, so
+  // the show()-to-sent latency grows past the wire time
+  strip.setBufferCount(3);
+  strip.resetStats();
+  for(int f=0; f<100; f++) {
+    strip.show();
+    host_clock_advance(1000);
+  }
+  host_clock_advance(wire * 3);
+  strip.getStats(st);
+  printf("  3 buffers: submitted %u, transmitted %u, dropped %u, coalesced %u, %u fps\n",
+         st.framesSubmitted, st.framesTransmitted, st.framesDropped,
+         st.framesCoalesced, st.fps);
+  printf("  log2 us  ");
+  for(int b=0; b<DOTSTAR_STATS_BINS; b++) printf("%6u", b ? 1u << (b - 1) : 0);
+  printf("\n");
+  printHist("transfer", st.transferHist);
+  printHist("send", st.sendLatencyHist);
+  printHist("render", st.renderHist);
+  uint32_t transfers = 0, latencies = 0, late = 0, renders = 0;
+  for(int b=0; b<DOTSTAR_STATS_BINS; b++) {
+    transfers += st.transferHist[b];
+    latencies += st.sendLatencyHist[b];
+    renders   += st.renderHist[b];
+    if((1u << b) > wire * 2) late += st.sendLatencyHist[b];
+  }
+  // A full ring replaces its newest queued frame: coalesced, not dropped
+  CHECK(st.framesSubmitted == 100 && !st.framesDropped &&
+        st.framesCoalesced == st.framesSubmitted - st.framesTransmitted &&
+        st.framesCoalesced == strip.getCoalescedFrames(),
+        "3 buffers: submitted %u dropped %u coalesced %u (%u) transmitted %u",
+        st.framesSubmitted, st.framesDropped, st.framesCoalesced,
+        strip.getCoalescedFrames(), st.framesTransmitted);
+  // Every show() after the first is 1 ms of "rendering" after the last
+  CHECK(renders == 99 && st.renderHist[32 - __builtin_clz(1000)] == renders,
+        "render histogram holds %u frames, %u in the 1 ms bin", renders,
+        st.renderHist[32 - __builtin_clz(1000)]);
+  CHECK(transfers == st.framesTransmitted && latencies == st.framesTransmitted,
+        "histograms hold %u / %u frames, %u sent", transfers, latencies,
+        st.framesTransmitted);
+  CHECK(st.transferHist[32 - __builtin_clz(wire)] == transfers,
+        "transfer time outside the %u us bin", wire);
+  CHECK(late > 0, "no queued frame took longer than twice the wire time");
+
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  host_clock_simulate(false);
+
+  // Soft SPI and DotStarParallel count too
+  Adafruit_DotStar soft(30, D2, D4), lane(30, D3, D4);
+  DotStarParallel  out;
+  soft.begin();
+  soft.show();
+  soft.show();
+  out.addStrip(lane);
+  out.begin();
+  out.show();
+  soft.getStats(st);
+  CHECK(st.framesSubmitted == 2 && st.framesTransmitted == 2, "soft SPI stats");
+  lane.getStats(st);
+  CHECK(st.framesSubmitted == 1 && st.framesTransmitted == 1, "parallel lane stats");
+#endif
+}
@@ -0,0 +1,192 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: palette-indexed strips (DotStarIndexed).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_indexed.h"
+
+// Palette-indexed strips -----------------------------------------------------
+
+// What a plain strip with the same colors sends: start frame and LEDs from
+// its buffer, then a zero end frame (the one streamed frames use)
+static std::vector<uint8_t> indexedReference(DotStarIndexed &strip) {
+  uint16_t         n = strip.numPixels();
+  Adafruit_DotStar ref(n);
+  ref.setBrightness(strip.getBrightness());
+  for(uint16_t i=0; i<n; i++) ref.setPixelColor(i, strip.getPixelColor(i));
+  std::vector<uint8_t> wire(ref.getPixels(), ref.getPixels() + 4 + n * 4);
+  wire.resize(wire.size() + 1 + n / 8, 0);
+  return wire;
+}
+
+static void indexedPattern(DotStarIndexed &strip, uint32_t seed) {
+  for(uint16_t i=0; i<strip.getPaletteSize(); i++)
+    strip.setPaletteColor(i, (i * 0x3A1F27 + seed) & 0xFFFFFF);
+  for(uint16_t i=0; i<strip.numPixels(); i++)
+    strip.setPixelIndex(i, (i * 7 + (i >> 3) + seed) & 0xFF);
+}
+
+static void indexedChecks(void) {
+  for(DotStarIndexBits bits : { DOTSTAR_INDEX_8BIT, DOTSTAR_INDEX_4BIT }) {
+    // streamed over hardware SPI, callbacks inside transfer() and later
+    for(uint16_t n : { 1, 31, 32, 33, 100, 1000 }) {
+      for(int deferred=0; deferred<2; deferred++) {
+        DotStarIndexed strip(n, bits);
+        strip.begin();
+        indexedPattern(strip, n);
+        SPI.hostReset();
+        SPI.hostSetCompletion(deferred ? SPIClass::DEFERRED : SPIClass::IMMEDIATE);
+        strip.show();
+        while(strip.isShowing()) host_dma_complete();
+        SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+        CHECK(SPI.wire == indexedReference(strip) && SPI.largest <= 4 + DOTSTAR_INDEXED_CHUNK * 4,
+              "%u bit, %u LEDs, deferred %d: streamed frame differs (%zu bytes, %zu largest)",
+              bits, n, deferred, SPI.wire.size(), SPI.largest);
+      }
+    }
+
+    // soft SPI and full frame send the same
+    DotStarIndexed soft(100, D2, D4, bits), full(100, bits, true);
+    soft.begin();
+    full.begin();
+    indexedPattern(soft, 5);
+    indexedPattern(full, 5);
+    host_gpio_probe(D4);
+    soft.show();
+    CHECK(host_gpio_bytes(D2) == indexedReference(soft), "%u bit: soft SPI stream differs", bits);
+    showWire(full);
+    std::vector<uint8_t> ref = indexedReference(full);
+    CHECK(!full.isStreamed() && SPI.wire.size() == frameBytes(100) &&
+          !memcmp(SPI.wire.data(), ref.data(), 4 + 100 * 4),
+          "%u bit: full frame differs", bits);
+
+    // palette changes and brightness reach the next show()
+    full.rotatePalette(0, full.getPaletteSize(), 3);
+    full.setBrightness(40);
+    showWire(full);
+    ref = indexedReference(full);
+    CHECK(!memcmp(SPI.wire.data(), ref.data(), 4 + 100 * 4) && SPI.wire[4] == 0xE0 + (40 >> 3),
+          "%u bit: rotated palette or brightness missing from the frame", bits);
+
+    // through an Adafruit_DotStar& (showAll(), the modules) the indexes
+    // still expand, streamed or not
+    DotStarIndexed    streamed(100, bits);
+    Adafruit_DotStar *one[1] = { &streamed };
+    Adafruit_DotStar &base   = full;
+    streamed.begin();
+    indexedPattern(streamed, 9);
+    indexedPattern(full, 9);
+    SPI.hostReset();
+    Adafruit_DotStar::showAll(one, 1, true);
+    bool viaAll = SPI.wire == indexedReference(streamed);
+    showWire(base);
+    ref = indexedReference(full);
+    CHECK(viaAll && SPI.wire.size() == frameBytes(100) &&
+          !memcmp(SPI.wire.data(), ref.data(), 4 + 100 * 4),
+          "%u bit: show() through the base class differs (showAll %d)", bits, viaAll);
+
+    // a streamed frame can't be limited, and can't share parallel lanes
+    DotStarParallel lanes;
+    CHECK(!streamed.setPowerLimit(1000) && !streamed.getPowerLimit() &&
+          full.setPowerLimit(100000) && full.setPowerLimit(0) && !lanes.addStrip(soft),
+          "%u bit: power limit or parallel lane accepted", bits);
+
+    // fills match per-LED writes, nibble boundaries included
+    DotStarIndexed a(50, bits), b(50, bits);
+    for(uint16_t first : { 0, 1, 2, 7 }) {
+      for(uint16_t count : { 1, 2, 3, 10, 0 }) {
+        a.fillIndex(9, first, count);
+        for(uint16_t i=first; i<(count ? first + count : 50); i++) b.setPixelIndex(i, 9);
+        bool same = true;
+        for(uint16_t i=0; i<50; i++) same &= (a.getPixelIndex(i) == b.getPixelIndex(i));
+        CHECK(same, "%u bit: fillIndex(9, %u, %u) differs", bits, first, count);
+        a.fillIndex(bits == 8 ? 200 : 6);
+        b.fillIndex(bits == 8 ? 200 : 6);
+      }
+    }
+  }
+
+  // rotation moves entry k to k + step
+  DotStarIndexed strip(16, DOTSTAR_INDEX_4BIT);
+  for(uint16_t i=0; i<16; i++) {
+    strip.setPaletteColor(i, i);
+    strip.setPixelIndex(i, i);
+  }
+  strip.rotatePalette(1, 15, 4);
+  bool rotated = strip.getPixelColor(0) == 0;
+  for(uint16_t i=1; i<16; i++) rotated &= (strip.getPixelColor(1 + (i - 1 + 4) % 15) == i);
+  CHECK(rotated, "rotatePalette(1, 15, 4)");
+}
+
+// Bytes a strip allocates: its frame, or indexes + palette + ping-pong
+// buffer + the empty frame of the base strip
+static size_t indexedBytes(uint16_t n, int kind) {
+  size_t pingPong = 4 + 2 * DOTSTAR_INDEXED_CHUNK * 4, empty = DOTSTAR_FRAME_BYTES(0);
+  switch(kind) {
+    case 0:  return DOTSTAR_FRAME_BYTES(n);
+    case 1:  return n + 256 * 4 + pingPong + empty;
+    default: return (n + 1) / 2 + 16 * 4 + pingPong + empty;
+  }
+}
+
+void benchIndexed(void) {
+  indexedChecks();
+
+  header("Palette-indexed strips, RAM", "bytes");
+  const char *kinds[] = { "Adafruit_DotStar (4 bytes/LED)", "DotStarIndexed 8 bit",
+                          "DotStarIndexed 4 bit" };
+  for(int kind=0; kind<3; kind++) {
+    printf("%-34s", kinds[kind]);
+    for(uint16_t n : sizes) printf("%10zu", indexedBytes(n, kind));
+    printf("\n");
+  }
+
+  // the heap agrees (the palette and ping-pong blocks may come from
+  // malloc's small-block cache, which it doesn't count)
+  SPI.hostSetCapture(false);
+  SPI.hostReset();
+  for(int kind=1; kind<3; kind++) {
+    size_t before = heapInUse();
+    DotStarIndexed strip(8192, kind == 1 ? DOTSTAR_INDEX_8BIT : DOTSTAR_INDEX_4BIT);
+    size_t used = heapInUse() - before;
+    CHECK(used >= (kind == 1 ? 8192u : 4096u) && used < indexedBytes(8192, kind) + 128,
+          "%s, 8192 LEDs: %zu heap bytes", kinds[kind], used);
+  }
+
+  header("Palette-indexed show(), CPU", "ns/LED");
+  const char *names[] = {
+    "Adafruit_DotStar show()", "indexed 8 bit, streamed", "indexed 4 bit, streamed",
+    "indexed 8 bit, full frame", "recolor: setPixelColor() + show()",
+    "recolor: rotatePalette() + show()"
+  };
+  SPI.hostSetCapture(false);
+  for(int api=0; api<6; api++) {
+    printf("%-34s", names[api]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar plain(n);
+      DotStarIndexed   strip(n, api == 2 ? DOTSTAR_INDEX_4BIT : DOTSTAR_INDEX_8BIT, api == 3);
+      plain.begin();
+      strip.begin();
+      fillPattern(plain);
+      indexedPattern(strip, 1);
+      uint8_t t = 0;
+      double ns = timeIt(n, [&] {
+        switch(api) {
+          case 0: plain.show(); break;
+          case 4:
+            // a scrolling 256-color wheel, recomputed per LED
+            t++;
+            for(uint16_t i=0; i<n; i++) plain.setPixelColor(i, strip.getPaletteColor((i + t) & 0xFF));
+            plain.show();
+            break;
+          case 5: strip.rotatePalette(0, 256); strip.show(); break;
+          default: strip.setPaletteColor(0, t++); strip.show(); break;
+        }
+      });
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+  SPI.hostSetCapture(true);
+}
@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: pixel math kernels (DotStarKernels).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_kernels.h"
+
+// Pixel math kernels ---------------------------------------------------------
+
+// Per-byte definitions from dotstar_kernels.h
+static uint8_t refScale(uint8_t c, uint8_t f)  { return (c * (f + 1)) >> 8; }
+static uint8_t refAdd(uint8_t c, uint8_t s)    { return (c + s > 255) ? 255 : c + s; }
+static uint8_t refAverage(uint8_t c, uint8_t s) { return (c + s) >> 1; }
+static uint8_t refBlend(uint8_t a, uint8_t b, uint8_t t) {
+  return (a * (256 - t) + b * t) >> 8;
+}
+
+static void kernelChecks(void) {
+  static const uint16_t counts[] = { 0, 1, 3, 4, 5, 17, 1023 };
+  uint32_t seed = 12345;
+  auto rnd = [&] { seed = seed * 1103515245 + 12345; return (uint8_t)(seed >> 16); };
+
+  for(uint16_t n : counts) {
+    for(int align=0; align<2; align++) {    // caller storage need not be aligned
+      std::vector<uint8_t> bufA(n * 4 + 1), bufB(n * 4 + 1), bufC(n * 4 + 1), out(n * 4 + 1);
+      uint8_t *a = &bufA[align], *b = &bufB[align], *c = &bufC[align], *d = &out[align];
+      for(uint32_t i=0; i<n*4u; i++) { a[i] = rnd(); b[i] = rnd(); c[i] = rnd(); }
+      // extremes, so saturation and the rounding of every lane are hit
+      if(n >= 4) { memset(a, 0xFF, 8); memset(b, 0xFF, 4); memset(b + 4, 0, 4); }
+      uint8_t f = rnd(), f1 = rnd(), f2 = rnd(), f3 = rnd(), t = rnd();
+      bool ok[5] = { true, true, true, true, true };
+
+      memcpy(d, a, n * 4);
+      DotStarKernels::scale(d, n, f);
+      for(uint32_t i=0; i<n*4u; i++) ok[0] &= d[i] == ((i & 3) ? refScale(a[i], f) : a[i]);
+
+      memcpy(d, a, n * 4);
+      DotStarKernels::scale(d, n, f1, f2, f3);
+      const uint8_t fs[4] = { 0, f1, f2, f3 };
+      for(uint32_t i=0; i<n*4u; i++) ok[1] &= d[i] == ((i & 3) ? refScale(a[i], fs[i & 3]) : a[i]);
+
+      memcpy(d, a, n * 4);
+      DotStarKernels::add(d, b, n);
+      for(uint32_t i=0; i<n*4u; i++) ok[2] &= d[i] == ((i & 3) ? refAdd(a[i], b[i]) : a[i]);
+
+      memcpy(d, a, n * 4);
+      DotStarKernels::average(d, b, n);
+      for(uint32_t i=0; i<n*4u; i++) ok[3] &= d[i] == ((i & 3) ? refAverage(a[i], b[i]) : a[i]);
+
+      memcpy(d, c, n * 4);                  // header comes from the destination
+      DotStarKernels::blend(d, a, b, n, t);
+      for(uint32_t i=0; i<n*4u; i++) ok[4] &= d[i] == ((i & 3) ? refBlend(a[i], b[i], t) : c[i]);
+
+      const char *names[] = { "scale", "scale(f1,f2,f3)", "add", "average", "blend" };
+      for(int k=0; k<5; k++) CHECK(ok[k], "%s differs from reference, n=%u align=%d", names[k], n, align);
+    }
+  }
+
+  // in place, and blend endpoints
+  uint8_t x[8] = { 0xE1, 10, 20, 30, 0xE1, 200, 100, 50 }, y[8];
+  memcpy(y, x, 8);
+  DotStarKernels::blend(y, y, x, 2, 0);
+  CHECK(!memcmp(x, y, 8), "blend t=0 is not a");
+  DotStarKernels::add(y, y, 2);
+  CHECK(y[0] == 0xE1 && y[1] == 20 && y[5] == 255 && y[7] == 100, "add in place");
+
+  // strip versions follow the color order and mark the strip changed
+  Adafruit_DotStar s(10, DOTSTAR_BGR), o(6, DOTSTAR_BGR);
+  s.begin(); o.begin();
+  s.setPartialShow(true);
+  s.fill(0x804020);
+  s.show();
+  DotStarKernels::scale(s, 255, 127, 0);
+  CHECK(s.getPixelColor(9) == 0x802000, "strip scale: %06x", (unsigned)s.getPixelColor(9));
+  DotStarKernels::fade(s, 127);
+  CHECK(s.getPixelColor(0) == 0x401000, "strip fade: %06x", (unsigned)s.getPixelColor(0));
+  o.fill(0xF0F0F0);
+  DotStarKernels::add(s, o);
+  CHECK(s.getPixelColor(5) == 0xFFFFF0 && s.getPixelColor(6) == 0x401000, "strip add");
+  s.show();
+  SPI.hostReset();
+  DotStarKernels::average(s, o);            // the first 6 of 10
+  s.show();
+  CHECK(SPI.wire.size() >= 4 + 6 * 4 && !memcmp(SPI.wire.data() + 4 + 5 * 4, s.getPixels() + 4 + 5 * 4, 4),
+        "strip kernels did not mark the strip changed");
+
+  // dithered 16-bit pixels go out as the kernels left them: the same wire
+  // as a strip set to the 8-bit colors
+  Adafruit_DotStar wide(4, DOTSTAR_BGR), narrow(4, DOTSTAR_BGR);
+  wide.begin(); narrow.begin();
+  wide.setOutputMode(DOTSTAR_OUTPUT_DITHER);
+  narrow.setOutputMode(DOTSTAR_OUTPUT_DITHER);
+  for(uint16_t i=0; i<4; i++) {
+    wide.setPixelColor16(i, 65535, 32768 + i, 4096);
+    narrow.setPixelColor(i, 255, 128, 16);
+  }
+  DotStarKernels::fade(wide, 0);
+  std::vector<uint8_t> faded = showWire(wide);
+  CHECK(faded.size() >= 4 + 4 * 4 && !faded[5] && !faded[6] && !faded[7],
+        "fade(0) of a 16-bit pixel sent %02x %02x %02x", faded[5], faded[6], faded[7]);
+  for(uint16_t i=0; i<4; i++) wide.setPixelColor16(i, 65535, 32768 + i, 4096);
+  DotStarKernels::fade(wide, 127);
+  DotStarKernels::fade(narrow, 127);
+  DotStarKernels::add(wide, o);
+  DotStarKernels::add(narrow, o);
+  std::vector<uint8_t> w8 = showWire(narrow);
+  CHECK(showWire(wide) == w8, "16-bit pixels after fade + add differ on the wire");
+
+  // with the limiter on, the strip versions keep its sums (no recount)
+  Adafruit_DotStar big(64, DOTSTAR_GRB), src(60, DOTSTAR_GRB);
+  big.begin(); src.begin();
+  fillPattern(big);
+  fillPattern(src);
+  bool tracked = true;
+  for(int k=0; k<5; k++) {
+    tracked &= powerTracked(big, 63, [&] {
+      switch(k) {
+        case 0: DotStarKernels::add(big, src); break;
+        case 1: DotStarKernels::average(big, src); break;
+        case 2: DotStarKernels::blend(big, src, src, 100); break;
+        case 3: DotStarKernels::fade(src, 200); DotStarKernels::add(big, src); break;
+        case 4: DotStarKernels::scale(src, 10, 200, 90); DotStarKernels::average(big, src); break;
+      }
+    });
+    CHECK(tracked, "kernel %d: recounted or miscounted", k);
+  }
+}
+
+void benchKernels(void) {
+  kernelChecks();
+
+#if defined(__SSE2__) && !defined(DOTSTAR_NO_SIMD)
+  header("Pixel kernels (SSE2)", "ns/pixel");
+#else
+  header("Pixel kernels (portable)", "ns/pixel");
+#endif
+  const char *names[] = {
+    "fade, get/setPixelColor() loop", "fade, DotStarKernels",
+    "scale(r,g,b), get/set loop", "scale(r,g,b), DotStarKernels",
+    "add, get/setPixelColor() loop", "add, DotStarKernels",
+    "crossfade, get/set loop", "crossfade, DotStarKernels"
+  };
+  for(int api=0; api<8; api++) {
+    printf("%-34s", names[api]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n), a(n), b(n);
+      strip.begin(); a.begin(); b.begin();
+      fillPattern(a);
+      fillPattern(b);
+      strip.fill(0x808080);
+      uint8_t t = 0;
+      double ns = timeIt(n, [&] {
+        t += 7;
+        switch(api) {
+          case 0:
+            for(uint16_t i=0; i<n; i++) {
+              uint32_t c = strip.getPixelColor(i);
+              strip.setPixelColor(i, ((c >> 16) & 0xFF) * (t + 1) >> 8,
+                                     ((c >>  8) & 0xFF) * (t + 1) >> 8,
+                                     ( c        & 0xFF) * (t + 1) >> 8);
+            }
+            break;
+          case 1: DotStarKernels::fade(strip, t); break;
+          case 2:
+            for(uint16_t i=0; i<n; i++) {
+              uint32_t c = strip.getPixelColor(i);
+              strip.setPixelColor(i, ((c >> 16) & 0xFF) * 256 >> 8,
+                                     ((c >>  8) & 0xFF) * (t + 1) >> 8,
+                                     ( c        & 0xFF) * 128 >> 8);
+            }
+            break;
+          case 3: DotStarKernels::scale(strip, 255, t, 127); break;
+          case 4:
+            for(uint16_t i=0; i<n; i++) {
+              uint32_t c = strip.getPixelColor(i), d = a.getPixelColor(i);
+              uint16_t r = ((c >> 16) & 0xFF) + ((d >> 16) & 0xFF),
+                       g = ((c >>  8) & 0xFF) + ((d >>  8) & 0xFF),
+                       bl = (c & 0xFF) + (d & 0xFF);
+              strip.setPixelColor(i, r > 255 ? 255 : r, g > 255 ? 255 : g,
+                                     bl > 255 ? 255 : bl);
+            }
+            break;
+          case 5: DotStarKernels::add(strip, a); break;
+          case 6:
+            for(uint16_t i=0; i<n; i++) {
+              uint32_t c = a.getPixelColor(i), d = b.getPixelColor(i);
+              strip.setPixelColor(i,
+                (((c >> 16) & 0xFF) * (256 - t) + ((d >> 16) & 0xFF) * t) >> 8,
+                (((c >>  8) & 0xFF) * (256 - t) + ((d >>  8) & 0xFF) * t) >> 8,
+                (( c        & 0xFF) * (256 - t) + ( d        & 0xFF) * t) >> 8);
+            }
+            break;
+          case 7: DotStarKernels::blend(strip, a, b, t); break;
+        }
+        sink += strip.getPixels()[5];
+      });
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+}
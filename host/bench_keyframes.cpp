@@ -0,0 +1,195 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: keyframe interpolation (DotStarKeyframes).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_keyframes.h"
+
+// Keyframe interpolation -------------------------------------------------------
+
+static uint32_t keyColor(uint32_t seed, uint16_t i) {
+  uint32_t x = (seed + i) * 2654435761u;
+  return (x ^ (x >> 13)) & 0xFFFFFF;
+}
+
+// Run a 2-key transition of 'frames' frames over 'n' LEDs and compare
+// every frame with the eased value worked out in floating point
+static bool keyframesExact(DotStarEase e, uint16_t frames, uint16_t n) {
+  Adafruit_DotStar strip(n, DOTSTAR_BGR);
+  DotStarKeyframes keys(strip);
+  if(!keys.begin(2)) return false;
+  std::vector<uint32_t> a(n), b(n);
+  for(uint16_t i=0; i<n; i++) {
+    a[i] = keyColor(frames, i);
+    b[i] = (i % 4) ? keyColor(frames + 7, i) : a[i];
+  }
+  keys.setKey(0, a.data());
+  keys.setKey(1, b.data());
+  keys.setTransition(1, frames, e);
+
+  uint32_t len = frames ? frames : 1;       // a cut takes one frame
+  bool     ok  = keys.step();               // key 0
+  for(uint32_t f=1; f<=len; f++) {
+    ok &= keys.step();
+    double t = DotStarKeyframes::ease(e, (f << 16) / len) / 65536.0;
+    for(uint16_t i=0; i<n; i++) {
+      uint32_t got = strip.getPixelColor(i);
+      for(int s=0; s<24; s += 8) {
+        double from = (a[i] >> s) & 0xFF, to = (b[i] >> s) & 0xFF,
+               want = from + (to - from) * t;
+        ok &= fabs(((got >> s) & 0xFF) - want) <= 1.0;
+      }
+      if(f == len) ok &= got == b[i];
+    }
+  }
+  return ok && !keys.step() && keys.isDone();
+}
+
+static void keyframesChecks(void) {
+  const DotStarEase eases[] = { DOTSTAR_EASE_LINEAR, DOTSTAR_EASE_IN,
+                                DOTSTAR_EASE_OUT, DOTSTAR_EASE_IN_OUT };
+  for(DotStarEase e : eases)
+    for(uint16_t frames : { 0, 1, 3, 8, 9, 100, 1000 })
+      CHECK(keyframesExact(e, frames, 40), "ease %d over %u frames off by more than 1",
+            e, frames);
+  CHECK(DotStarKeyframes::ease(DOTSTAR_EASE_IN_OUT, 32768) == 32768 &&
+        DotStarKeyframes::ease(DOTSTAR_EASE_IN, 65536) == 65536 &&
+        DotStarKeyframes::ease(DOTSTAR_EASE_OUT, 0) == 0, "easing end points");
+
+  // only pixels that differ take part; the rest are never written again
+  const uint16_t n = 60;
+  Adafruit_DotStar strip(n, DOTSTAR_GRB);
+  DotStarKeyframes keys(strip);
+  CHECK(!keys.begin(1) && !keys.begin(2, n), "begin() with 1 key or past the strip");
+  CHECK(keys.begin(3), "begin(3) failed");
+  keys.fillKey(0, 0x000010);
+  keys.fillKey(1, 0x000010);
+  keys.fillKey(2, 0x000010);
+  for(uint16_t i=5; i<15; i++) keys.setKeyPixel(1, i, 0xFF8000);
+  keys.setTransition(1, 10);
+  keys.setTransition(2, 5, DOTSTAR_EASE_OUT);
+  keys.step();
+  CHECK(keys.getActive() == 10 && keys.getKey() == 1, "%u active pixels", keys.getActive());
+  strip.setPixelColor(30, 0x123456);
+  uint32_t steps = 1;
+  while(keys.step()) steps++;
+  CHECK(steps == 16 && strip.getPixelColor(30) == 0x123456 &&
+        strip.getPixelColor(5) == 0x000010 && keys.getKey() == 2,
+        "%u steps, pixel 30 %06x", steps, (unsigned)strip.getPixelColor(30));
+
+  // looping comes back round to key 0
+  keys.setLoop(true);
+  keys.setTransition(0, 4);
+  keys.fillKey(2, 0x400000);
+  keys.rewind();
+  for(int i=0; i<1 + 10 + 5; i++) keys.step();
+  CHECK(strip.getPixelColor(0) == 0x400000, "key 2 not reached: %06x",
+        (unsigned)strip.getPixelColor(0));
+  for(int i=0; i<4; i++) keys.step();
+  CHECK(!keys.isDone() && keys.getKey() == 1 && strip.getPixelColor(0) == 0x000010,
+        "loop to key 0: key %u, %06x", keys.getKey(), (unsigned)strip.getPixelColor(0));
+  keys.end();
+
+  // segments run on their own and leave the rest of the strip alone
+  strip.fill(0x010203);
+  DotStarKeyframes left(strip), right(strip);
+  left.begin(2, 0, 20);
+  right.begin(2, 40);
+  left.fillKey(1, 0xFF0000);
+  right.fillKey(1, 0x0000FF);
+  left.setTransition(1, 3);
+  right.setTransition(1, 6);
+  for(int i=0; i<4; i++) left.step();
+  for(int i=0; i<7; i++) right.step();
+  bool kept = true;
+  for(uint16_t i=20; i<40; i++) kept &= strip.getPixelColor(i) == 0x010203;
+  CHECK(kept && strip.getPixelColor(19) == 0xFF0000 && strip.getPixelColor(40) == 0x0000FF &&
+        strip.getPixelColor(59) == 0x0000FF && left.isDone() && right.isDone(),
+        "segments: %06x %06x", (unsigned)strip.getPixelColor(19), (unsigned)strip.getPixelColor(40));
+
+  // partial show sends up to the last changing pixel only
+  strip.setPartialShow(true);
+  strip.begin();
+  strip.show();
+  left.fillKey(0, 0xFF0000);
+  left.setKeyPixel(1, 7, 0x00FF00);
+  left.rewind();
+  left.step();
+  strip.show();
+  SPI.hostReset();
+  left.step();
+  strip.show();
+  CHECK(SPI.wire.size() == frameBytes(8),
+        "partial show sent %u bytes", (unsigned)SPI.wire.size());
+  strip.setPartialShow(false);
+
+  // the power limiter follows without a recount
+  strip.setPowerLimit(1000000);
+  strip.show();
+  left.setTransition(1, 50, DOTSTAR_EASE_IN_OUT);
+  left.fillKey(1, 0x804020);
+  left.rewind();
+  for(int i=0; i<20; i++) left.step();
+  strip.show();
+  CHECK(strip.getPowerEstimate() == powerOf(strip, n, 31), "power estimate %u, recount %u",
+        strip.getPowerEstimate(), powerOf(strip, n, 31));
+  strip.setPowerLimit(0);
+
+  // dithering gets the 8.8 values as 16-bit pixels
+  strip.setOutputMode(DOTSTAR_OUTPUT_DITHER);
+  right.fillKey(0, 0);
+  right.fillKey(1, 0x000003);
+  right.setTransition(1, 4);
+  right.rewind();
+  right.step();
+  right.step();
+  const uint16_t *wide = strip.getPixels16();
+  CHECK(wide && strip.getPixels()[4 + 40 * 4] == 0 && wide[40 * 3 + 2] == 0xC0,
+        "16-bit pixel %04x", wide ? wide[40 * 3 + 2] : 0);
+  strip.setOutputMode(DOTSTAR_OUTPUT_DIRECT);
+}
+
+void benchKeyframes(void) {
+  keyframesChecks();
+
+  header("Keyframes, one frame", "ns/pixel");
+  const char *names[] = { "step(), linear", "step(), ease in-out",
+                          "step(), 1 in 10 pixels changing", "float lerp + setPixelColor()" };
+  for(int row=0; row<4; row++) {
+    printf("%-34s", names[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      DotStarKeyframes keys(strip);
+      keys.begin(2);
+      for(uint16_t i=0; i<n; i++) {
+        keys.setKeyPixel(0, i, keyColor(1, i));
+        keys.setKeyPixel(1, i, (row == 2 && i % 10) ? keyColor(1, i) : keyColor(2, i));
+      }
+      keys.setTransition(0, 60000);
+      keys.setTransition(1, 60000, row == 1 ? DOTSTAR_EASE_IN_OUT : DOTSTAR_EASE_LINEAR);
+      keys.setLoop(true);
+      double ns;
+      if(row < 3) ns = timeIt(n, [&] { keys.step(); });
+      else {
+        // what a sketch does without the engine: every pixel, every frame
+        uint32_t frame = 0;
+        ns = timeIt(n, [&] {
+          float t = (frame++ % 60000) / 60000.0f;
+          t = t * t * (3 - 2 * t);
+          for(uint16_t i=0; i<n; i++) {
+            uint32_t a = keyColor(1, i), b = keyColor(2, i);
+            uint8_t  c[3];
+            for(int s=0; s<3; s++) {
+              float from = (a >> (16 - s * 8)) & 0xFF, to = (b >> (16 - s * 8)) & 0xFF;
+              c[s] = (uint8_t)(from + (to - from) * t + 0.5f);
+            }
+            strip.setPixelColor(i, c[0], c[1], c[2]);
+          }
+        });
+      }
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+}
@@ -0,0 +1,144 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: matrix mapping and segments (DotStarMatrix).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_matrix.h"
+
+// Matrix mapping and segments ------------------------------------------------
+
+// Every LED exactly once in the matrix table?
+static bool isPermutation(const DotStarMatrix &m, uint16_t leds) {
+  std::vector<uint8_t> seen(leds, 0);
+  for(uint16_t y=0; y<m.height(); y++) {
+    for(uint16_t x=0; x<m.width(); x++) {
+      uint16_t i = m.index(x, y);
+      if(i >= leds || seen[i]++) return false;
+    }
+  }
+  return true;
+}
+
+static void matrixChecks(void) {
+  Adafruit_DotStar strip(12);
+  strip.begin();
+
+  // every wiring and view maps the panel onto the strip one to one
+  for(uint8_t layout=0; layout<16; layout++) {
+    DotStarMatrix m(strip, 4, 3, layout);
+    for(uint8_t r=0; r<4; r++) {
+      m.setRotation(r);
+      m.setFlip(r & 1, r & 2);
+      CHECK(m.width() == ((r & 1) ? 3 : 4) && m.height() == ((r & 1) ? 4 : 3),
+            "layout %u rotation %u: %ux%u", layout, r, m.width(), m.height());
+      CHECK(isPermutation(m, 12), "layout %u rotation %u: not a permutation", layout, r);
+    }
+  }
+
+  // known serpentine wirings of a 4x3 panel
+  DotStarMatrix rows(strip, 4, 3, DOTSTAR_MATRIX_TOP + DOTSTAR_MATRIX_LEFT +
+                     DOTSTAR_MATRIX_ROWS + DOTSTAR_MATRIX_ZIGZAG);
+  CHECK(rows.index(0, 0) == 0 && rows.index(3, 0) == 3 && rows.index(0, 1) == 7 &&
+        rows.index(3, 1) == 4 && rows.index(0, 2) == 8, "rows zigzag");
+  DotStarMatrix cols(strip, 4, 3, DOTSTAR_MATRIX_BOTTOM + DOTSTAR_MATRIX_RIGHT +
+                     DOTSTAR_MATRIX_COLUMNS + DOTSTAR_MATRIX_ZIGZAG);
+  CHECK(cols.index(3, 2) == 0 && cols.index(3, 0) == 2 && cols.index(2, 0) == 3 &&
+        cols.index(2, 2) == 5 && cols.index(0, 2) == 11, "columns zigzag");
+  rows.setRotation(1);                      // (0,0) is now the top right LED
+  CHECK(rows.index(0, 0) == 3 && rows.index(2, 0) == 11 && rows.index(0, 3) == 0,
+        "rotation 1");
+  rows.setRotation(0);
+  rows.setFlip(true, false);
+  CHECK(rows.index(0, 0) == 3 && rows.index(0, 1) == 4, "flip x");
+  CHECK(rows.index(4, 0) == DOTSTAR_NO_LED, "outside the panel");
+
+  // user map with a hole, and LEDs past the end of the strip left out
+  static const uint16_t map[6] = { 5, 4, DOTSTAR_NO_LED, 0, 1, 20 };
+  DotStarMatrix user(strip, 3, 2, map);
+  CHECK(user.index(0, 0) == 5 && user.index(2, 0) == DOTSTAR_NO_LED &&
+        user.index(1, 1) == 1 && user.index(2, 1) == DOTSTAR_NO_LED, "user map");
+  user.setRotation(2);
+  CHECK(user.index(2, 1) == 5 && user.index(0, 0) == DOTSTAR_NO_LED, "user map rotated");
+
+  // fillRect() and setXY() write the same frame bytes
+  Adafruit_DotStar a(16 * 16, DOTSTAR_GRB), b(16 * 16, DOTSTAR_GRB);
+  a.begin(); b.begin();
+  a.setBrightness(100); b.setBrightness(100);
+  DotStarMatrix ma(a, 16, 16, DOTSTAR_MATRIX_ZIGZAG + DOTSTAR_MATRIX_COLUMNS),
+                mb(b, 16, 16, DOTSTAR_MATRIX_ZIGZAG + DOTSTAR_MATRIX_COLUMNS);
+  ma.setRotation(3); mb.setRotation(3);
+  ma.fillRect(3, 5, 9, 20, 0x123456);       // clipped at the bottom
+  for(uint16_t y=5; y<16; y++)
+    for(uint16_t x=3; x<12; x++) mb.setXY(x, y, 0x123456);
+  CHECK(!memcmp(a.getPixels(), b.getPixels(), 16 * 16 * 4), "fillRect != setXY loop");
+  CHECK(ma.getXY(3, 5) == 0x123456 && ma.getXY(2, 5) == 0, "getXY");
+  ma.fillRow(0, 0xFF0000);
+  ma.fillColumn(15, 0x0000FF);
+  CHECK(ma.getXY(0, 0) == 0xFF0000 && ma.getXY(15, 0) == 0x0000FF &&
+        ma.getXY(15, 15) == 0x0000FF, "fillRow/fillColumn");
+
+  // segments of one strip
+  Adafruit_DotStar s(20);
+  s.begin();
+  DotStarSegment segs[] = {
+    DotStarSegment(s, 0, 8, "roof"), DotStarSegment(s, 8, 12, "door", true)
+  };
+  DotStarSegment *door = DotStarSegment::find(segs, 2, "door");
+  CHECK(door == &segs[1] && !DotStarSegment::find(segs, 2, "wall"), "find");
+  door->setPixelColor(0, 0x010203);
+  door->setPixelColor(12, 0xFFFFFF);        // past the segment: ignored
+  segs[0].fill(0x00FF00);
+  CHECK(s.getPixelColor(19) == 0x010203 && door->getPixelColor(0) == 0x010203 &&
+        s.getPixelColor(7) == 0x00FF00 && s.getPixelColor(8) == 0, "segments");
+}
+
+void benchMatrix(void) {
+  matrixChecks();
+
+  printf("\n%-34s%10s%10s%10s   %s\n", "Matrix 16x16 .. 128x64", "16x16",
+         "64x64", "128x64", "ns/pixel");
+  static const uint16_t dims[][2] = { { 16, 16 }, { 64, 64 }, { 128, 64 } };
+  const char *names[] = {
+    "serpentine math + setPixelColor()", "setXY() (index table)",
+    "rotated serpentine math + setPixel", "setXY(), rotated view", "fillRect()"
+  };
+  for(int api=0; api<5; api++) {
+    printf("%-34s", names[api]);
+    for(const uint16_t *d : dims) {
+      uint16_t w = d[0], h = d[1];
+      Adafruit_DotStar strip(w * h);
+      strip.begin();
+      DotStarMatrix m(strip, w, h, DOTSTAR_MATRIX_ZIGZAG);
+      if(api == 3) m.setRotation(1);
+      uint16_t vw = m.width(), vh = m.height();
+      uint32_t c = 0;
+      double ns = timeIt(w * h, [&] {
+        c += 0x010101;
+        switch(api) {
+          case 0:
+            for(uint16_t y=0; y<h; y++)
+              for(uint16_t x=0; x<w; x++)
+                strip.setPixelColor(y * w + ((y & 1) ? (w - 1 - x) : x), c);
+            break;
+          case 2:                           // view (x, y) is panel (w-1-y, x)
+            for(uint16_t y=0; y<w; y++)
+              for(uint16_t x=0; x<h; x++)
+                strip.setPixelColor(x * w + ((x & 1) ? y : (w - 1 - y)), c);
+            break;
+          case 1:
+          case 3:
+            for(uint16_t y=0; y<vh; y++)
+              for(uint16_t x=0; x<vw; x++) m.setXY(x, y, c);
+            break;
+          case 4:
+            m.fillRect(0, 0, w, h, c);
+            break;
+        }
+        sink += strip.getPixels()[4];
+      });
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+}
@@ -0,0 +1,116 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: parallel soft SPI (DotStarParallel).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar.h"
+
+// Parallel soft SPI (DotStarParallel) ---------------------------------------
+
+// Per-lane frames of 'out' as decoded from the probed clock, checked against
+// each strip's buffer followed by 0xFF padding up to the longest frame.
+static bool checkLanes(Adafruit_DotStar **strips, const pin_t *data,
+                       uint8_t lanes, const char *label) {
+  uint32_t longest = 0;
+  for(uint8_t i=0; i<lanes; i++)
+    longest = std::max(longest, frameBytes(strips[i]->numPixels()));
+  bool ok = true;
+  for(uint8_t i=0; i<lanes; i++) {
+    std::vector<uint8_t> out = host_gpio_bytes(data[i]),
+                         want(strips[i]->getPixels(),
+                              strips[i]->getPixels() + frameBytes(strips[i]->numPixels()));
+    want.resize(longest, 0xFF);
+    if(out != want) {
+      CHECK(false, "%s: lane %u differs from its strip", label, i);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void benchParallel(void) {
+  // D0-D3 share port B with the D4 clock; D5-D7/A3-A7 are all on port A
+  const pin_t portB[] = { D0, D1, D2, D3 },
+              portA[] = { D5, D6, D7, A3, A4, A5, A6, A7 };
+  struct { const char *name; const pin_t *data; uint8_t lanes; } configs[] = {
+    { "4 lanes, clock on same port", portB, 4 },
+    { "8 lanes, clock on other port", portA, 8 } };
+
+  header("DotStarParallel show(), all lanes", "bytes/us");
+  double writesPerBit[2] = { 0 }, sequential[2] = { 0 };
+  for(int c=0; c<2; c++) {
+    printf("%-34s", configs[c].name);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar *strips[8];
+      DotStarParallel   out;
+      for(uint8_t i=0; i<configs[c].lanes; i++) {
+        strips[i] = new Adafruit_DotStar(n, configs[c].data[i], D4,
+                                         i & 1 ? DOTSTAR_GRB : DOTSTAR_BGR);
+        CHECK(out.addStrip(*strips[i]), "addStrip lane %u", i);
+      }
+      CHECK(out.begin(), "begin()");
+      for(uint8_t i=0; i<configs[c].lanes; i++) {
+        for(uint16_t p=0; p<n; p++)
+          strips[i]->setPixelColor(p, (uint8_t)(p * 7 + i), (uint8_t)(p * 13 - i),
+                                   (uint8_t)(p * 29 ^ (i << 4)));
+      }
+
+      host_gpio_probe(D4);
+      out.show();
+      CHECK(host_gpio_edges() == frameBytes(n) * 8, "%s: %u clock edges",
+            configs[c].name, host_gpio_edges());
+      checkLanes(strips, configs[c].data, configs[c].lanes, configs[c].name);
+      writesPerBit[c] = (double)host_gpio_writes() / host_gpio_edges();
+
+      host_gpio_reset();
+      uint32_t bytes = frameBytes(n) * configs[c].lanes;
+      double ns = timeIt(bytes, [&] { out.show(); });
+      printf("%10.1f", 1000.0 / ns);
+
+      if(n == sizes[2]) {                   // the same strips one after the other
+        sequential[c] = 1000.0 / timeIt(bytes, [&] {
+          for(uint8_t i=0; i<configs[c].lanes; i++) strips[i]->show();
+        });
+      }
+      for(uint8_t i=0; i<configs[c].lanes; i++) delete strips[i];
+    }
+    printf("\n");
+  }
+  for(int c=0; c<2; c++) {
+    printf("%-34s%10.2f BSRR writes/bit (all lanes), sequential show() %.1f bytes/us at %u\n",
+           configs[c].name, writesPerBit[c], sequential[c], sizes[2]);
+  }
+  CHECK(writesPerBit[0] < 2.01, "same-port clock should need 2 writes per bit");
+
+  // Mixed lengths and an output stage on one lane
+  Adafruit_DotStar a(50, D0, D4), b(7, D1, D4, DOTSTAR_RGB), c(23, D2, D4);
+  Adafruit_DotStar *mixed[] = { &a, &b, &c };
+  DotStarParallel out;
+  for(Adafruit_DotStar *s : mixed) CHECK(out.addStrip(*s), "addStrip mixed");
+  out.begin();
+  for(Adafruit_DotStar *s : mixed) fillPattern(*s);
+  host_gpio_probe(D4);
+  out.show();
+  checkLanes(mixed, portB, 3, "mixed lengths");
+
+  c.setOutputMode(DOTSTAR_OUTPUT_LUT);     // reference: the strip on its own
+  c.setBrightness(128);
+  host_gpio_probe(D4);
+  c.show();
+  std::vector<uint8_t> alone = host_gpio_bytes(D2);
+  host_gpio_probe(D4);
+  out.show();
+  std::vector<uint8_t> lane = host_gpio_bytes(D2);
+  CHECK(lane.size() == frameBytes(50) && alone.size() == frameBytes(23) &&
+        std::equal(alone.begin(), alone.end(), lane.begin()) &&
+        memcmp(alone.data(), c.getPixels(), alone.size()),
+        "lane with an output stage differs from the strip's own show()");
+
+  // Lanes that can't share the port or clock are refused
+  Adafruit_DotStar other(10, D5, D4), clock2(10, D3, D1), hw(10);
+  CHECK(!out.addStrip(other), "data pin on another port accepted");
+  CHECK(!out.addStrip(clock2), "other clock pin accepted");
+  CHECK(!out.addStrip(hw), "hardware SPI strip accepted");
+  CHECK(!out.addStrip(a), "same data pin accepted twice");
+}
@@ -0,0 +1,246 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: recorded animations (DotStarPlayer, DSA encoder).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_player.h"
+#include "dsa_encoder.h"
+
+// Recorded animations (DSA, DotStarPlayer) -----------------------------------
+
+// Test animations, frames * leds R,G,B triplets
+enum { ANIM_RAINBOW, ANIM_SCANNER, ANIM_SPARKLE, ANIM_FIRE, ANIM_PULSE, ANIM_COUNT };
+static const char *animNames[] = { "rainbow", "scanner", "sparkle", "fire", "pulse" };
+
+static std::vector<uint8_t> makeAnimation(int kind, uint16_t leds, uint32_t frames) {
+  std::vector<uint8_t> rgb((size_t)leds * 3 * frames);
+  std::vector<uint8_t> heat(leds);
+  uint32_t seed = 12345;
+  auto rnd = [&seed](void) { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7FFF; };
+
+  for(uint32_t f=0; f<frames; f++) {
+    uint8_t *p = &rgb[(size_t)f * leds * 3];
+    if(f) memcpy(p, p - leds * 3, leds * 3);
+    for(uint16_t i=0; i<leds; i++, p+=3) {
+      switch(kind) {
+        case ANIM_RAINBOW: {                  // hue wheel scrolling one step a frame
+          uint8_t h = (i * 256 / leds + f) & 0xFF, s = h % 85 * 3;
+          p[0] = h < 85 ? 255 - s : h < 170 ? 0 : s;
+          p[1] = h < 85 ? s : h < 170 ? 255 - s : 0;
+          p[2] = h < 85 ? 0 : h < 170 ? s : 255 - s;
+          break;
+        }
+        case ANIM_SCANNER: {                  // red dot with a fading tail
+          int32_t d = (int32_t)(f * 8 % (2 * leds)) - i;
+          p[0] = (d >= 0 && d < 32) ? 255 - d * 8 : 0;
+          p[1] = p[2] = 0;
+          break;
+        }
+        case ANIM_SPARKLE:                    // white flashes decaying on black
+          if(!(rnd() % 200)) p[0] = p[1] = p[2] = 255;
+          else if(p[0]) p[0] = p[1] = p[2] = p[0] * 3 / 4;
+          break;
+        case ANIM_FIRE: {                     // cooling, rising noise
+          heat[i] = (heat[i] * 7 + (i ? heat[i - 1] : 255) * 2) / 9;
+          if(!(rnd() % 16)) heat[i] = rnd() & 0xFF;
+          p[0] = heat[i];
+          p[1] = heat[i] * heat[i] >> 9;
+          p[2] = 0;
+          break;
+        }
+        case ANIM_PULSE: {                    // whole strip breathing in blue
+          uint8_t v = (uint8_t)(127.5 + 127.5 * sin(f * 0.1));
+          p[0] = p[1] = 0;
+          p[2] = v;
+          break;
+        }
+      }
+    }
+  }
+  return rgb;
+}
+
+struct MemorySource {
+  const std::vector<uint8_t> *data;
+  size_t                      pos;
+};
+
+static int readMemory(void *context, uint8_t *buf, uint16_t len) {
+  MemorySource *m = (MemorySource *)context;
+  size_t n = std::min((size_t)len, m->data->size() - m->pos);
+  memcpy(buf, &m->data->at(0) + m->pos, n);
+  m->pos += n;
+  return n;
+}
+
+// Frame 'f' of 'rgb' (animation of 'leds') in the strip's first LEDs?
+static bool playerFrameIs(Adafruit_DotStar &strip, const std::vector<uint8_t> &rgb,
+                          uint16_t leds, uint32_t f) {
+  uint16_t n = std::min(leds, strip.numPixels());
+  for(uint16_t i=0; i<n; i++) {
+    const uint8_t *p = &rgb[((size_t)f * leds + i) * 3];
+    if(strip.getPixelColor(i) != (((uint32_t)p[0] << 16) | (p[1] << 8) | p[2])) return false;
+  }
+  return true;
+}
+
+static void playerChecks(void) {
+  const uint16_t leds = 200;
+  const uint32_t frames = 60;
+
+  for(int kind=0; kind<ANIM_COUNT; kind++) {
+    std::vector<uint8_t> rgb = makeAnimation(kind, leds, frames);
+    for(int palette=0; palette<2; palette++) {
+      std::vector<uint8_t> dsa = dsaEncode(rgb, leds, frames, 33333, 16, palette);
+      for(int streamed=0; streamed<2; streamed++) {
+        Adafruit_DotStar strip(leds);
+        strip.begin();
+        DotStarPlayer    player(strip);
+        MemorySource     source = { &dsa, 0 };
+        bool ok = streamed ? player.begin(readMemory, &source) : player.begin(dsa.data(), dsa.size());
+        CHECK(ok && player.numLEDs() == leds && player.getFrameCount() == frames &&
+              player.getFrameMicros() == 33333, "%s: header", animNames[kind]);
+        uint32_t f = 0;
+        for(; f<frames && player.nextFrame(); f++) {
+          if(!playerFrameIs(strip, rgb, leds, f)) break;
+        }
+        CHECK(f == frames && !player.nextFrame() && player.ok(),
+              "%s, palette %d, streamed %d: decoded %u of %u frames", animNames[kind],
+              palette, streamed, f, frames);
+      }
+    }
+  }
+
+  // with the limiter on, frames keep its sums (no recount per frame);
+  // runs, literals, palettes and skips
+  for(int palette=0; palette<2; palette++) {
+    std::vector<uint8_t> rgb = makeAnimation(ANIM_SCANNER, leds, frames),
+                         dsa = dsaEncode(rgb, leds, frames, 20000, 10, palette);
+    Adafruit_DotStar strip(leds + 1);
+    DotStarPlayer    player(strip);
+    strip.begin();
+    player.begin(dsa.data(), dsa.size());
+    bool tracked = true;
+    for(uint32_t f=0; f<frames; f++)
+      tracked &= powerTracked(strip, leds, [&] { player.nextFrame(); });
+    CHECK(tracked, "palette %d: frames recounted or miscounted", palette);
+  }
+
+  std::vector<uint8_t> rgb = makeAnimation(ANIM_FIRE, leds, frames),
+                       dsa = dsaEncode(rgb, leds, frames, 20000, 10);
+  Adafruit_DotStar strip(leds), shortStrip(leds / 2);
+  strip.begin();
+  shortStrip.begin();
+  DotStarPlayer    player(strip);
+
+  // seek lands on any frame, from key frames or not
+  player.begin(dsa.data(), dsa.size());
+  for(uint32_t f : { 0u, 9u, 10u, 11u, 37u, 59u }) {
+    bool ok = player.seek(f) && player.nextFrame() && playerFrameIs(strip, rgb, leds, f);
+    CHECK(ok && player.getFrame() == f + 1, "seek(%u)", f);
+  }
+  CHECK(!player.seek(frames), "seek past the end");
+
+  // looping starts over after the last frame
+  player.setLoop(true);
+  player.seek(frames - 1);
+  player.nextFrame();
+  CHECK(player.nextFrame() && player.getFrame() == 1 && playerFrameIs(strip, rgb, leds, 0),
+        "loop back to frame 0");
+
+  // a strip shorter than the animation gets its first LEDs
+  DotStarPlayer shortPlayer(shortStrip);
+  shortPlayer.begin(dsa.data(), dsa.size());
+  uint32_t f = 0;
+  for(; f<frames && shortPlayer.nextFrame(); f++) {
+    if(!playerFrameIs(shortStrip, rgb, leds, f)) break;
+  }
+  CHECK(f == frames, "short strip: %u of %u frames", f, frames);
+
+  // brightness changes reach palette colors too
+  std::vector<uint8_t> pulse = dsaEncode(makeAnimation(ANIM_PULSE, leds, 4), leds, 4, 20000);
+  player.begin(pulse.data(), pulse.size());
+  player.nextFrame();
+  strip.setBrightness(64);
+  player.nextFrame();
+  CHECK(strip.getPixels()[4] == 0xE0 + (64 >> 3), "palette header after setBrightness: %02x",
+        strip.getPixels()[4]);
+  strip.setBrightness(255);
+
+  // damaged files stop the player without writing past the strip
+  for(size_t cut : { (size_t)3, (size_t)DOTSTAR_DSA_HEADER, dsa.size() / 2, dsa.size() - 1 }) {
+    player.begin(dsa.data(), cut);
+    uint32_t shown = 0;
+    while(player.nextFrame()) shown++;
+    CHECK(!player.ok() && shown < frames, "truncated at %zu: %u frames, ok %d", cut, shown,
+          player.ok());
+  }
+  // ops that overrun their payload or the LED count: 8 LEDs, 1 frame, R,G,B
+  const uint8_t overruns[][6] = {
+    { DOTSTAR_DSA_KEY, 2, 0, 0, 0xFF, 1 },  // 64 colors in a 2-byte payload
+    { DOTSTAR_DSA_KEY, 4, 0, 0, 0x7F, 1 },  // run of 64 on 8 LEDs
+    { DOTSTAR_DSA_KEY, 1, 0, 0, 0x08, 0 },  // skip of 9
+    { 7,               1, 0, 0, 0x00, 0 },  // unknown frame type
+  };
+  for(const uint8_t *frame : overruns) {
+    uint8_t file[DOTSTAR_DSA_HEADER + 6 + 8] = { 'D', 'S', 'A', '1', 8, 0, 0, 0, 1, 0, 0, 0,
+                                                 0x20, 0x4E, 0, 0, 0, 0 };
+    memcpy(&file[DOTSTAR_DSA_HEADER], frame, 6);
+    Adafruit_DotStar tiny(4);
+    tiny.begin();
+    uint8_t guard = tiny.getPixels()[4 + 4 * 4];
+    DotStarPlayer tinyPlayer(tiny);
+    CHECK(tinyPlayer.begin(file, sizeof(file)) && !tinyPlayer.nextFrame() && !tinyPlayer.ok() &&
+          tiny.getPixels()[4 + 4 * 4] == guard, "bad op %02x accepted", frame[4]);
+  }
+
+  // update() shows at the recorded rate
+  host_clock_simulate(true);
+  player.begin(dsa.data(), dsa.size());
+  uint32_t shown = 0;
+  for(uint32_t t=0; t<500000; t+=1000) {
+    shown += player.update();
+    host_clock_advance(1000);
+  }
+  host_clock_simulate(false);
+  CHECK(shown == 25, "update(): %u frames in 0.5 s at 50 fps", shown);
+}
+
+void benchPlayer(void) {
+  playerChecks();
+
+  const uint16_t leds = 1024;
+  const uint32_t frames = 120;
+  printf("\nRecorded animations, %u LEDs x %u frames   %% of frame buffer   decode (ns/LED)\n",
+         leds, frames);
+  printf("%-12s %10s %10s %10s %10s %10s %10s\n", "", "bytes", "RGB", "palette",
+         "keys 30", "memory", "streamed");
+
+  for(int kind=0; kind<ANIM_COUNT; kind++) {
+    std::vector<uint8_t> rgb = makeAnimation(kind, leds, frames),
+                         dsa = dsaEncode(rgb, leds, frames, 16667),
+                         raw = dsaEncode(rgb, leds, frames, 16667, 0, false),
+                         keys = dsaEncode(rgb, leds, frames, 16667, 30);
+    double buffer = (double)frames * leds * 4;
+
+    Adafruit_DotStar strip(leds);
+    strip.begin();
+    DotStarPlayer player(strip);
+    player.begin(dsa.data(), dsa.size());
+    player.setLoop(true);
+    double memory = timeIt(leds, [&] { player.nextFrame(); });
+
+    MemorySource source = { &dsa, 0 };
+    double streamed = timeIt(leds, [&] {
+      if(!player.nextFrame()) {
+        source.pos = 0;
+        player.begin(readMemory, &source);
+        player.nextFrame();
+      }
+    });
+    printf("%-12s %10zu %9.1f%% %9.1f%% %9.1f%% %10.2f %10.2f\n", animNames[kind], dsa.size(),
+           100 * raw.size() / buffer, 100 * dsa.size() / buffer, 100 * keys.size() / buffer,
+           memory, streamed);
+  }
+}
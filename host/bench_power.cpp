@@ -0,0 +1,196 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: the power limiter.
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_matrix.h"
+
+// Power limiter ----------------------------------------------------------------
+
+static void powerChecks(void) {
+  const uint16_t n = 300;
+  Adafruit_DotStar strip(n, DOTSTAR_GRB);
+  strip.begin();
+  strip.setPowerLimit(1000000);             // measure only
+  strip.show();
+  CHECK(strip.getPowerEstimate() == 300, "dark strip: %u mA", strip.getPowerEstimate());
+
+  // every write path keeps the sums, no recount in between
+  std::vector<uint32_t> src(n);
+  std::vector<uint8_t>  rgb(n * 3);
+  for(uint16_t i=0; i<n; i++) src[i] = (uint32_t)i * 0x030507 ^ 0x804020;
+  for(uint32_t i=0; i<n * 3u; i++) rgb[i] = (uint8_t)(i * 7);
+  bool same = true;
+  for(int step=0; step<8; step++) {
+    switch(step) {
+      case 0: for(uint16_t i=0; i<n; i += 3) strip.setPixelColor(i, i, 255 - i, i >> 1); break;
+      case 1: for(uint16_t i=1; i<n; i += 2) strip.setPixelColor(i, src[i]); break;
+      case 2: strip.fill(0x102030, 40, 100); break;
+      case 3: strip.setPixels(20, src.data(), 150); break;
+      case 4: strip.setPixelsRGB(100, rgb.data(), 0); break;
+      case 5: for(uint16_t i=0; i<n; i += 5) strip.setPixelColor16(i, i * 200, 65535, 0); break;
+      case 6: strip.clear(); break;
+      case 7: strip.fill(0xFFFFFF); break;
+    }
+    strip.show();
+    same &= strip.getPowerEstimate() == powerOf(strip, n, 31);
+  }
+  CHECK(same, "running sums differ from a recount");
+
+  // writes through getPixels() are recounted once markDirty() says so
+  strip.getPixels()[4 + 7 * 4 + 1] = 0;
+  strip.markDirty(7);
+  strip.show();
+  CHECK(strip.getPowerEstimate() == powerOf(strip, n, 31), "raw write not recounted");
+
+  // 300 white LEDs want 18.3 A; 5 A leaves the largest global that fits
+  strip.fill(0xFFFFFF);
+  strip.setPowerLimit(5000);
+  showWire(strip);
+  uint8_t g = (5000 - 300) * 31 / (n * 60);
+  bool headers = true;
+  for(uint16_t i=0; i<n; i++) headers &= SPI.wire[4 + i * 4] == 0xE0 + g;
+  CHECK(headers && strip.getPowerEstimate() <= 5000 &&
+        strip.getPowerEstimate() == powerOf(strip, n, g) && powerOf(strip, n, g + 1) > 5000,
+        "limited to %u mA at global %u (want %u)", strip.getPowerEstimate(),
+        SPI.wire[4] & 31, g);
+  CHECK(strip.getPowerBrightness() == g << 3 && strip.getBrightness() == 255,
+        "brightness %u shown, %u set", strip.getPowerBrightness(), strip.getBrightness());
+
+  // new pixels get the limited header
+  strip.setPixelColor(3, 0xFFFFFF);
+  CHECK(strip.getPixels()[4 + 3 * 4] == 0xE0 + g, "write stamped header %02x",
+        strip.getPixels()[4 + 3 * 4]);
+
+  // one pixel that moves the limit changes every LED, partial show or not
+  strip.setPowerLimit(700);
+  strip.fill(0x000010);                     // 676 mA: no limit
+  strip.setPartialShow(true);
+  strip.show();
+  CHECK(strip.getPowerBrightness() == 255, "dim frame limited to %u", strip.getPowerBrightness());
+  SPI.hostReset();
+  strip.setPixelColor(0, 0xFFFFFF);         // 736 mA at full
+  strip.show();
+  CHECK(SPI.wire.size() == frameBytes(n) && SPI.wire[4 + (n - 1) * 4] == 0xE0 + 28 &&
+        strip.getPowerEstimate() <= 700, "new limit sent %u bytes, last header %02x",
+        (unsigned)SPI.wire.size(), SPI.wire[4 + (n - 1) * 4]);
+  strip.setPartialShow(false);
+
+  // setBrightness() is the ceiling, for the whole frame
+  strip.setBrightness(64);
+  showWire(strip);
+  CHECK(SPI.wire[4] == 0xE0 + 8 && SPI.wire[4 + (n - 1) * 4] == 0xE0 + 8,
+        "setBrightness() under the limit sent %02x", SPI.wire[4]);
+  strip.setBrightness(255);
+
+  // a budget below the idle draw turns the colors off
+  strip.setPowerLimit(100);
+  strip.fill(0xFFFFFF);
+  strip.show();
+  CHECK(strip.getPixels()[4] == 0xE0 && strip.getPowerEstimate() == 300,
+        "below idle: header %02x, %u mA", strip.getPixels()[4], strip.getPowerEstimate());
+
+  // off: the sketch's brightness is back on every pixel
+  strip.setPowerLimit(0);
+  showWire(strip);
+  CHECK(SPI.wire[4] == 0xFF && SPI.wire[4 + (n - 1) * 4] == 0xFF &&
+        !strip.getPowerEstimate(), "limiter off left header %02x", SPI.wire[4]);
+
+  // setBrightness() changes no color, so the sums stand
+  CHECK(powerTracked(strip, 0, [&] { strip.setBrightness(100); strip.setBrightness(255); }),
+        "setBrightness() recounted the frame");
+
+  // raw and matrix writes under a limit that isn't reached: only what
+  // changed goes out, and the recount still matches
+  {
+    const uint16_t leds = 1024;
+    Adafruit_DotStar big(leds, DOTSTAR_BGR);
+    DotStarMatrix    matrix(big, 32, 32, DOTSTAR_MATRIX_TOP + DOTSTAR_MATRIX_LEFT +
+                            DOTSTAR_MATRIX_ROWS + DOTSTAR_MATRIX_PROGRESSIVE);
+    big.begin();
+    big.setPartialShow(true);
+    big.setPowerLimit(100000);
+    big.show();
+    SPI.hostReset();
+    big.getPixels()[4 + 3 * 4 + 1] = 0x40;
+    big.markDirty(3);
+    big.show();
+    size_t raw = SPI.wire.size();
+    SPI.hostReset();
+    matrix.setXY(5, 0, 0x204080);
+    big.show();
+    CHECK(raw == frameBytes(4) && SPI.wire.size() == frameBytes(6) &&
+          SPI.wire[4 + 5 * 4] == 0xFF && big.getPowerEstimate() == powerOf(big, leds, 31),
+          "limiter on: raw write sent %u bytes, setXY %u", (unsigned)raw,
+          (unsigned)SPI.wire.size());
+
+    // the matrix writers keep the sums themselves
+    matrix.fillRect(2, 4, 9, 6, 0x80FF10);
+    matrix.setXY(31, 31, 200, 0, 90);
+    big.show();
+    CHECK(big.getPowerEstimate() == powerOf(big, leds, 31), "matrix writes: %u mA, recount %u",
+          big.getPowerEstimate(), powerOf(big, leds, 31));
+  }
+
+  // output stage: the limit goes into the table
+  strip.setOutputMode(DOTSTAR_OUTPUT_LUT);
+  strip.setPowerLimit(5000);
+  showWire(strip);
+  uint8_t b = strip.getPowerBrightness();
+  CHECK(b < 255 && strip.getPowerEstimate() <= 5000 && SPI.wire[4] == 0xFF &&
+        SPI.wire[5] == (255 * 255 * (b + 1) / 256 + 127) / 255,
+        "LUT stage: brightness %u, %u mA, wire %02x", b, strip.getPowerEstimate(), SPI.wire[5]);
+  strip.setOutputMode(DOTSTAR_OUTPUT_DIRECT);
+}
+
+void benchPower(void) {
+  powerChecks();
+
+  header("Power limiter, write cost", "ns/pixel");
+  const char *names[] = {
+    "setPixelColor(n, r, g, b), off", "setPixelColor(n, r, g, b), on",
+    "setPixels(0, src, n), off", "setPixels(0, src, n), on"
+  };
+  for(int row=0; row<4; row++) {
+    printf("%-34s", names[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      std::vector<uint32_t> src(n);
+      for(uint16_t i=0; i<n; i++) src[i] = (uint32_t)i * 0x010203;
+      if(row & 1) strip.setPowerLimit(1000);
+      double ns = (row < 2) ?
+        timeIt(n, [&] {
+          for(uint16_t i=0; i<n; i++) strip.setPixelColor(i, i, i >> 1, 255 - i);
+        }) :
+        timeIt(n, [&] { strip.setPixels(0, src.data(), n); });
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+
+  // an animation that changes 16 pixels a frame: the running sums against
+  // recounting the strip at every show() (what markDirty() costs)
+  header("16 pixels + show(), CPU", "ns/frame");
+  const char *rows[] = { "limiter off", "limiter on, running sums",
+                         "limiter on, recount per show()" };
+  for(int row=0; row<3; row++) {
+    printf("%-34s", rows[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      strip.begin();
+      fillPattern(strip);
+      if(row) strip.setPowerLimit(n * 10);  // limiting, steady global
+      SPI.hostSetCapture(false);
+      uint16_t at = 0;
+      double ns = timeIt(1, [&] {
+        for(uint8_t i=0; i<16; i++, at = (at + 1) % n) strip.setPixelColor(at, at, 255, at >> 2);
+        if(row == 2) strip.markDirty(at);
+        strip.show();
+      });
+      SPI.hostSetCapture(true);
+      printf("%10.0f", ns);
+    }
+    printf("\n");
+  }
+}
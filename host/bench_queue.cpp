@@ -0,0 +1,224 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: the frame queue between threads (DotStarFrameQueue).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_queue.h"
+
+#include <atomic>
+#include <thread>
+
+// Frame queue between threads ------------------------------------------------
+
+// LED i of frame 'seq': the sequence number in red/green, i in blue, so a
+// frame mixing two frames (or a shifted one) shows
+static uint32_t queueColor(uint32_t seq, uint16_t i) {
+  return ((seq & 0xFFFF) << 8) | (i & 0xFF);
+}
+
+// Split the captured wire into frames; count torn ones and check the
+// rest arrived in order.  Returns the number of frames.
+static uint32_t queueFrames(uint16_t n, uint32_t &torn, uint32_t &last, bool &ordered) {
+  Adafruit_DotStar ref(n);
+  size_t   size = frameBytes(n);
+  uint32_t frames = SPI.wire.size() / size;
+  torn    = 0;
+  last    = 0;
+  ordered = (SPI.wire.size() % size) == 0;
+  for(uint32_t f=0; f<frames; f++) {
+    const uint8_t *p = &SPI.wire[f * size];
+    uint32_t seq = (p[4 + 3] << 8) | p[4 + 2];   // BGR: red at byte 3, green at 2
+    bool     same = true;
+    for(uint16_t i=0; i<n; i++) {
+      ref.setPixelColor(i, queueColor(seq, i));
+      same &= !memcmp(&p[4 + i * 4], &ref.getPixels()[4 + i * 4], 4);
+    }
+    if(!same) {
+      torn++;
+      continue;
+    }
+    if(f && (seq <= last)) ordered = false;
+    last = seq;
+  }
+  return frames;
+}
+
+struct QueueRun {
+  uint32_t published, sent, skipped, frames, torn, last;
+  bool     ordered;
+  double   seconds;
+};
+
+// A producer thread publishing 'count' frames, pausing up to 'pauseUs'
+// after each, while this thread polls and completes DMA on the real clock
+static QueueRun runQueue(uint16_t n, uint32_t count, uint32_t pauseUs, uint8_t depth) {
+  Adafruit_DotStar  strip(n);
+  DotStarFrameQueue queue(strip);
+  strip.begin();
+  SPI.hostReset();
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+  SPI.hostSetCaptureAtEnd(true);
+  queue.begin(depth);
+
+  std::atomic<bool> done(false);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&] {
+    uint32_t seed = 1;
+    for(uint32_t seq=1; seq<=count; seq++) {
+      uint8_t *frame;
+      while(!(frame = queue.acquire())) std::this_thread::yield();
+      for(uint16_t i=0; i<n; i++) queue.setPixelColor(frame, i, queueColor(seq, i));
+      queue.publish();
+      seed = seed * 1103515245 + 12345;
+      if(pauseUs) std::this_thread::sleep_for(std::chrono::microseconds((seed >> 16) % pauseUs));
+    }
+    done = true;
+  });
+  while(!done || strip.isShowing() || queue.poll()) {
+    queue.poll();
+    host_dma_poll();
+    std::this_thread::yield();              // on one core the producer needs the CPU too
+  }
+  producer.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  QueueRun r;
+  r.published = queue.getPublished();
+  r.sent      = queue.getSent();
+  r.skipped   = queue.getSkipped();
+  r.frames    = queueFrames(n, r.torn, r.last, r.ordered);
+  r.seconds   = seconds;
+  queue.end();
+  SPI.hostSetCaptureAtEnd(false);
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  return r;
+}
+
+static void queueChecks(void) {
+  const uint16_t n = 20;
+  Adafruit_DotStar  strip(n);
+  DotStarFrameQueue queue(strip);
+  strip.begin();
+  CHECK(queue.begin(3), "begin(3)");
+
+  // the same frame until it is published; three out, none left
+  uint8_t *a = queue.acquire();
+  CHECK(a && queue.acquire() == a, "acquire() twice gave another frame");
+  queue.fill(a, 0x010101);
+  queue.publish();
+  uint8_t *b = queue.acquire();
+  queue.fill(b, 0x020202);
+  queue.publish();
+  uint8_t *c = queue.acquire();
+  queue.fill(c, 0x030303);
+  queue.setPixelColor(c, 3, 0xABCDEF);
+  queue.publish();
+  CHECK(a != b && b != c && a != c && !queue.acquire(), "three distinct frames, then none");
+
+  // the newest goes out, the older two come back
+  SPI.hostReset();
+  CHECK(queue.poll() && queue.getSent() == 1 && queue.getSkipped() == 2,
+        "poll(): sent %u skipped %u", queue.getSent(), queue.getSkipped());
+  strip.fill(0x030303);
+  strip.setPixelColor(3, 0xABCDEF);
+  CHECK(wireIsFrame(strip), "poll() sent another frame");
+  CHECK(!queue.poll(), "poll() with nothing published");
+  uint8_t *d = queue.acquire();
+  queue.publish();
+  uint8_t *e = queue.acquire();
+  queue.publish();
+  CHECK(d && e && queue.acquire(), "frames recycled after sending");
+  queue.end();
+
+  // needs a plain strip
+  strip.setBufferCount(2);
+  CHECK(!queue.begin(3), "begin() with two frame buffers");
+  strip.setBufferCount(1);
+  strip.setOutputMode(DOTSTAR_OUTPUT_LUT);
+  CHECK(!queue.begin(3), "begin() with an output stage");
+  strip.setOutputMode(DOTSTAR_OUTPUT_DIRECT);
+
+  // soft SPI sends from poll()
+  Adafruit_DotStar  soft(n, D2, D4);
+  DotStarFrameQueue softQueue(soft);
+  soft.begin();
+  softQueue.begin(2);
+  softQueue.fill(softQueue.acquire(), 0x445566);
+  softQueue.publish();
+  host_gpio_probe(D4);
+  softQueue.poll();
+  soft.fill(0x445566);
+  std::vector<uint8_t> out = host_gpio_bytes(D2);
+  CHECK(out.size() == frameBytes(n) && !memcmp(out.data(), soft.getPixels(), out.size()),
+        "soft SPI queue frame differs");
+}
+
+void benchQueue(void) {
+  queueChecks();
+
+  printf("\nDotStarFrameQueue, producer thread -> DMA, 300 LEDs (%u us on the wire)\n",
+         SPI.hostWireMicros(frameBytes(300)));
+  printf("%-28s %6s %10s %8s %8s %6s %8s\n", "", "frames", "published", "sent", "skipped",
+         "torn", "sent/s");
+  struct { const char *name; uint32_t count, pause; uint8_t depth; } runs[] = {
+    { "flat out, 3 frames",         3000,    0, 3 },
+    { "flat out, 2 frames",         3000,    0, 2 },
+    { "paced 0-1 ms, 3 frames",      400, 1000, 3 },
+    { "paced 0-1 ms, 8 frames",      400, 1000, 8 },
+  };
+  for(auto &run : runs) {
+    QueueRun r = runQueue(300, run.count, run.pause, run.depth);
+    printf("%-28s %6u %10u %8u %8u %6u %8.0f\n", run.name, run.count, r.published, r.sent,
+           r.skipped, r.torn, r.sent / r.seconds);
+    CHECK(r.published == run.count && r.sent + r.skipped == r.published &&
+          r.frames == r.sent && !r.torn && r.ordered && r.last == run.count,
+          "%s: %u published, %u sent, %u skipped, %u on the wire, %u torn, last %u, ordered %d",
+          run.name, r.published, r.sent, r.skipped, r.frames, r.torn, r.last, r.ordered);
+  }
+
+  // the same producer drawing straight into a shared strip buffer (a data
+  // race on purpose: what the queue is for)
+  Adafruit_DotStar strip(300);
+  strip.begin();
+  SPI.hostReset();
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+  SPI.hostSetCaptureAtEnd(true);
+  std::atomic<bool> stop(false);
+  std::thread producer([&] {
+    for(uint32_t seq=1; !stop; seq++)
+      for(uint16_t i=0; i<300; i++) strip.setPixelColor(i, queueColor(seq, i));
+  });
+  while(SPI.wire.size() < 200 * frameBytes(300)) {
+    strip.show();
+    host_dma_poll();
+    std::this_thread::yield();
+  }
+  stop = true;
+  producer.join();
+  while(strip.isShowing()) host_dma_complete();
+  uint32_t torn, last;
+  bool     ordered;
+  uint32_t frames = queueFrames(300, torn, last, ordered);
+  printf("%-28s %6s %10s %8u %8s %6u\n", "shared buffer, no queue", "-", "-", frames, "-", torn);
+  SPI.hostSetCaptureAtEnd(false);
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+
+  header("DotStarFrameQueue, one thread", "ns/frame");
+  printf("%-34s", "acquire() + publish() + poll()");
+  for(uint16_t n : sizes) {
+    Adafruit_DotStar  s(n);
+    DotStarFrameQueue q(s);
+    s.begin();
+    q.begin(3);
+    SPI.hostSetCapture(false);
+    double ns = timeIt(1, [&] {
+      q.acquire();
+      q.publish();
+      q.poll();
+    });
+    SPI.hostSetCapture(true);
+    printf("%10.1f", ns);
+  }
+  printf("\n");
+}
@@ -0,0 +1,284 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: the network receiver (DotStarReceiver).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_receiver.h"
+
+#include <atomic>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Network receiver (DDP / OPC / E1.31) ---------------------------------------
+
+typedef std::vector<uint8_t> Packet;
+
+// One RGB frame as DDP packets of at most 'chunk' data bytes, push on the last
+static std::vector<Packet> ddpPackets(const uint8_t *rgb, uint32_t bytes,
+                                      uint16_t chunk) {
+  std::vector<Packet> out;
+  for(uint32_t off=0; off<bytes; off+=chunk) {
+    uint16_t len = std::min<uint32_t>(chunk, bytes - off);
+    Packet p(10 + len);
+    p[0] = 0x40 | ((off + len >= bytes) ? 0x01 : 0);
+    p[2] = 0x0B;                            // RGB, 8 bit
+    p[3] = 1;
+    p[4] = off >> 24; p[5] = off >> 16; p[6] = off >> 8; p[7] = off;
+    p[8] = len >> 8;  p[9] = len;
+    memcpy(&p[10], rgb + off, len);
+    out.push_back(p);
+  }
+  return out;
+}
+
+// One RGB frame as E1.31 data packets, 170 pixels per universe from 'first'
+static std::vector<Packet> e131Packets(const uint8_t *rgb, uint32_t bytes,
+                                       uint16_t first) {
+  static const uint8_t acnId[12] = { 'A','S','C','-','E','1','.','1','7',0,0,0 };
+  std::vector<Packet> out;
+  for(uint32_t off=0, u=first; off<bytes; off+=510, u++) {
+    uint16_t len = std::min<uint32_t>(510, bytes - off);
+    Packet p(126 + len, 0);
+    p[1] = 0x10;                            // preamble size
+    memcpy(&p[4], acnId, sizeof(acnId));
+    p[21] = 0x04;                           // root vector
+    p[43] = 0x02;                           // framing vector
+    memcpy(&p[44], "bench", 5);             // source name
+    p[108] = 100;                           // priority
+    p[113] = u >> 8; p[114] = u;
+    p[117] = 0x02; p[118] = 0xA1;
+    p[122] = 1;                             // address increment
+    p[123] = (len + 1) >> 8; p[124] = len + 1;
+    memcpy(&p[126], rgb + off, len);
+    out.push_back(p);
+  }
+  return out;
+}
+
+static Packet opcMessage(const uint8_t *rgb, uint16_t bytes, uint8_t channel) {
+  Packet p(4 + bytes);
+  p[0] = channel; p[1] = 0;
+  p[2] = bytes >> 8; p[3] = bytes;
+  memcpy(&p[4], rgb, bytes);
+  return p;
+}
+
+static std::vector<uint8_t> rgbFrame(uint16_t n, uint32_t seed) {
+  std::vector<uint8_t> rgb(n * 3);
+  for(uint32_t i=0; i<rgb.size(); i++) rgb[i] = (uint8_t)(i * 31 + seed * 7 + (i >> 8));
+  return rgb;
+}
+
+static bool stripHolds(Adafruit_DotStar &strip, const uint8_t *rgb) {
+  for(uint16_t i=0; i<strip.numPixels(); i++) {
+    uint32_t c = ((uint32_t)rgb[i * 3] << 16) | (rgb[i * 3 + 1] << 8) | rgb[i * 3 + 2];
+    if(strip.getPixelColor(i) != c) return false;
+  }
+  return true;
+}
+
+static int senderSocket(int type, uint16_t port) {
+  int fd = socket(AF_INET, type, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if(fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+static uint64_t nowNs(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void receiverDecodeChecks(void) {
+  const uint16_t n = 600;                   // 4 universes, 2 DDP packets
+  SPI.hostReset();
+
+  for(uint8_t order : { DOTSTAR_BGR, DOTSTAR_GRB }) {
+    Adafruit_DotStar strip(n, order);
+    DotStarReceiver  rx(strip);
+    strip.begin();
+    strip.setBufferCount(2);                // getPixels() moves on every show()
+
+    std::vector<uint8_t> rgb = rgbFrame(n, order);
+    rx.begin(DOTSTAR_DDP, 0); rx.stop();    // protocol only, no socket needed
+    uint32_t shown = 0;
+    for(const Packet &p : ddpPackets(rgb.data(), rgb.size(), 1000)) // splits pixels
+      shown += rx.handlePacket(p.data(), p.size());
+    CHECK(shown == 1 && stripHolds(strip, rgb.data()), "DDP frame, order %02x", order);
+    CHECK(!memcmp(&SPI.wire[SPI.wire.size() - frameBytes(n)], strip.getPixels(),
+                  frameBytes(n)), "DDP frame not on the wire");
+
+    rgb = rgbFrame(n, order + 1);
+    rx.begin(DOTSTAR_E131, 0); rx.stop();
+    rx.setUniverse(7);
+    shown = 0;
+    for(const Packet &p : e131Packets(rgb.data(), rgb.size(), 7))
+      shown += rx.handlePacket(p.data(), p.size());
+    CHECK(shown == 1 && stripHolds(strip, rgb.data()), "E1.31 frame, order %02x", order);
+
+    rgb = rgbFrame(n, order + 2);
+    Packet msg = opcMessage(rgb.data(), rgb.size(), 0);
+    rx.begin(DOTSTAR_OPC, 0); rx.stop();
+    shown = 0;
+    for(size_t off=0, step=1; off<msg.size(); off+=step, step=step*3+1)  // split anywhere
+      shown += rx.handleStream(&msg[off], std::min(step, msg.size() - off));
+    CHECK(shown == 1 && stripHolds(strip, rgb.data()), "OPC frame, order %02x", order);
+
+    // not ours: other OPC channel, DDP of another version, universe out of range
+    rx.setOpcChannel(3);
+    Packet other = opcMessage(rgb.data(), 30, 4);
+    CHECK(!rx.handleStream(other.data(), other.size()), "OPC channel 4 accepted");
+    Packet bad = ddpPackets(rgb.data(), 30, 30)[0];
+    bad[0] = 0x81;
+    rx.begin(DOTSTAR_DDP, 0); rx.stop();
+    CHECK(!rx.handlePacket(bad.data(), bad.size()) && rx.getErrors() == 2,
+          "bad DDP packet accepted (%u errors)", rx.getErrors());
+  }
+
+  // with the limiter on, packets keep its sums (no recount per frame),
+  // pixels split between packets included
+  Adafruit_DotStar strip(n);
+  DotStarReceiver  rx(strip);
+  strip.begin();
+  rx.begin(DOTSTAR_DDP, 0); rx.stop();
+  std::vector<uint8_t> rgb = rgbFrame(n, 9);
+  CHECK(powerTracked(strip, n - 1, [&] {
+          for(const Packet &p : ddpPackets(rgb.data(), (n - 1) * 3, 1000))
+            rx.handlePacket(p.data(), p.size());
+        }), "DDP frame recounted or miscounted: %u mA, recount %u",
+        strip.getPowerEstimate(), powerOf(strip, n, 31));
+}
+
+void benchReceiver(void) {
+  receiverDecodeChecks();
+  SPI.hostSetCapture(false);
+
+  // Decode cost: receiver vs. parsing into colors and setPixelColor()
+  header("network frame decode + show()", "ns/pixel");
+  for(int row=0; row<4; row++) {
+    const char *names[] = { "DDP, DotStarReceiver", "E1.31, DotStarReceiver",
+                            "OPC, DotStarReceiver", "parse + setPixelColor()" };
+    printf("%-34s", names[row]);
+    for(uint16_t n : sizes) {
+      Adafruit_DotStar strip(n, DOTSTAR_BGR);
+      DotStarReceiver  rx(strip);
+      strip.begin();
+      std::vector<uint8_t> rgb = rgbFrame(n, 1);
+      std::vector<Packet>  ps  = (row == 1) ? e131Packets(rgb.data(), rgb.size(), 1)
+                                            : ddpPackets(rgb.data(), rgb.size(), 1440);
+      Packet msg = opcMessage(rgb.data(), std::min<size_t>(rgb.size(), 65535), 0);
+      rx.begin(row == 1 ? DOTSTAR_E131 : row == 2 ? DOTSTAR_OPC : DOTSTAR_DDP, 0);
+      rx.stop();
+      double ns = timeIt(n, [&] {
+        switch(row) {
+          case 0: case 1:
+            for(const Packet &p : ps) rx.handlePacket(p.data(), p.size());
+            break;
+          case 2:
+            rx.handleStream(msg.data(), msg.size());
+            break;
+          case 3:
+            for(const Packet &p : ps) {
+              uint32_t off = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7],
+                       len = (p[8] << 8) | p[9];
+              for(uint32_t i=0; i+2<len; i+=3) {
+                uint32_t c = ((uint32_t)p[10 + i] << 16) | (p[11 + i] << 8) | p[12 + i];
+                strip.setPixelColor((off + i) / 3, c);
+              }
+            }
+            strip.show();
+            break;
+        }
+      });
+      printf("%10.2f", ns);
+    }
+    printf("\n");
+  }
+
+  // Loopback: a sender thread against poll(), 1024 LEDs
+  const uint16_t n = 1024;
+  const uint16_t ports[] = { 24048, 27890, 25568 };
+  const DotStarProtocol protos[] = { DOTSTAR_DDP, DOTSTAR_OPC, DOTSTAR_E131 };
+  const char *names[] = { "DDP/UDP", "OPC/TCP", "E1.31/UDP" };
+  printf("\nloopback sender -> poll(), %u LEDs\n", n);
+  printf("%-12s %10s %10s %10s %12s %12s\n", "", "packets/s", "frames/s",
+         "lost", "latency us", "p99 us");
+  for(int k=0; k<3; k++) {
+    Adafruit_DotStar strip(n, DOTSTAR_BGR);
+    DotStarReceiver  rx(strip);
+    strip.begin();
+    if(!rx.begin(protos[k], ports[k])) {
+      printf("%-12s (socket unavailable, skipped)\n", names[k]);
+      continue;
+    }
+    std::vector<uint8_t> rgb = rgbFrame(n, 3);
+    std::vector<Packet>  ps  = (protos[k] == DOTSTAR_E131) ?
+                                 e131Packets(rgb.data(), rgb.size(), 1) :
+                               (protos[k] == DOTSTAR_DDP) ?
+                                 ddpPackets(rgb.data(), rgb.size(), 1440) :
+                                 std::vector<Packet>(1, opcMessage(rgb.data(), rgb.size(), 0));
+    int fd = senderSocket(protos[k] == DOTSTAR_OPC ? SOCK_STREAM : SOCK_DGRAM, ports[k]);
+    CHECK(fd >= 0, "%s: no loopback sender socket", names[k]);
+    if(fd < 0) continue;
+
+    // Added latency: one frame at a time, last byte sent to show() returned
+    std::vector<double> lat;
+    for(int f=0; f<300; f++) {
+      uint32_t before = rx.getFrames();
+      uint64_t t0 = 0;
+      for(const Packet &p : ps) {
+        t0 = nowNs();
+        if(send(fd, p.data(), p.size(), 0) < 0) break;
+      }
+      uint64_t deadline = nowNs() + 100000000ull;
+      while(rx.getFrames() == before && nowNs() < deadline) rx.poll();
+      if(rx.getFrames() != before) lat.push_back((nowNs() - t0) / 1000.0);
+    }
+    std::sort(lat.begin(), lat.end());
+
+    // Throughput: the sender streams frames while the receiver polls
+    const uint32_t frames = 2000;
+    uint32_t packets0 = rx.getPackets(), frames0 = rx.getFrames();
+    std::atomic<bool> done(false);
+    uint64_t start = nowNs();
+    std::thread sender([&] {
+      for(uint32_t f=0; f<frames; f++)
+        for(const Packet &p : ps) {
+          while(send(fd, p.data(), p.size(), 0) < 0) std::this_thread::yield();
+        }
+      done = true;
+    });
+    uint64_t idleSince = 0;
+    for(;;) {
+      if(rx.poll() || !done) idleSince = nowNs();
+      else if(nowNs() - idleSince > 20000000ull) break; // 20 ms quiet after the sender
+    }
+    sender.join();
+    double secs = (idleSince - start) / 1e9;
+    uint32_t gotPackets = rx.getPackets() - packets0, gotFrames = rx.getFrames() - frames0;
+    printf("%-12s %10.0f %10.0f %10u %12.1f %12.1f\n", names[k], gotPackets / secs,
+           gotFrames / secs, frames - gotFrames,
+           lat.empty() ? 0.0 : lat[lat.size() / 2],
+           lat.empty() ? 0.0 : lat[lat.size() * 99 / 100]);
+    CHECK(lat.size() == 300, "%s: %u of 300 paced frames arrived", names[k],
+          (unsigned)lat.size());
+    CHECK(stripHolds(strip, rgb.data()), "%s: strip does not hold the frame", names[k]);
+    if(protos[k] == DOTSTAR_OPC)
+      CHECK(gotFrames == frames, "OPC/TCP: %u of %u frames", gotFrames, frames);
+    close(fd);
+    rx.stop();
+  }
+  SPI.hostSetCapture(true);
+}
@@ -0,0 +1,114 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: the fixed-rate scheduler (DotStarScheduler).
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar_scheduler.h"
+
+// Fixed-rate scheduler -------------------------------------------------------
+
+static uint32_t schedRenderUs;              // simulated render time
+static uint32_t schedRenders;
+
+// Every LED carries the frame number, so the wire shows what went out
+static void schedRender(Adafruit_DotStar &strip, uint32_t frame) {
+  host_clock_advance(schedRenderUs);
+  strip.fill(0x550000 | (frame & 0xFFFF));
+  schedRenders++;
+}
+
+struct SchedResult { uint32_t frames, misses, wireMisses, late; double fps; };
+
+// Run for 'ms' of simulated time, poll() every 50 us, tick() from a 1 ms
+// "timer" when timerTick is set
+static SchedResult runScheduler(uint16_t leds, uint16_t fps, uint32_t renderUs,
+                                uint8_t buffers, bool timerTick, uint32_t ms) {
+  Adafruit_DotStar strip(leds, DOTSTAR_RGB);
+  strip.begin();
+  host_clock_simulate(true);
+  SPI.hostSetCompletion(SPIClass::DEFERRED);
+  SPI.hostReset();
+
+  DotStarScheduler sched(strip);
+  schedRenderUs = renderUs;
+  schedRenders  = 0;
+  CHECK(sched.begin(fps, schedRender, timerTick), "begin() failed");
+  if(buffers == 1) strip.setBufferCount(1);
+
+  uint32_t start = micros(), nextTick = start, tickShows = 0;
+  while(micros() - start < ms * 1000) {
+    sched.poll();
+    if(timerTick && (int32_t)(micros() - nextTick) >= 0) {
+      uint32_t before = SPI.transfers;
+      sched.tick();
+      tickShows += (SPI.transfers != before);
+      nextTick += 1000;
+    }
+    host_clock_advance(50);
+  }
+  sched.stop();
+  strip.waitForShow();
+  double elapsed = (micros() - start) / 1e6;
+
+  // frames on the wire: whole, in order, one per frame shown
+  uint32_t sent = SPI.transfers, last = 0;
+  bool     ordered = true;
+  for(uint32_t t=0; t<sent; t++) {
+    const uint8_t *p = &SPI.wire[t * frameBytes(leds) + 4];
+    uint32_t f = (p[2] << 8) | p[3];
+    for(uint16_t i=1; i<leds; i++) ordered &= !memcmp(p, p + i * 4, 4);
+    ordered &= (t == 0) || (f > last);
+    last = f;
+  }
+  CHECK(ordered, "%u fps: frames torn or out of order", fps);
+  CHECK(!tickShows, "%u fps: tick() showed %u frames, poll() should", fps, tickShows);
+  CHECK(sent == sched.getFrames(), "%u fps: %u on the wire, %u shown", fps, sent, sched.getFrames());
+
+  SchedResult r = { sched.getFrames(), sched.getMisses(), sched.getWireMisses(),
+                    sched.getMaxLateness(), sched.getFrames() / elapsed };
+  printf("%6u %6u %8u %8u %6u %7u %7u %6u %8u %8.1f\n", leds, fps, renderUs,
+         buffers, timerTick, r.frames, r.misses, r.wireMisses, r.late, r.fps);
+
+  SPI.hostSetCompletion(SPIClass::IMMEDIATE);
+  host_clock_simulate(false);
+  return r;
+}
+
+void benchScheduler(void) {
+  printf("\nDotStarScheduler, 2 s simulated, poll() every 50 us\n");
+  printf("%6s %6s %8s %8s %6s %7s %7s %6s %8s %8s\n", "LEDs", "fps", "render",
+         "buffers", "timer", "shown", "missed", "wire", "late us", "fps");
+  SchedResult r;
+
+  // render + wire fit a period: every deadline met, on time
+  r = runScheduler(1024, 100, 3000, 2, false, 2000);
+  CHECK(r.frames == 199 && !r.misses && r.late <= 50, "100 fps: %u frames, %u misses, %u us late",
+        r.frames, r.misses, r.late);
+
+  // a 1 ms timer: same frames, up to a tick late
+  r = runScheduler(1024, 100, 3000, 2, true, 2000);
+  CHECK(r.frames == 199 && !r.misses && r.late <= 1000, "100 fps timer: %u frames, %u misses",
+        r.frames, r.misses);
+
+  // render 9 ms + wire 1.8 ms only fit 10 ms when they overlap
+  r = runScheduler(1024, 100, 9000, 2, false, 2000);
+  CHECK(!r.misses, "pipelined 9 ms render missed %u", r.misses);
+  r = runScheduler(1024, 100, 9000, 1, false, 2000);
+  CHECK(r.misses > 50, "one buffer, 9 ms render + wire: only %u misses", r.misses);
+
+  // 60 fps doesn't drift: 120 frames in 2 s
+  r = runScheduler(300, 60, 1000, 2, false, 2000);
+  CHECK(r.frames == 119 && !r.misses, "60 fps: %u frames, %u misses", r.frames, r.misses);
+
+  // render slower than the period: every other deadline
+  r = runScheduler(300, 100, 15000, 2, false, 2000);
+  CHECK(r.frames >= 99 && r.frames + r.misses == 199 && r.late <= 50,
+        "slow render: %u shown, %u missed, %u us late",
+        r.frames, r.misses, r.late);
+
+  // the wire is the limit: 8192 LEDs take ~18 ms, 100 fps can't happen
+  r = runScheduler(8192, 100, 500, 2, false, 2000);
+  CHECK(r.wireMisses > 50 && r.misses == r.wireMisses, "wire bound: %u wire misses of %u",
+        r.wireMisses, r.misses);
+}
@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------
+  Host checks and benchmarks: soft (bitbang) SPI.
+  See bench.h for the shared helpers, bench.cpp for the sections.
+  ------------------------------------------------------------------------*/
+
+#include "bench.h"
+#include "dotstar.h"
+
+// Soft SPI throughput ---------------------------------------------------------
+
+void benchShowSw(void) {
+  const char *engines[] = { "DOTSTAR_SOFT_FAST", "DOTSTAR_SOFT_TABLE",
+                            "DOTSTAR_SOFT_PINMAP" };
+  struct { const char *name; pin_t data, clock; } pins[] = {
+    { "D2/D4 (one port)", D2, D4 }, { "D2/D5 (two ports)", D2, D5 } };
+
+  header("show() software SPI (bitbang)", "bytes/us");
+  // Host time is mostly the GPIO stub; BSRR writes per bit is what carries
+  // over to the device, where each write is a bus store.
+  double writesPerBit[2][3];
+  for(int p=0; p<2; p++) {
+    for(int e=0; e<3; e++) {
+      char label[48];
+      snprintf(label, sizeof(label), "%s %s", pins[p].name, engines[e] + 13);
+      printf("%-34s", label);
+      for(uint16_t n : sizes) {
+        Adafruit_DotStar strip(n, pins[p].data, pins[p].clock, DOTSTAR_BGR);
+        strip.begin();
+        CHECK(strip.setSoftSPIMode((DotStarSoftSPI)e), "setSoftSPIMode(%s)", engines[e]);
+        fillPattern(strip);
+
+        host_gpio_probe(pins[p].clock);
+        strip.show();
+        std::vector<uint8_t> out = host_gpio_bytes(pins[p].data);
+        CHECK(host_gpio_edges() == frameBytes(n) * 8,
+              "%s: %u clock edges for %u LEDs", label, host_gpio_edges(), n);
+        CHECK(out.size() == frameBytes(n) &&
+              !memcmp(out.data(), strip.getPixels(), out.size()),
+              "%s: bitbanged data does not match the %u LED frame", label, n);
+        writesPerBit[p][e] = (double)host_gpio_writes() / host_gpio_edges();
+
+        host_gpio_reset();
+        double ns = timeIt(frameBytes(n), [&] { strip.show(); });
+        printf("%10.1f", 1000.0 / ns);
+      }
+      printf("\n");
+    }
+  }
+
+  printf("%-34s%10s%10s%10s   BSRR writes/bit\n", "", "FAST", "TABLE", "PINMAP");
+  for(int p=0; p<2; p++) {
+    printf("%-34s", pins[p].name);
+    for(int e=0; e<3; e++) printf("%10.2f", writesPerBit[p][e]);
+    printf("\n");
+  }
+  CHECK(writesPerBit[0][0] < 2.01 && writesPerBit[0][1] < 2.01,
+        "one-port engines should need 2 writes per bit");
+
+  // Partial frame, and moving the strip to other pins after begin()
+  Adafruit_DotStar strip(64, D2, D4, DOTSTAR_BGR);
+  strip.begin();
+  fillPattern(strip);
+  strip.setPartialShow(true);
+  strip.show();
+  strip.setPixelColor(9, 0x123456);
+  host_gpio_probe(D4);
+  strip.show();
+  std::vector<uint8_t> out = host_gpio_bytes(D2);
+  CHECK(out.size() == 4 + 10 * 4 + 2 &&
+        !memcmp(out.data(), strip.getPixels(), 4 + 10 * 4) &&
+        !out[out.size() - 1] && !out[out.size() - 2],
+        "partial bitbanged frame");
+  strip.updatePins(D3, D6);
+  strip.setPixelColor(0, 0xABCDEF);
+  host_gpio_probe(D6);
+  strip.show();
+  out = host_gpio_bytes(D3);
+  CHECK(out.size() >= 8 && !memcmp(out.data(), strip.getPixels(), 8),
+        "bitbang after updatePins()");
+}
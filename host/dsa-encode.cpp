@@ -0,0 +1,67 @@
+/*------------------------------------------------------------------------
+  Converts raw R,G,B frames to the DotStar animation format (DSA).
+
+  Usage: dsa-encode --leds N [--fps F] [--key K] [--no-palette] in.rgb out.dsa
+
+  in.rgb is frame after frame of N R,G,B triplets, e.g. from
+    ffmpeg -i clip.mp4 -vf scale=N:1 -f rawvideo -pix_fmt rgb24 in.rgb
+  ------------------------------------------------------------------------*/
+
+#include "dsa_encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int usage(void) {
+  fprintf(stderr, "usage: dsa-encode --leds N [--fps F] [--key K] [--no-palette] in.rgb out.dsa\n"
+                  "  --fps F        frame rate (default 30)\n"
+                  "  --key K        key frame every K frames (default 0: only when smaller)\n"
+                  "  --no-palette   always store R,G,B\n");
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  unsigned    leds = 0, fps = 30, key = 0;
+  bool        palette = true;
+  const char *files[2] = { NULL, NULL };
+  int         nfiles = 0;
+
+  for(int i=1; i<argc; i++) {
+    if(!strcmp(argv[i], "--leds") && (i + 1 < argc))      leds = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--fps") && (i + 1 < argc))  fps  = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--key") && (i + 1 < argc))  key  = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "--no-palette"))              palette = false;
+    else if((argv[i][0] != '-') && (nfiles < 2))           files[nfiles++] = argv[i];
+    else return usage();
+  }
+  if(!leds || (leds > 65535) || !fps || (nfiles != 2)) return usage();
+
+  FILE *in = fopen(files[0], "rb");
+  if(!in) {
+    perror(files[0]);
+    return 1;
+  }
+  std::vector<uint8_t> rgb;
+  uint8_t              buf[4096];
+  size_t               n;
+  while((n = fread(buf, 1, sizeof(buf), in)) > 0) rgb.insert(rgb.end(), buf, buf + n);
+  fclose(in);
+
+  uint32_t frames = rgb.size() / (leds * 3);
+  if(!frames) {
+    fprintf(stderr, "%s: less than one frame of %u LEDs\n", files[0], leds);
+    return 1;
+  }
+  std::vector<uint8_t> dsa = dsaEncode(rgb, leds, frames, 1000000UL / fps, key, palette);
+
+  FILE *out = fopen(files[1], "wb");
+  if(!out || (fwrite(dsa.data(), 1, dsa.size(), out) != dsa.size()) || fclose(out)) {
+    perror(files[1]);
+    return 1;
+  }
+  printf("%u frames of %u LEDs: %zu bytes, %.1f%% of the raw frames (%.2f bytes/LED)\n",
+         frames, leds, dsa.size(), 100.0 * dsa.size() / ((size_t)frames * leds * 4),
+         (double)dsa.size() / ((size_t)frames * leds));
+  return 0;
+}
@@ -0,0 +1,146 @@
+/*------------------------------------------------------------------------
+  Encoder for the DotStar animation format (DSA) played by DotStarPlayer.
+  ------------------------------------------------------------------------*/
+
+#include "dsa_encoder.h"
+#include "dotstar_player.h"
+
+#include <map>
+#include <string.h>
+
+/* Greedy, one pass per frame: LEDs equal to the previous frame become
+  skips (delta frames only), three or more equal colors in a row a run,
+  anything else literals.  A skip at the end of a frame is dropped, the
+  player leaves those LEDs alone anyway.
+*/
+
+static void put16(std::vector<uint8_t> &out, uint32_t v) {
+  out.push_back(v);
+  out.push_back(v >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t v) {
+  put16(out, v);
+  put16(out, v >> 16);
+}
+
+static uint32_t colorAt(const uint8_t *p) {
+  return ((uint32_t)p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+struct Coder {
+  const std::map<uint32_t, uint8_t> *index;   // Palette, or NULL
+  std::vector<uint8_t>               out;
+
+  void color(uint32_t c) {
+    if(index) {
+      out.push_back(index->find(c)->second);
+    } else {
+      out.push_back(c >> 16);
+      out.push_back(c >> 8);
+      out.push_back(c);
+    }
+  }
+};
+
+// Payload for one frame; prev == NULL makes a key frame
+static std::vector<uint8_t> encodeFrame(const uint8_t *cur, const uint8_t *prev,
+                                        uint16_t leds,
+                                        const std::map<uint32_t, uint8_t> *index) {
+  Coder    coder = { index, std::vector<uint8_t>() };
+  uint32_t i = 0;
+
+  while(i < leds) {
+    uint32_t n = 0;
+
+    if(prev) {                                // skip
+      while((i + n < leds) && !memcmp(&cur[(i + n) * 3], &prev[(i + n) * 3], 3)) n++;
+      if(i + n == leds) break;
+      for(i += n; n; ) {
+        uint32_t k = (n > 64) ? 64 : n;
+        coder.out.push_back(k - 1);
+        n -= k;
+      }
+    }
+
+    uint32_t c = colorAt(&cur[i * 3]);        // run
+    for(n = 1; (i + n < leds) && (colorAt(&cur[(i + n) * 3]) == c); n++);
+    if(n >= 3) {
+      while(n) {
+        uint32_t k = (n > 64) ? 64 : n;
+        coder.out.push_back(0x40 + k - 1);
+        coder.color(c);
+        n -= k;
+        i += k;
+      }
+      continue;
+    }
+
+    // literal, up to the next run of 3 or unchanged LED
+    uint32_t start = i;
+    while((i < leds) && (i - start < 64)) {
+      if(prev && !memcmp(&cur[i * 3], &prev[i * 3], 3)) break;
+      if((i + 2 < leds) && (colorAt(&cur[i * 3]) == colorAt(&cur[(i + 1) * 3])) &&
+         (colorAt(&cur[i * 3]) == colorAt(&cur[(i + 2) * 3])) && (i > start)) break;
+      i++;
+    }
+    coder.out.push_back(0x80 + (i - start) - 1);
+    for(uint32_t k=start; k<i; k++) coder.color(colorAt(&cur[k * 3]));
+  }
+  return coder.out;
+}
+
+std::vector<uint8_t> dsaEncode(const std::vector<uint8_t> &rgb, uint16_t leds,
+                               uint32_t frames, uint32_t frameMicros,
+                               uint32_t keyInterval, bool palette) {
+  std::vector<uint8_t> out;
+  if(!leds || (rgb.size() < (size_t)leds * 3 * frames)) return out;
+
+  std::map<uint32_t, uint8_t> index;
+  std::vector<uint32_t>       colors;
+  if(palette) {
+    for(size_t i=0; i<(size_t)leds * frames; i++) {
+      uint32_t c = colorAt(&rgb[i * 3]);
+      if(index.count(c)) continue;
+      if(colors.size() == 256) {
+        colors.clear();
+        index.clear();
+        break;
+      }
+      index[c] = colors.size();
+      colors.push_back(c);
+    }
+  }
+  const std::map<uint32_t, uint8_t> *map = colors.empty() ? NULL : &index;
+
+  out.insert(out.end(), "DSA1", "DSA1" + 4);
+  put16(out, leds);
+  put16(out, map ? 1 : 0);
+  put32(out, frames);
+  put32(out, frameMicros);
+  put16(out, colors.size());
+  for(uint32_t c : colors) {
+    out.push_back(c >> 16);
+    out.push_back(c >> 8);
+    out.push_back(c);
+  }
+
+  for(uint32_t f=0; f<frames; f++) {
+    const uint8_t *cur = &rgb[(size_t)f * leds * 3];
+    std::vector<uint8_t> payload = encodeFrame(cur, NULL, leds, map);
+    uint8_t              type    = DOTSTAR_DSA_KEY;
+    if(f && (!keyInterval || (f % keyInterval))) {
+      std::vector<uint8_t> delta = encodeFrame(cur, cur - leds * 3, leds, map);
+      if(delta.size() < payload.size()) {
+        payload.swap(delta);
+        type = DOTSTAR_DSA_DELTA;
+      }
+    }
+    out.push_back(type);
+    out.push_back(payload.size());
+    out.push_back(payload.size() >> 8);
+    out.push_back(payload.size() >> 16);
+    out.insert(out.end(), payload.begin(), payload.end());
+  }
+  return out;
+}
@@ -0,0 +1,20 @@
+/*------------------------------------------------------------------------
+  Encoder for the DotStar animation format (DSA) played by DotStarPlayer.
+  See firmware/dotstar_player.h for the format.
+  ------------------------------------------------------------------------*/
+
+#ifndef _DSA_ENCODER_H_
+#define _DSA_ENCODER_H_
+
+#include <stdint.h>
+#include <vector>
+
+// 'rgb' holds 'frames' frames of 'leds' R,G,B triplets.  A key frame goes
+// out every 'keyInterval' frames (0: only the first) and whenever it is
+// smaller than the delta.  An animation with 256 colors or fewer gets a
+// palette unless 'palette' is false.
+std::vector<uint8_t> dsaEncode(const std::vector<uint8_t> &rgb, uint16_t leds,
+                               uint32_t frames, uint32_t frameMicros,
+                               uint32_t keyInterval = 0, bool palette = true);
+
+#endif // _DSA_ENCODER_H_